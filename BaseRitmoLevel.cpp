@@ -4,8 +4,17 @@
 #include "BaseRitmoLevel.h"
 #include "RitmoLevelMeta.h"
 #include "SplineMeshHoldNote.h"
+#include "BinaryChart.h"
+#include "LaneNoteStream.h"
+#include "RitmoStats.h"
 #include "ObjectPool.h"
 #include "../WorldController.h"
+#include "Async/ParallelFor.h"
+#include "Framework/Application/SlateApplication.h"
+#include "Blueprint/SlateBlueprintLibrary.h"
+#include "Components/AudioComponent.h"
+#include "Sound/SoundWave.h"
+#include "EngineUtils.h"
 
 // Sets default values
 ABaseRitmoLevel::ABaseRitmoLevel()
@@ -29,8 +38,18 @@ ABaseRitmoLevel::ABaseRitmoLevel()
 void ABaseRitmoLevel::SetUpComponents()
 {
 	GetComponents<ULane>(Lanes);
+
+	SharedRingRadii.Init(0.0f, Lanes.Num());
+	SharedRingRadiusNames.Empty();
+	for (int i = 0; i < Lanes.Num(); i++)
+		SharedRingRadiusNames.Add(*FString::Printf(TEXT("Lane%iRingRadius"), i));
 	for (ULane* Lane : Lanes)
+	{
 		Lane->OwningLevel = this;
+		Lane->SetComponentTickEnabled(!bParallelLaneSimulation);
+		// Lanes read the song clock, which the level moves forward in its own tick
+		Lane->PrimaryComponentTick.AddPrerequisite(this, PrimaryActorTick);
+	}
 }
 
 void ABaseRitmoLevel::LoadLevel(FRitmoLevelPlayData& LevelMeta, FSongData& SongMeta, FVector SizeMultiplier)
@@ -39,26 +58,74 @@ void ABaseRitmoLevel::LoadLevel(FRitmoLevelPlayData& LevelMeta, FSongData& SongM
 	ReceiveComponentSetup();
 }
 
+void ABaseRitmoLevel::SetRunSeed(int32 Seed)
+{
+	RunSeed = Seed;
+	bFixedRunSeed = true;
+}
+
+bool ABaseRitmoLevel::LoadBinaryChart(const FString& Filename)
+{
+	TSharedPtr<const FBinaryChart> Chart = FBinaryChart::Open(Filename);
+	if (!Chart.IsValid())
+		return false;
+
+	for (int32 i = 0; i < Lanes.Num(); i++)
+		Lanes[i]->LoadNotes(FLaneNoteStream::FromBinaryChart(Chart.ToSharedRef(), i));
+
+	return true;
+}
+
+bool ABaseRitmoLevel::SaveBinaryChart(const FString& Filename)
+{
+	TArray<TSharedRef<const FLaneNoteStream>> LaneStreams;
+	for (ULane* Lane : Lanes)
+	{
+		TSharedPtr<const FLaneNoteStream> NoteStream = Lane->GetLoadedNoteStream();
+		if (!NoteStream.IsValid())
+			return false;
+
+		LaneStreams.Add(NoteStream.ToSharedRef());
+	}
+
+	return FBinaryChart::WriteToFile(LaneStreams, Filename);
+}
+
 void ABaseRitmoLevel::ResetLevel()
 {
 	ppMatDynamicArray.Empty();
+	MaterialParameters.Empty();
 
 	// Generate dynamic post processing materials 
 	ppMatDynamicArray.Add(UMaterialInstanceDynamic::Create(ppMatArray[ppMatArrayIndex], nullptr));
-	ppMatDynamicArray[ppMatArrayIndex]->SetScalarParameterValue("Intensity", 0.0f);
-	ppMatDynamicArray[ppMatArrayIndex]->SetScalarParameterValue("Speed", 0.0f);
+	SetEffectParameters(0.0f, 0.0f);
 	CameraComponent->PostProcessSettings.AddBlendable(ppMatDynamicArray[ppMatArrayIndex], 1.0f);
 	// Background blur post processing material
 	ppMatDynamicArray.Add(UMaterialInstanceDynamic::Create(ppMatArray[1], nullptr));
-	ppMatDynamicArray[1]->SetScalarParameterValue("Intensity", 0.0f);
+	RITMO_ADD_COUNTER(MIDsCreated, 2);
+	MaterialParameters.SetScalar(ppMatDynamicArray[1], "Intensity", 0.0f);
 	CameraComponent->PostProcessSettings.AddBlendable(ppMatDynamicArray[1], 1.0f);
 
+	// Also drops the audio position reported during the last run, the song starts again from the beginning
+	SongClock.Reset();
+
+	// Special notes are decided for the whole run before anything spawns
+	if (!bFixedRunSeed)
+		RunSeed = FMath::Rand();
+
+	if (bCsvCapturePerSong)
+		BeginSongCsvCapture();
+
 	for (ULane* Lane : Lanes)
 	{
+		Lane->ResolveSpecialNotes(RunSeed);
 		Lane->ResetLane();
 	}
 
 	Cast<ARhythmGameGameMode>(GetWorld()->GetAuthGameMode())->NotePool->OnNoteSpawned.AddUniqueDynamic(this, &ABaseRitmoLevel::NativeReceiveNoteSpawn);
+	// Hold notes the pool prewarming spawns need MaxHoldDuration to prewarm their own segments
+	PrewarmHoldNoteSegments();
+	PrewarmNotePool();
 
 	OnButtonPress.Clear();
 	OnButtonPress.AddUniqueDynamic(this, &ABaseRitmoLevel::ActivateButton);
@@ -70,26 +137,120 @@ void ABaseRitmoLevel::ResetLevel()
 
 void ABaseRitmoLevel::NativeReceiveNoteSpawn(ABaseNote* Note)
 {
+	if (bPrewarmingNotePool)
+	{
+		NotePoolStats.PrewarmedNotes++;
+	}
+	else
+	{
+		NotePoolStats.Misses++;
+		RITMO_INC_COUNTER(PoolMisses);
+		if (Cast<ARhythmGameGameMode>(GetWorld()->GetAuthGameMode())->bIsPlaying)
+			NotePoolStats.GrowthAllocations++;
+	}
+
 	if (Note->IsA(ASplineMeshHoldNote::StaticClass()))
 	{
-		Cast<ASplineMeshHoldNote>(Note)->OnSegmentSpawned.AddUniqueDynamic(this, &ABaseRitmoLevel::NativeReceiveSegmentSpawned);
+		ASplineMeshHoldNote* HoldNote = Cast<ASplineMeshHoldNote>(Note);
+		HoldNote->OnSegmentSpawned.AddUniqueDynamic(this, &ABaseRitmoLevel::NativeReceiveSegmentSpawned);
+		HoldNote->PrewarmBodyMeshes(HoldNote->GetBodySegmentsNum(MaxHoldDuration, MoveSpeed, MaxPathCurvature));
 	}
 	ReceiveNoteSpawn(Note);
 }
 
-void ABaseRitmoLevel::NativeReceiveSegmentSpawned(USplineMeshComponent* Segment)
+void ABaseRitmoLevel::PrewarmHoldNoteSegments()
+{
+	MaxHoldDuration = 0.0f;
+	MaxPathCurvature = 0.0f;
+	for (ULane* Lane : Lanes)
+	{
+		MaxPathCurvature = FMath::Max(MaxPathCurvature, Lane->GetMovementPathMaxCurvature());
+		if (Lane->GetNoteStream().IsValid())
+			MaxHoldDuration = FMath::Max(MaxHoldDuration, Lane->GetNoteStream()->MaxHoldDuration);
+	}
+
+	if (MaxHoldDuration <= 0.0f)
+		return;
+
+	for (TActorIterator<ASplineMeshHoldNote> It(GetWorld()); It; ++It)
+	{
+		It->PrewarmBodyMeshes(It->GetBodySegmentsNum(MaxHoldDuration, MoveSpeed, MaxPathCurvature));
+	}
+}
+
+void ABaseRitmoLevel::PrewarmNotePool()
+{
+	NotePoolStats = FNotePoolStats();
+
+	ARhythmGameGameMode* GameMode = Cast<ARhythmGameGameMode>(GetWorld()->GetAuthGameMode());
+	if (!GameMode || !GameMode->NotePool)
+		return;
+
+	// When every note of the chart is on the lanes
+	TArray<FNoteLifetime> Lifetimes;
+	for (ULane* Lane : Lanes)
+	{
+		if (Lane->GetNoteStream().IsValid() && Lane->GetMoveSpeed() > 0.0f)
+			Lane->GetNoteStream()->GetLifetimes(Lane->GetSpawnTimeOffset(), Lane->GetMovementPathLength() / Lane->GetMoveSpeed(), Lifetimes);
+	}
+
+	TMap<ENoteType, int32> PeakNotes;
+	FLaneNoteStream::GetPeakConcurrentNotes(Lifetimes, PeakNotes);
+
+	// Take the notes out of the pool all at once so it has to have (or spawn) that many, then give them back
+	bPrewarmingNotePool = true;
+	TArray<ABaseNote*> ReservedNotes;
+	for (const TPair<ENoteType, int32>& Peak : PeakNotes)
+	{
+		if (Peak.Value <= 0)
+			continue;
+
+		for (int32 i = 0; i < Peak.Value + NotePoolHeadroom; i++)
+		{
+			ABaseNote* Note = GameMode->NotePool->GetPooledObject(Peak.Key);
+			if (!Note || Note->NoteState.bActive)
+				break;
+
+			// Marked as in use so the pool hands out a different note next time
+			Note->NoteState.bActive = true;
+			ReservedNotes.Add(Note);
+		}
+	}
+	for (ABaseNote* Note : ReservedNotes)
+		Note->NoteState.bActive = false;
+	bPrewarmingNotePool = false;
+}
+
+void ABaseRitmoLevel::BeginSongCsvCapture()
 {
-	FLinearColor BodyColor;
-	UMaterialInstanceDynamic* DynamicMaterial = UMaterialInstanceDynamic::Create(Segment->GetMaterial(0), Segment);
+#if CSV_PROFILER
+	EndSongCsvCapture();
+
+	if (FCsvProfiler::Get()->IsCapturing())
+		return;
 
-	// Get the color from the existing note and apply it to the segment
-	FMaterialParameterInfo MatParamInfo;
-	MatParamInfo.Name = "Color";
+	FCsvProfiler::Get()->BeginCapture(-1, FString(), FString::Printf(TEXT("%s_%d_%s.csv"), *GetName(), RunSeed, *FDateTime::Now().ToString()));
+	CSV_METADATA(TEXT("RitmoLevel"), *GetName());
+	CSV_METADATA(TEXT("RitmoRunSeed"), *FString::FromInt(RunSeed));
+	bCapturingSongCsv = true;
+#endif
+}
+
+void ABaseRitmoLevel::EndSongCsvCapture()
+{
+#if CSV_PROFILER
+	if (!bCapturingSongCsv)
+		return;
 
-	Cast<ASplineMeshHoldNote>(Segment->GetAttachParent()->GetOwner())->BodyMeshCmp->GetMaterial(0)->GetVectorParameterValue(MatParamInfo, BodyColor);
-	DynamicMaterial->SetVectorParameterValue(FName("Color"), BodyColor);
-	Segment->SetMaterial(0, DynamicMaterial);
+	if (FCsvProfiler::Get()->IsCapturing())
+		FCsvProfiler::Get()->EndCapture();
+	bCapturingSongCsv = false;
+#endif
+}
 
+void ABaseRitmoLevel::NativeReceiveSegmentSpawned(USplineMeshComponent* Segment)
+{
+	// AcquireBodyMesh has already given the segment its note's body material
 	ReceiveNoteSegmentSpawn(Segment);
 }
 
@@ -98,11 +259,35 @@ void ABaseRitmoLevel::BeginPlay()
 {
 	Super::BeginPlay();
 
+	SongClock.LatencyOffset = AudioLatencyOffset;
+
+	if (SharedParameters)
+		SharedParametersInstance = GetWorld()->GetParameterCollectionInstance(SharedParameters);
+
 	CameraComponent->SetActive(true, true);
 	GetWorld()->GetFirstPlayerController()->SetViewTargetWithBlend(this, 0.0f, EViewTargetBlendFunction::VTBlend_Linear, 0.0f, false);
 
 	if (CameraTransforms.Num() && CameraTransformIndex < CameraTransforms.Num())
 		CameraComponent->SetWorldLocationAndRotation(CameraTransforms[CameraTransformIndex].Location, CameraTransforms[CameraTransformIndex].Rotation, false, nullptr, ETeleportType::None);
+
+	// Capture input as it comes in, before it gets polled by the frame
+	if (FSlateApplication::IsInitialized())
+	{
+		InputQueue = MakeShared<FTimedInputQueue>();
+		FSlateApplication::Get().RegisterInputPreProcessor(InputQueue);
+	}
+}
+
+void ABaseRitmoLevel::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	SetSongAudioComponent(nullptr);
+	EndSongCsvCapture();
+
+	if (InputQueue.IsValid() && FSlateApplication::IsInitialized())
+		FSlateApplication::Get().UnregisterInputPreProcessor(InputQueue);
+	InputQueue.Reset();
+
+	Super::EndPlay(EndPlayReason);
 }
 
 // Called every frame
@@ -110,13 +295,158 @@ void ABaseRitmoLevel::Tick(float DeltaTime)
 {
 	Super::Tick(DeltaTime);
 
-	if (Cast<ARhythmGameGameMode>(GetWorld()->GetAuthGameMode())->bIsPlaying)
+	MaterialParameters.BeginFrame();
+
+	ARhythmGameGameMode* GameMode = Cast<ARhythmGameGameMode>(GetWorld()->GetAuthGameMode());
+	if (GameMode->bIsPlaying)
 	{
+		// Keep the game mode's time in step with the song clock for everything that still reads it
+		GameMode->SecondsSinceStart = SongClock.Tick(DeltaTime);
+
+		DispatchInputEvents();
+
+		if (bParallelLaneSimulation)
+			TickLanes(DeltaTime);
+
 		if (CameraParams.bCamCanShake)
 			CameraShake(DeltaTime);
 
 		ppEffectsTick(DeltaTime);
 	}
+
+	// When the lanes tick on their own they run after this, so their ring values are shared the next frame
+	FlushSharedParameters();
+
+	// Counted from the notes on the lanes every frame, so it starts from 0 with every level instead of carrying over from the last one
+	int32 LiveHoldSegmentsNum = 0;
+	for (ULane* Lane : Lanes)
+	{
+		for (ABaseNote* Note : Lane->NoteActors)
+		{
+			if (const ASplineMeshHoldNote* HoldNote = Cast<ASplineMeshHoldNote>(Note))
+				LiveHoldSegmentsNum += HoldNote->GetLiveBodyMeshesNum();
+		}
+	}
+	RITMO_ADD_COUNTER(LiveHoldSegments, LiveHoldSegmentsNum);
+}
+
+void ABaseRitmoLevel::TickLanes(float DeltaTime)
+{
+	RITMO_SCOPE(TickLanes);
+
+	const float CurrentTime = SongClock.GetTime();
+
+	// Spawning takes notes out of the object pool and the path spline can only be read here, so both stay on the game thread
+	for (ULane* Lane : Lanes)
+	{
+		Lane->UpdateMovementPathTable();
+		Lane->NoteSpawn();
+	}
+
+	// The simulation only works on each lane's own note arrays, so the lanes don't have to wait for each other
+	ParallelFor(Lanes.Num(), [this, DeltaTime, CurrentTime](int32 LaneIdx)
+	{
+		Lanes[LaneIdx]->SimulateNotes(DeltaTime, CurrentTime);
+	});
+
+	// Transforms, delegates and materials can only be touched on the game thread
+	for (ULane* Lane : Lanes)
+	{
+		Lane->CommitTick(DeltaTime);
+	}
+}
+
+void ABaseRitmoLevel::DispatchInputEvents()
+{
+	RITMO_SCOPE(DispatchInput);
+
+	if (!InputQueue.IsValid())
+		return;
+
+	InputEvents.Reset();
+	if (!InputQueue->Drain(InputEvents))
+		return;
+
+	for (const FTimedInputEvent& Event : InputEvents)
+	{
+		ULane* Lane = nullptr;
+
+		if (Event.bPressed)
+		{
+			FVector2D PixelLoc, ViewportLoc;
+			USlateBlueprintLibrary::AbsoluteToViewport(GetWorld(), Event.ScreenLoc, PixelLoc, ViewportLoc);
+
+			for (ULane* CurLane : Lanes)
+			{
+				if (CurLane->IsWithinButton(PixelLoc))
+				{
+					Lane = CurLane;
+					break;
+				}
+			}
+			PointerLanes.Add(Event.PointerIdx, Lane);
+		}
+		else
+		{
+			PointerLanes.RemoveAndCopyValue(Event.PointerIdx, Lane);
+		}
+
+		if (Lane)
+			Lane->QueueInputTime(PlatformTimeToSongTime(Event.Timestamp), Event.bPressed);
+	}
+}
+
+void ABaseRitmoLevel::SetSongAudioComponent(UAudioComponent* AudioComponent)
+{
+	if (SongAudioComponent.IsValid())
+	{
+		SongAudioComponent->OnAudioPlaybackPercentNative.Remove(SongAudioPlaybackHandle);
+		SongAudioComponent->OnAudioFinishedNative.Remove(SongAudioFinishedHandle);
+	}
+	SongAudioComponent = AudioComponent;
+	SongAudioPlaybackHandle.Reset();
+	SongAudioFinishedHandle.Reset();
+	SongAudioClock.Reset();
+
+	if (!AudioComponent)
+	{
+		SongClock.SetAudioClock(nullptr);
+		return;
+	}
+
+	TSharedPtr<FReportedSongAudioClock> AudioClock = MakeShared<FReportedSongAudioClock>();
+	SongAudioPlaybackHandle = AudioComponent->OnAudioPlaybackPercentNative.AddLambda([AudioClock](const UAudioComponent*, const USoundWave* SoundWave, const float Percent)
+	{
+		AudioClock->ReportPlaybackTime(Percent * SoundWave->GetDuration());
+	});
+	SongAudioFinishedHandle = AudioComponent->OnAudioFinishedNative.AddUObject(this, &ABaseRitmoLevel::SongAudioFinished);
+	SongAudioClock = AudioClock;
+	SongClock.SetAudioClock(AudioClock);
+}
+
+void ABaseRitmoLevel::SongAudioFinished(UAudioComponent* AudioComponent)
+{
+	// Seek restarts the audio at the new time, which finishes the sound that was playing before
+	if (AudioComponent && AudioComponent->IsPlaying())
+		return;
+
+	// The last reported position would go stale, the clock just adds up the frame time once the audio is over
+	if (SongAudioClock.IsValid())
+		SongAudioClock->Stop();
+
+	// The song is over, so is its CSV
+	EndSongCsvCapture();
+}
+
+void ABaseRitmoLevel::SetAudioLatencyOffset(float NewOffset)
+{
+	AudioLatencyOffset = NewOffset;
+	SongClock.LatencyOffset = NewOffset;
+}
+
+float ABaseRitmoLevel::PlatformTimeToSongTime(double PlatformTime) const
+{
+	return SongClock.PlatformTimeToSongTime(PlatformTime);
 }
 
 // Called when the game is unpaused
@@ -171,6 +501,11 @@ void ABaseRitmoLevel::NoteMiss(ABaseNote* Note)
 
 }
 
+void ABaseRitmoLevel::NoteJudged(int LaneIdx, EJudgement Judgement, float Offset)
+{
+	ReceiveNoteJudged(Lanes[LaneIdx], Judgement, Offset);
+}
+
 void ABaseRitmoLevel::TouchHeld(float DeltaTime)
 {
 
@@ -200,6 +535,24 @@ void ABaseRitmoLevel::SetMoveSpeed(float NewSpeed)
 	ReceiveNewMoveSpeed(NewSpeed);
 }
 
+void ABaseRitmoLevel::Seek(float Time)
+{
+	// Lanes and hold notes read the time from the song clock, so it has to be moved first. The audio is moved with it,
+	// otherwise the clock would be pulled straight back to where the audio still is on the next tick
+	SongClock.Seek(Time);
+	if (SongAudioComponent.IsValid())
+		SongAudioComponent->Play((float)SongClock.GetPlaybackTime());
+
+	// Everything goes to the time the clock reports, with the latency offset already taken into account
+	const float SongTime = SongClock.GetTime();
+	Cast<ARhythmGameGameMode>(GetWorld()->GetAuthGameMode())->SecondsSinceStart = SongTime;
+
+	for (ULane* Lane : Lanes)
+	{
+		Lane->Seek(SongTime);
+	}
+}
+
 void ABaseRitmoLevel::NewCamTransform(FVector CamLoc, FRotator CamRot, float CamFov)
 {
 
@@ -209,6 +562,8 @@ void ABaseRitmoLevel::NewCamTransform(FVector CamLoc, FRotator CamRot, float Cam
 
 void ABaseRitmoLevel::ppEffectsTick(float DeltaTime)
 {
+	RITMO_SCOPE(PPEffectsTick);
+
 	//Gradually decrease effect over time
 	if (ppEffectSpeed > 0.0f)
 	{
@@ -220,11 +575,46 @@ void ABaseRitmoLevel::ppEffectsTick(float DeltaTime)
 			ppEffectAmount = 0.0f;
 			ppEffectSpeed = 0.0f;
 		}
-		ppMatDynamicArray[ppMatArrayIndex]->SetScalarParameterValue("Intensity", ppEffectAmount * 2.0f);
-		ppMatDynamicArray[ppMatArrayIndex]->SetScalarParameterValue("Speed", ppEffectSpeed * 2.0f);
+		SetEffectParameters(ppEffectAmount * 2.0f, ppEffectSpeed * 2.0f);
 	}
 }
 
+void ABaseRitmoLevel::SetEffectParameters(float Intensity, float Speed)
+{
+	if (SharedParametersInstance)
+	{
+		SharedEffectIntensity = Intensity;
+		SharedEffectSpeed = Speed;
+		return;
+	}
+
+	MaterialParameters.SetScalar(ppMatDynamicArray[ppMatArrayIndex], "Intensity", Intensity);
+	MaterialParameters.SetScalar(ppMatDynamicArray[ppMatArrayIndex], "Speed", Speed);
+}
+
+void ABaseRitmoLevel::SetRingRadius(int LaneIdx, UMaterialInstanceDynamic* RingMaterial, float Radius)
+{
+	if (SharedParametersInstance && SharedRingRadii.IsValidIndex(LaneIdx))
+	{
+		SharedRingRadii[LaneIdx] = Radius;
+		return;
+	}
+
+	MaterialParameters.SetScalar(RingMaterial, "Radius", Radius);
+}
+
+void ABaseRitmoLevel::FlushSharedParameters()
+{
+	if (!SharedParametersInstance)
+		return;
+
+	for (int i = 0; i < SharedRingRadii.Num(); i++)
+		MaterialParameters.SetCollectionScalar(SharedParametersInstance, SharedRingRadiusNames[i], SharedRingRadii[i]);
+
+	MaterialParameters.SetCollectionScalar(SharedParametersInstance, "EffectIntensity", SharedEffectIntensity);
+	MaterialParameters.SetCollectionScalar(SharedParametersInstance, "EffectSpeed", SharedEffectSpeed);
+}
+
 void ABaseRitmoLevel::ppGenerateEffect(float NewppEffectAmount)
 {
 	ppEffectAmount = NewppEffectAmount;
@@ -233,6 +623,8 @@ void ABaseRitmoLevel::ppGenerateEffect(float NewppEffectAmount)
 
 void ABaseRitmoLevel::CameraShake(float DeltaTime)
 {
+	RITMO_SCOPE(CameraShake);
+
 	if (ppEffectAmount <= 0.0f || ppEffectSpeed <= 0.0f)
 		return;
 
@@ -357,6 +749,15 @@ void ABaseRitmoLevel::PostEditChangeProperty(FPropertyChangedEvent& PropertyChan
 					Inner.SetUsingType("HoldSpline");
 			}
 		}
+		else if (Hold == FName("RibbonHoldNote"))
+		{
+			// The ribbon is built from the static body mesh, so it edits the same fields as a static hold note
+			for (FHoldNoteMeta& Note : PlayData.HoldNotesMeta)
+			{
+				for (FNoteMeta& Inner : Note.ComponentMeta)
+					Inner.SetUsingType("HoldStatic");
+			}
+		}
 	}
 	else
 	{
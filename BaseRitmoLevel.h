@@ -9,6 +9,11 @@
 // Ritmo classes
 #include "/RitmoLevelMeta.h"
 #include "Lane.h"
+#include "TimedInputQueue.h"
+#include "SongClock.h"
+#include "MaterialParameterCache.h"
+#include "Materials/MaterialParameterCollection.h"
+#include "Materials/MaterialParameterCollectionInstance.h"
 
 // Unreal includes
 #include "Engine.h"
@@ -28,6 +33,22 @@ DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FReceiveButtonLift, ULane*, TouchedL
 
 struct FSongData;
 
+// How the note pool was used since the level was last reset
+USTRUCT(BlueprintType)
+struct FNotePoolStats
+{
+	GENERATED_BODY()
+
+	// Notes the lanes took out of the pool
+	UPROPERTY(BlueprintReadOnly)	int32	Requests = 0;
+	// Requests the pool had to spawn a new note for
+	UPROPERTY(BlueprintReadOnly)	int32	Misses = 0;
+	// Misses that happened while playing. Should be 0 if the pool was prewarmed right
+	UPROPERTY(BlueprintReadOnly)	int32	GrowthAllocations = 0;
+	// Notes spawned by PrewarmNotePool
+	UPROPERTY(BlueprintReadOnly)	int32	PrewarmedNotes = 0;
+};
+
 USTRUCT(BlueprintType)
 struct FRitmoTransform
 {
@@ -50,6 +71,7 @@ public:
 	ABaseRitmoLevel();
 
 	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 	virtual void Tick(float DeltaTime) override;
 
 
@@ -76,6 +98,8 @@ public:
 		void ReceiveNoteHit(ABaseNote* Note);
 	UFUNCTION(BlueprintImplementableEvent, BlueprintCallable, meta = (DisplayName = "Note Miss"))
 		void ReceiveNoteMiss(ABaseNote* Note);
+	UFUNCTION(BlueprintImplementableEvent, BlueprintCallable, meta = (DisplayName = "Note Judged"))
+		void ReceiveNoteJudged(ULane* Lane, EJudgement Judgement, float Offset);
 	UFUNCTION(BlueprintImplementableEvent, BlueprintCallable, meta = (DisplayName = "Note Spawned"))
 		void ReceiveNoteSpawn(ABaseNote* Note);
 	UFUNCTION(BlueprintImplementableEvent, BlueprintCallable, meta = (DisplayName = "Hold Note Segment Spawned"))
@@ -90,6 +114,34 @@ public:
 	*/
 	virtual void CameraShake(float DeltaTime);
 
+	/* Ticks every lane in two phases: the note simulation of all lanes runs at once across worker threads,
+	* then the results are applied to the note actors, delegates and materials on the game thread lane by lane
+	*/
+	virtual void TickLanes(float DeltaTime);
+
+	/* Hands every press / release captured since the last call to the lane it landed on, in the order they happened, converted to song time.
+	* Called at the start of every tick, and by the lanes before they handle a press or a release so they always see the latest events
+	*/
+	void DispatchInputEvents();
+
+	/* Converts an FPlatformTime::Seconds() timestamp to seconds since the start of the level
+	*/
+	float PlatformTimeToSongTime(double PlatformTime) const;
+
+	/* Makes the song clock follow the playback position of the input audio component. Whoever plays the song should call this, nullptr to stop
+	* @param AudioComponent - The audio component playing the song
+	*/
+	UFUNCTION(BlueprintCallable) void SetSongAudioComponent(UAudioComponent* AudioComponent);
+
+	/* When the song audio has finished playing. The song clock carries on by itself from there
+	*/
+	void SongAudioFinished(UAudioComponent* AudioComponent);
+
+	/* Sets how late the player hears the audio, e.g. from the settings menu
+	* @param NewOffset - Latency in seconds
+	*/
+	UFUNCTION(BlueprintCallable) void SetAudioLatencyOffset(float NewOffset);
+
 	/* Called to load the level
 	* @param LevelMeta - Struct containing references to mesh assets that will be used by the notes
 	* @param SongMeta - Struct containing info about the song: sound wave, level map, etc
@@ -97,6 +149,20 @@ public:
 	*/
 	virtual void LoadLevel(FRitmoLevelPlayData& LevelMeta, FSongData& SongMeta, FVector SizeMultiplier);
 
+	/* Gives every lane its notes from a binary chart file (see FBinaryChart) instead of a level map. The file is memory-mapped where possible
+	* and stays mapped while the lanes read their notes from it
+	* @param Filename	- Path to the .rchart file
+	* @return			- False if the file couldn't be opened or isn't a valid chart
+	*/
+	UFUNCTION(BlueprintCallable) bool LoadBinaryChart(const FString& Filename);
+
+	/* Converts the level map the lanes were given in LoadLevel into a binary chart file, so the level can be loaded with LoadBinaryChart
+	* from then on. The notes are saved as loaded, without the special notes of the current run
+	* @param Filename	- Path of the .rchart file to write
+	* @return			- False if a lane has no notes loaded or the file couldn't be written
+	*/
+	UFUNCTION(BlueprintCallable) bool SaveBinaryChart(const FString& Filename);
+
 	/* When we resume the game from a pause state
 	*/
 	UFUNCTION(BlueprintCallable)
@@ -118,6 +184,10 @@ public:
 	*/
 	UFUNCTION() virtual void NoteMiss(ABaseNote* Note);
 
+	/* When a press on a lane has been judged against a note's time, or a note went past without a press (MISS)
+	*/
+	UFUNCTION() virtual void NoteJudged(int LaneIdx, EJudgement Judgement, float Offset);
+
 	/* Each frame the user holds within the button bounds
 	*/
 	virtual void TouchHeld(float DeltaTime);
@@ -132,6 +202,12 @@ public:
 
 	virtual void SetMoveSpeed(float NewSpeed);
 
+	/* Jumps the level to any point of the song (test mode, practice looping). Every lane brings back the notes that should be on it at that time.
+	* The song audio set with SetSongAudioComponent is moved with it
+	* @param Time - Seconds since the start of the level to jump to, as the player hears it
+	*/
+	UFUNCTION(BlueprintCallable) virtual void Seek(float Time);
+
 	/* Called every time the camera location, rotation or fov is changed
 	*/
 	virtual void NewCamTransform(FVector CamLoc, FRotator CamRot, float CamFov);
@@ -145,7 +221,32 @@ public:
 	*/
 	UFUNCTION() virtual void NativeReceiveNoteSpawn(ABaseNote* Note);
 
+	/* Makes every following run use the input seed for its special notes instead of a new random one, e.g. for replays and perf comparisons
+	* @param Seed - Seed to resolve the special notes with
+	*/
+	UFUNCTION(BlueprintCallable) void SetRunSeed(int32 Seed);
+
+	/* Makes every spline mesh hold note create the body segments the longest hold of the loaded chart needs, so none are created while playing.
+	* Call once the lanes have their notes. Hold notes spawned afterwards are prewarmed as they spawn
+	*/
+	UFUNCTION(BlueprintCallable) virtual void PrewarmHoldNoteSegments();
+
+	/* Fills the note pool with as many notes of each type as the loaded chart ever has on the lanes at once, so none are spawned while playing.
+	* Special notes are already resolved by then, so the counts are exact. Call once the lanes have their notes, before Post-Load
+	*/
+	UFUNCTION(BlueprintCallable) virtual void PrewarmNotePool();
+
+	/* Starts a CSV profile capture of the run that is about to play, ending the previous run's capture if it is still going. ResetLevel calls this
+	* when bCsvCapturePerSong is set. Captures started by hand are left alone. Does nothing in builds without the CSV profiler
+	*/
+	UFUNCTION(BlueprintCallable) void BeginSongCsvCapture();
+
+	/* Ends the capture started by BeginSongCsvCapture and writes it out. SongAudioFinished calls this when the song finishes, EndPlay when the level ends
+	*/
+	UFUNCTION(BlueprintCallable) void EndSongCsvCapture();
+
 	/* When a hold note spawns a segment i.e. when it occupies a longer duration.   If you need to do anything to hold note segments at runtime before they're seen. Do it here 
+	* Every segment of a note uses the note's BodyMaterial, so changing a parameter on it changes the whole body
 	* @param Segment - The new segment spawned
 	*/
 	UFUNCTION() virtual void NativeReceiveSegmentSpawned(USplineMeshComponent* Segment);
@@ -154,6 +255,17 @@ public:
 
 	UFUNCTION(BlueprintCallable) TArray<ULane*> GetLanes() { return Lanes; }
 	UFUNCTION(BlueprintCallable) float			GetMoveSpeed() { return MoveSpeed;  }
+	// Time of the song in seconds since the start of the level. Everything that is synced to the music should read this
+	UFUNCTION(BlueprintCallable) float			GetSongTime() const { return SongClock.GetTime(); }
+	// Seed the special notes of the current run were resolved with. Pass it to SetRunSeed to play the same notes again
+	UFUNCTION(BlueprintCallable) int32			GetRunSeed() const { return RunSeed; }
+	// Pool requests that didn't have to spawn a new note are Requests - Misses
+	UFUNCTION(BlueprintCallable) FNotePoolStats	GetNotePoolStats() const { return NotePoolStats; }
+
+	/* ############################################# PUBLIC VARIABLES ############################################# */
+
+	// Counted by the lanes as they take notes out of the pool and by NativeReceiveNoteSpawn as the pool spawns them
+	FNotePoolStats																NotePoolStats;
 
 	/* ############################################# DELEGATES ############################################# */
 
@@ -193,6 +305,12 @@ public:
 
 	// Note move speed
 	UPROPERTY(EditDefaultsOnly)															float						MoveSpeed;
+	// How late (s) the player hears the audio compared to when it's played. See SetAudioLatencyOffset
+	UPROPERTY(BlueprintReadOnly, EditDefaultsOnly)										float						AudioLatencyOffset = 0.0f;
+	// When true the level ticks the lanes itself and simulates them in parallel, instead of every lane ticking on its own
+	UPROPERTY(EditDefaultsOnly)															bool						bParallelLaneSimulation = true;
+	// When true every run of the level is captured into its own CSV profile (Saved/Profiling/CSV). See RitmoStats.h for what is in it
+	UPROPERTY(EditAnywhere)																bool						bCsvCapturePerSong = false;
 	UPROPERTY(BlueprintReadOnly, EditDefaultsOnly)										bool						bDelayStart = false;
 	// How long to wait at the start of the game before notes are spawned
 	UPROPERTY(BlueprintReadOnly, EditDefaultsOnly)										float						StartDelay = 4.0f;
@@ -231,6 +349,53 @@ public:
 	/* Gradually decreases the glitch and camera shake effect over time
 	*/
 	virtual void ppEffectsTick(float DeltaTime);
+
+	/* Sets the intensity and speed of the glitch effect. Written once per frame to SharedParameters if it's set, otherwise to the glitch material
+	*/
+	void SetEffectParameters(float Intensity, float Speed);
+
+	/* Sets how far a lane's ring is filled in with its new colour. Written once per frame to SharedParameters if it's set, otherwise to the ring material
+	* @param LaneIdx		- Lane of the ring
+	* @param RingMaterial	- Material of the ring
+	* @param Radius			- 0 - 1
+	*/
+	void SetRingRadius(int LaneIdx, UMaterialInstanceDynamic* RingMaterial, float Radius);
+
+	/* Writes the values shared through SharedParameters for this frame
+	*/
+	void FlushSharedParameters();
+
+	// Number of material parameter writes made / skipped during the last frame
+	UFUNCTION(BlueprintCallable) int32 GetMaterialParameterWrites() const { return MaterialParameters.GetLastFrameStats().Writes + MaterialParameters.GetLastFrameStats().CollectionWrites; }
+	UFUNCTION(BlueprintCallable) int32 GetSkippedMaterialParameterWrites() const { return MaterialParameters.GetLastFrameStats().SkippedWrites; }
+
+	// Every material parameter write of the level and its lanes goes through this, so values that haven't changed aren't written again
+	FMaterialParameterCache												MaterialParameters;
+
+	// Optional collection the values animated every frame (ring fill, glitch intensity / speed) are written to once per frame, instead of
+	// to every material that uses them. Materials have to read "Lane<Idx>RingRadius", "EffectIntensity" and "EffectSpeed" from it
+	UPROPERTY(EditDefaultsOnly, Category = "Camera | PostProcessing")		UMaterialParameterCollection*			SharedParameters;
+	UPROPERTY()																UMaterialParameterCollectionInstance*	SharedParametersInstance;
+	// Values waiting to be written to SharedParameters
+	TArray<float>															SharedRingRadii;
+	TArray<FName>															SharedRingRadiusNames;
+	float																	SharedEffectIntensity = 0.0f;
+	float																	SharedEffectSpeed = 0.0f;
+
+	// The longest hold of the loaded chart and the tightest bend of any lane's movement path, see PrewarmHoldNoteSegments
+	float																	MaxHoldDuration = 0.0f;
+	float																	MaxPathCurvature = 0.0f;
+
+	// Seed the special notes of every lane are resolved with when the level is reset. A new one is picked for every run unless bFixedRunSeed is set
+	UPROPERTY(EditAnywhere)													int32									RunSeed = 0;
+	UPROPERTY(EditAnywhere)													bool									bFixedRunSeed = false;
+
+	// Extra notes of each type PrewarmNotePool adds on top of the peak of the chart, for notes that stay around a little after they leave the path
+	UPROPERTY(EditDefaultsOnly)												int32									NotePoolHeadroom = 2;
+	// True while PrewarmNotePool is filling the pool, so the notes it spawns aren't counted as misses
+	bool																	bPrewarmingNotePool = false;
+	// True while the CSV profiler is capturing a run for BeginSongCsvCapture
+	bool																	bCapturingSongCsv = false;
 	
 	/* Starts the glitch and camera shake effect
 	*/
@@ -249,6 +414,20 @@ protected:
 	UPROPERTY(BlueprintReadWrite)								TArray<ULane*>				Lanes;
 	UPROPERTY(BlueprintReadWrite)								FVector						ViewportSizeMultiplier;
 
+	// The time of the song, following the audio playback. See GetSongTime
+	FSongClock													SongClock;
+	TWeakObjectPtr<UAudioComponent>								SongAudioComponent;
+	// The playback position of SongAudioComponent the song clock follows
+	TSharedPtr<FReportedSongAudioClock>							SongAudioClock;
+	FDelegateHandle												SongAudioPlaybackHandle;
+	FDelegateHandle												SongAudioFinishedHandle;
+
+	// Presses and releases captured with the time they happened, see DispatchInputEvents
+	TSharedPtr<FTimedInputQueue>								InputQueue;
+	TArray<FTimedInputEvent>									InputEvents;
+	// The lane every touch currently down was pressed on, so its release goes to the same lane even if the touch moved
+	TMap<uint32, ULane*>										PointerLanes;
+
 
 	UPROPERTY(BlueprintReadOnly, EditDefaultsOnly, meta = (DisplayName = "Show Debug Messages"))				bool	bDebugMessages;
 
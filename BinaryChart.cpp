@@ -0,0 +1,269 @@
+/*  Copyright (C) 2020-2021 Ilya Tsykunov (ilya@ilyatsykunov.com)
+*/
+
+#include "BinaryChart.h"
+
+#include "LaneNoteStream.h"
+#include "Algo/BinarySearch.h"
+#include "Async/MappedFileHandle.h"
+#include "HAL/PlatformFilemanager.h"
+#include "Misc/FileHelper.h"
+
+FBinaryChart::~FBinaryChart()
+{
+	// The region has to go before the file it maps
+	delete MappedRegion;
+	delete MappedFile;
+}
+
+TSharedPtr<const FBinaryChart> FBinaryChart::Open(const FString& Filename)
+{
+	IMappedFileHandle* MappedFile = FPlatformFileManager::Get().GetPlatformFile().OpenMapped(*Filename);
+	IMappedFileRegion* MappedRegion = MappedFile ? MappedFile->MapRegion(0, MappedFile->GetFileSize()) : nullptr;
+
+	if (!MappedRegion)
+	{
+		delete MappedFile;
+
+		// Files that can't be mapped are read in one go instead
+		TArray<uint8> FileData;
+		if (!FFileHelper::LoadFileToArray(FileData, *Filename))
+			return nullptr;
+
+		return FromMemory(MoveTemp(FileData));
+	}
+
+	TSharedRef<FBinaryChart> Chart = MakeShareable(new FBinaryChart());
+	Chart->MappedFile = MappedFile;
+	Chart->MappedRegion = MappedRegion;
+	Chart->Data = MappedRegion->GetMappedPtr();
+
+	if (!Chart->Validate(MappedRegion->GetMappedSize()))
+		return nullptr;
+
+	return Chart;
+}
+
+TSharedPtr<const FBinaryChart> FBinaryChart::FromMemory(TArray<uint8>&& Data)
+{
+	TSharedRef<FBinaryChart> Chart = MakeShareable(new FBinaryChart());
+	Chart->LoadedData = MoveTemp(Data);
+	Chart->Data = Chart->LoadedData.GetData();
+
+	if (!Chart->Validate(Chart->LoadedData.Num()))
+		return nullptr;
+
+	return Chart;
+}
+
+bool FBinaryChart::Validate(int64 DataSize)
+{
+	if (!Data || DataSize < (int64)sizeof(FBinaryChartHeader) || !IsAligned(Data, alignof(uint32)))
+		return false;
+
+	Header = (const FBinaryChartHeader*)Data;
+	if (Header->Magic != BinaryChart::Magic || Header->Version > BinaryChart::Version || Header->TicksPerSecond == 0 || Header->FileSize > DataSize)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Binary chart is not a valid version %u chart"), BinaryChart::Version);
+		return false;
+	}
+
+	const int64 LanesEnd = sizeof(FBinaryChartHeader) + (int64)Header->LanesNum * sizeof(FBinaryChartLane);
+	if (LanesEnd > Header->FileSize)
+		return false;
+
+	Lanes = (const FBinaryChartLane*)(Data + sizeof(FBinaryChartHeader));
+
+	for (uint32 i = 0; i < Header->LanesNum; i++)
+	{
+		const FBinaryChartLane& Lane = Lanes[i];
+		const int64 RecordsEnd = (int64)Lane.RecordsOffset + (int64)Lane.NotesNum * sizeof(FBinaryChartRecord);
+		const int64 KeyframesEnd = (int64)Lane.KeyframesOffset + (int64)Lane.KeyframesNum * sizeof(FBinaryChartKeyframe);
+
+		if (RecordsEnd > Header->FileSize || KeyframesEnd > Header->FileSize || Lane.RecordsOffset % alignof(uint32) || Lane.KeyframesOffset % alignof(uint32) ||
+			Lane.KeyframesNum != FMath::DivideAndRoundUp(Lane.NotesNum, BinaryChart::KeyframeInterval))
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Binary chart lane %u is cut short"), i);
+			return false;
+		}
+
+		// GetNoteTicks and LowerBound start decoding from a keyframe, so every keyframe has to point at the record it is kept for and
+		// keyframes can't go back in time, otherwise a search could end up past the lane's last record
+		const FBinaryChartKeyframe* Keyframes = GetKeyframes(i);
+		for (uint32 KeyframeIdx = 0; KeyframeIdx < Lane.KeyframesNum; KeyframeIdx++)
+		{
+			if (Keyframes[KeyframeIdx].RecordIdx != KeyframeIdx * BinaryChart::KeyframeInterval ||
+				(KeyframeIdx > 0 && Keyframes[KeyframeIdx].Ticks < Keyframes[KeyframeIdx - 1].Ticks))
+			{
+				UE_LOG(LogTemp, Warning, TEXT("Binary chart lane %u has an invalid keyframe %u"), i, KeyframeIdx);
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+bool FBinaryChartRecord::IsValidType() const
+{
+	switch (GetType())
+	{
+	case ENoteType::SINGLE:
+	case ENoteType::HOLD:
+	case ENoteType::SWIPE:
+	case ENoteType::BOMB:
+	case ENoteType::IGC:
+	case ENoteType::RANDOM:
+		return true;
+	default:
+		return false;
+	}
+}
+
+void FBinaryChart::Write(const TArray<TSharedRef<const FLaneNoteStream>>& LaneStreams, TArray<uint8>& OutData)
+{
+	const int32 LanesNum = LaneStreams.Num();
+
+	// Work out where every lane goes: the header, the lane table, then the records and keyframes of each lane
+	TArray<FBinaryChartLane> Lanes;
+	Lanes.SetNumZeroed(LanesNum);
+
+	uint32 Offset = sizeof(FBinaryChartHeader) + LanesNum * sizeof(FBinaryChartLane);
+	uint32 NotesNum = 0;
+	for (int32 i = 0; i < LanesNum; i++)
+	{
+		Lanes[i].NotesNum = LaneStreams[i]->Num();
+		Lanes[i].KeyframesNum = FMath::DivideAndRoundUp<uint32>(Lanes[i].NotesNum, BinaryChart::KeyframeInterval);
+		Lanes[i].RecordsOffset = Offset;
+		Offset += Lanes[i].NotesNum * sizeof(FBinaryChartRecord);
+		Lanes[i].KeyframesOffset = Offset;
+		Offset += Lanes[i].KeyframesNum * sizeof(FBinaryChartKeyframe);
+		NotesNum += Lanes[i].NotesNum;
+	}
+
+	OutData.SetNumZeroed(Offset);
+
+	// Absolute tick of every note of every lane, used for the peak density of the whole chart
+	TArray<uint32> AllTicks;
+	AllTicks.Reserve(NotesNum);
+
+	// Most ticks in a sorted array that fall within any one second
+	auto GetPeakPerSecond = [](const TArray<uint32>& Ticks)
+	{
+		uint32 Peak = 0;
+		for (int32 First = 0, Last = 0; Last < Ticks.Num(); Last++)
+		{
+			while (Ticks[Last] - Ticks[First] >= BinaryChart::TicksPerSecond)
+				First++;
+			Peak = FMath::Max<uint32>(Peak, Last - First + 1);
+		}
+		return Peak;
+	};
+
+	TArray<uint32> LaneTicks;
+	for (int32 i = 0; i < LanesNum; i++)
+	{
+		const FLaneNoteStream& Stream = *LaneStreams[i];
+		FBinaryChartLane& Lane = Lanes[i];
+		FBinaryChartRecord* Records = (FBinaryChartRecord*)(OutData.GetData() + Lane.RecordsOffset);
+		FBinaryChartKeyframe* Keyframes = (FBinaryChartKeyframe*)(OutData.GetData() + Lane.KeyframesOffset);
+
+		LaneTicks.Reset();
+		uint32 PrevTicks = 0;
+		Stream.ForEachNote([&](int32 NoteIdx, const FLaneNote& Note)
+		{
+			// Notes are in time order, so a note can never be before the previous one
+			const uint32 Ticks = FMath::Max<uint32>(FMath::RoundToInt(FMath::Max(Note.Time, 0.0f) * BinaryChart::TicksPerSecond), PrevTicks);
+			const uint32 HoldTicks = FMath::Min<uint32>(FMath::RoundToInt(FMath::Max(Note.HoldDuration, 0.0f) * BinaryChart::TicksPerSecond), 0x00FFFFFF);
+
+			Records[NoteIdx].DeltaTicks = Ticks - PrevTicks;
+			Records[NoteIdx].HoldTicksAndType = HoldTicks | ((uint32)Note.Type << 24);
+
+			if (NoteIdx % BinaryChart::KeyframeInterval == 0)
+				Keyframes[NoteIdx / BinaryChart::KeyframeInterval] = { (uint32)NoteIdx, Ticks };
+
+			Lane.MaxHoldTicks = FMath::Max(Lane.MaxHoldTicks, HoldTicks);
+			LaneTicks.Add(Ticks);
+			PrevTicks = Ticks;
+		});
+
+		Lane.PeakNotesPerSecond = GetPeakPerSecond(LaneTicks);
+		AllTicks.Append(LaneTicks);
+	}
+
+	AllTicks.Sort();
+
+	FBinaryChartHeader& Header = *(FBinaryChartHeader*)OutData.GetData();
+	Header.Magic = BinaryChart::Magic;
+	Header.Version = BinaryChart::Version;
+	Header.LanesNum = LanesNum;
+	Header.TicksPerSecond = BinaryChart::TicksPerSecond;
+	Header.NotesNum = NotesNum;
+	Header.PeakNotesPerSecond = GetPeakPerSecond(AllTicks);
+	Header.FileSize = OutData.Num();
+
+	FMemory::Memcpy(OutData.GetData() + sizeof(FBinaryChartHeader), Lanes.GetData(), LanesNum * sizeof(FBinaryChartLane));
+}
+
+void FBinaryChart::Write(const TArray<FLevelMapRow>& Rows, int32 LanesNum, const TArray<TArray<TPair<float, float>>>& HoldNoteData, TArray<uint8>& OutData)
+{
+	TArray<TSharedRef<const FLaneNoteStream>> LaneStreams;
+	for (int32 i = 0; i < LanesNum; i++)
+		LaneStreams.Add(FLaneNoteStream::Compile(Rows, i, HoldNoteData.IsValidIndex(i) ? HoldNoteData[i] : TArray<TPair<float, float>>()));
+
+	Write(LaneStreams, OutData);
+}
+
+bool FBinaryChart::WriteToFile(const TArray<TSharedRef<const FLaneNoteStream>>& LaneStreams, const FString& Filename)
+{
+	TArray<uint8> Data;
+	Write(LaneStreams, Data);
+	return FFileHelper::SaveArrayToFile(Data, *Filename);
+}
+
+bool FBinaryChart::WriteToFile(const TArray<FLevelMapRow>& Rows, int32 LanesNum, const TArray<TArray<TPair<float, float>>>& HoldNoteData, const FString& Filename)
+{
+	TArray<uint8> Data;
+	Write(Rows, LanesNum, HoldNoteData, Data);
+	return FFileHelper::SaveArrayToFile(Data, *Filename);
+}
+
+uint32 FBinaryChart::GetNoteTicks(int32 LaneIdx, int32 NoteIdx) const
+{
+	check(NoteIdx >= 0 && (uint32)NoteIdx < Lanes[LaneIdx].NotesNum);
+
+	const FBinaryChartKeyframe& Keyframe = GetKeyframes(LaneIdx)[NoteIdx / BinaryChart::KeyframeInterval];
+	const FBinaryChartRecord* Records = GetRecords(LaneIdx);
+
+	uint32 Ticks = Keyframe.Ticks;
+	for (int32 i = Keyframe.RecordIdx + 1; i <= NoteIdx; i++)
+		Ticks += Records[i].DeltaTicks;
+
+	return Ticks;
+}
+
+int32 FBinaryChart::LowerBound(int32 LaneIdx, float Time) const
+{
+	const FBinaryChartLane& Lane = Lanes[LaneIdx];
+	if (Lane.NotesNum == 0)
+		return 0;
+
+	const uint32 Ticks = (uint32)FMath::Max(FMath::CeilToInt((double)Time * Header->TicksPerSecond), 0);
+	const FBinaryChartKeyframe* Keyframes = GetKeyframes(LaneIdx);
+	const FBinaryChartRecord* Records = GetRecords(LaneIdx);
+
+	// The last keyframe before the time, then walk the records after it
+	const int32 KeyframeIdx = FMath::Max(Algo::LowerBoundBy(TArrayView<const FBinaryChartKeyframe>(Keyframes, Lane.KeyframesNum), Ticks,
+		[](const FBinaryChartKeyframe& Keyframe) { return Keyframe.Ticks; }) - 1, 0);
+
+	uint32 RecordTicks = Keyframes[KeyframeIdx].Ticks;
+	int32 RecordIdx = Keyframes[KeyframeIdx].RecordIdx;
+	while (RecordTicks < Ticks)
+	{
+		if (++RecordIdx >= (int32)Lane.NotesNum)
+			break;
+		RecordTicks += Records[RecordIdx].DeltaTicks;
+	}
+
+	return RecordIdx;
+}
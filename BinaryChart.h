@@ -0,0 +1,169 @@
+/*  A compact binary chart that can be memory-mapped and read in place. The file is a header, a table with one entry per lane and then each
+	lane's notes as fixed-width records. A record holds the time since the previous note of the lane in integer ticks, the note type and the
+	hold duration, so no separate hold data is needed. Every KeyframeInterval records the lane also keeps a keyframe with the absolute time,
+	so any note can be found without decoding the lane from the start.
+
+	Every field is a little-endian uint32 (or packed into one), so the data can be used straight out of the mapped file.
+
+	Copyright (C) 2020-2021 Ilya Tsykunov (ilya@ilyatsykunov.com)
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "EnumTypes.h"
+#include "NoteMap.h"
+
+struct FLaneNoteStream;
+class IMappedFileHandle;
+class IMappedFileRegion;
+
+static_assert(PLATFORM_LITTLE_ENDIAN, "Binary charts are stored little-endian and read in place");
+
+struct FBinaryChartHeader
+{
+	// Has to be BinaryChart::Magic
+	uint32	Magic;
+	// BinaryChart::Version of the converter the file was written with
+	uint32	Version;
+	uint32	LanesNum;
+	// Timestamps and hold durations are stored as integer ticks of 1 / TicksPerSecond seconds
+	uint32	TicksPerSecond;
+	// Notes of every lane together
+	uint32	NotesNum;
+	// The most notes of every lane together that reach the button within any single second
+	uint32	PeakNotesPerSecond;
+	// Size of the whole file, used to check it isn't cut short
+	uint32	FileSize;
+	uint32	Reserved;
+};
+
+struct FBinaryChartLane
+{
+	uint32	NotesNum;
+	// Offset of the lane's first FBinaryChartRecord from the start of the file
+	uint32	RecordsOffset;
+	uint32	KeyframesNum;
+	// Offset of the lane's first FBinaryChartKeyframe from the start of the file
+	uint32	KeyframesOffset;
+	// The longest hold of the lane in ticks
+	uint32	MaxHoldTicks;
+	// The most notes of this lane that reach the button within any single second
+	uint32	PeakNotesPerSecond;
+};
+
+struct FBinaryChartRecord
+{
+	// Ticks since the previous note of the lane, or since 0 for the first one
+	uint32	DeltaTicks;
+	// Lower 24 bits - hold duration in ticks, upper 8 bits - ENoteType
+	uint32	HoldTicksAndType;
+
+	inline uint32		GetHoldTicks() const	{ return HoldTicksAndType & 0x00FFFFFF; }
+	inline ENoteType	GetType() const			{ return (ENoteType)(HoldTicksAndType >> 24); }
+
+	/* Whether the record's type is one a lane spawns: SINGLE, HOLD, SWIPE, BOMB, IGC or RANDOM. Records of any other type are read as EMPTY
+	*/
+	bool IsValidType() const;
+};
+
+struct FBinaryChartKeyframe
+{
+	// Index of the record in the lane
+	uint32	RecordIdx;
+	// Absolute time of that record in ticks
+	uint32	Ticks;
+};
+
+namespace BinaryChart
+{
+	// "RTMC"
+	static constexpr uint32 Magic = 0x434D5452;
+	// Bump whenever the layout changes. Files newer than this are refused
+	static constexpr uint32 Version = 1;
+	static constexpr uint32 TicksPerSecond = 10000;
+	// A keyframe is kept for every this many records of a lane
+	static constexpr uint32 KeyframeInterval = 64;
+}
+
+class FBinaryChart
+{
+public:
+
+	~FBinaryChart();
+
+	/* Opens a binary chart file by memory-mapping it, or by reading it into memory if the file can't be mapped (e.g. it is compressed in a pak)
+	* @param Filename	- Path to the .rchart file
+	* @return			- The chart, or null if the file couldn't be opened or isn't a valid chart
+	*/
+	static TSharedPtr<const FBinaryChart> Open(const FString& Filename);
+
+	/* Wraps a chart that is already in memory
+	* @param Data	- Contents of a binary chart file
+	* @return		- The chart, or null if the data isn't a valid chart
+	*/
+	static TSharedPtr<const FBinaryChart> FromMemory(TArray<uint8>&& Data);
+
+	/* Converts compiled note streams into a binary chart
+	* @param LaneStreams	- Notes of each lane, in lane order
+	* @param OutData		- Contents of the binary chart file
+	*/
+	static void Write(const TArray<TSharedRef<const FLaneNoteStream>>& LaneStreams, TArray<uint8>& OutData);
+
+	/* Converts a level map into a binary chart
+	* @param Rows			- Array containing the note types and times to spawn them at
+	* @param LanesNum		- Number of lanes of the level map
+	* @param HoldNoteData	- <Time value of entry, duration> of every hold note of each lane, in order
+	* @param OutData		- Contents of the binary chart file
+	*/
+	static void Write(const TArray<FLevelMapRow>& Rows, int32 LanesNum, const TArray<TArray<TPair<float, float>>>& HoldNoteData, TArray<uint8>& OutData);
+
+	/* Converts compiled note streams and saves them as a binary chart file
+	* @return - True if the file was written
+	*/
+	static bool WriteToFile(const TArray<TSharedRef<const FLaneNoteStream>>& LaneStreams, const FString& Filename);
+
+	/* Converts a level map and saves it as a binary chart file
+	* @return - True if the file was written
+	*/
+	static bool WriteToFile(const TArray<FLevelMapRow>& Rows, int32 LanesNum, const TArray<TArray<TPair<float, float>>>& HoldNoteData, const FString& Filename);
+
+	/* Returns the absolute time in ticks of a note of a lane, decoding from the closest keyframe
+	*/
+	uint32	GetNoteTicks(int32 LaneIdx, int32 NoteIdx) const;
+
+	/* Returns the time (s) of a note of a lane, decoding from the closest keyframe
+	*/
+	inline float GetNoteTime(int32 LaneIdx, int32 NoteIdx) const	{ return TicksToSeconds(GetNoteTicks(LaneIdx, NoteIdx)); }
+
+	/* Returns the index of the first note of the lane that reaches the button at or after the input time
+	*/
+	int32	LowerBound(int32 LaneIdx, float Time) const;
+
+	inline const FBinaryChartHeader&	GetHeader() const					{ return *Header; }
+	inline int32						GetLanesNum() const					{ return Header->LanesNum; }
+	inline const FBinaryChartLane&		GetLane(int32 LaneIdx) const		{ return Lanes[LaneIdx]; }
+	inline const FBinaryChartRecord*	GetRecords(int32 LaneIdx) const		{ return (const FBinaryChartRecord*)(Data + Lanes[LaneIdx].RecordsOffset); }
+	inline const FBinaryChartKeyframe*	GetKeyframes(int32 LaneIdx) const	{ return (const FBinaryChartKeyframe*)(Data + Lanes[LaneIdx].KeyframesOffset); }
+	inline float						TicksToSeconds(uint32 Ticks) const	{ return (float)((double)Ticks / Header->TicksPerSecond); }
+	// True if the chart is read straight from the mapped file instead of a copy in memory
+	inline bool							IsMapped() const					{ return MappedRegion != nullptr; }
+
+private:
+
+	FBinaryChart() {}
+
+	/* Checks that the data is a chart this version can read, that every lane's records and keyframes are inside it and that every keyframe
+	* points at the record it is kept for. Records themselves aren't walked, their types are checked as they are decoded
+	*/
+	bool Validate(int64 DataSize);
+
+	const uint8*				Data = nullptr;
+	const FBinaryChartHeader*	Header = nullptr;
+	const FBinaryChartLane*		Lanes = nullptr;
+
+	// Either the mapped file or a copy of it keeps Data alive
+	IMappedFileHandle*			MappedFile = nullptr;
+	IMappedFileRegion*			MappedRegion = nullptr;
+	TArray<uint8>				LoadedData;
+};
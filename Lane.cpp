@@ -7,6 +7,8 @@
 #include "BaseNote.h"
 #include "BaseHoldNote.h"
 #include "RitmoLevel/BaseRitmoLevel.h"
+#include "NoteKinematics.h"
+#include "RitmoStats.h"
 
 ULane::ULane()
 {
@@ -18,6 +20,10 @@ void ULane::BeginPlay()
 	Super::BeginPlay();
 	GameMode = Cast<ARhythmGameGameMode>(GetWorld()->GetAuthGameMode());
 	ButtonLeniency = FVector2D(0.1f, 0.1f);
+	Simulation.ReserveNotes(NoteQueueCapacity);
+	NoteActors.Reserve(NoteQueueCapacity);
+	Simulation.JudgementWindows = JudgementWindows;
+	Simulation.bTimeDrivenNotes = bTimeDrivenNotes;
 }
 
 void ULane::SetUpComponents()
@@ -42,6 +48,9 @@ void ULane::SetUpComponents()
 			MovementPath = SplineCmp;
 	}
 
+	RebuildMovementPathTable();
+	CreateParticleMaterials();
+
 	OrigButtonLoc = GetButtonWorldLoc();
 	ButtonLoc = OrigButtonLoc;
 }
@@ -64,6 +73,7 @@ void ULane::SetParameters(int NewLaneIdx, int NewMoveSpeed, FVector SizeMultipli
 	{
 		RingMaterial = RingMeshComponent->CreateDynamicMaterialInstance(0);
 		Ring1Material = Ring1MeshComponent->CreateDynamicMaterialInstance(0);
+		RITMO_ADD_COUNTER(MIDsCreated, 2);
 	}
 	RingMeshComponent->SetMaterial(0, RingMaterial);
 	Ring1MeshComponent->SetMaterial(0, Ring1Material);
@@ -72,16 +82,57 @@ void ULane::SetParameters(int NewLaneIdx, int NewMoveSpeed, FVector SizeMultipli
 	ButtonLoc = OrigButtonLoc;
 	LaneLoc = GetComponentLocation();
 
+	// Set note boundaries
+	UpdateBoundaries();
+}
+
+void ULane::SetUpStandalone(int NewLaneIdx, float NewMoveSpeed, int BoundaryStartPointIdx, int BoundaryEndPointIdx)
+{
+	LaneIdx = NewLaneIdx;
+	NoteBoundaryStartPointIdx = BoundaryStartPointIdx;
+	NoteBoundaryEndPointIdx = BoundaryEndPointIdx;
+	SetUpComponents();
+
+	// Give back the notes of the last run, same as a seek
+	for (ABaseNote* Note : NoteActors)
+	{
+		if (Note)
+			Note->Reset();
+	}
+	NoteActors.Reset();
+	FreeNoteHandles.Reset();
+	NoteHandles.Reset();
+	NoteWithinBounds = nullptr;
+	JudgedNotes.Reset();
+
+	// No rings to update the boundaries of, so the Simulation is given the speed directly instead of through SetMoveSpeed
+	Simulation.JudgementWindows = JudgementWindows;
+	Simulation.bTimeDrivenNotes = bTimeDrivenNotes;
+	Simulation.SetMoveSpeed(0.0f, NewMoveSpeed, GameMode ? GameMode->GameSpeed : 1.0f);
+	Simulation.Reset(NewMoveSpeed);
+	Simulation.ReserveNotes(NoteQueueCapacity);
+}
+
+void ULane::RebuildMovementPathTable()
+{
 	// Set the start of the note movement location and the end depending on the length of the of the lane
 	MovementPathLength = MovementPath->GetSplineLength();
+	LaneLength = MovementPathLength;
 	StartLoc = MovementPath->GetLocationAtSplinePoint(0, ESplineCoordinateSpace::World);
-	NoteBoundaryStartPointPercentage = GetPercentageAlongMovementPathAtSplinePoint(NoteBoundaryStartPointIdx);
 	EndLoc = MovementPath->GetLocationAtSplinePoint(MovementPath->GetNumberOfSplinePoints() - 1, ESplineCoordinateSpace::World);
+
+	// The boundaries are read every frame by every note so cache them once here
+	NoteBoundaryStartPointPercentage = GetPercentageAlongMovementPathAtSplinePoint(NoteBoundaryStartPointIdx);
 	NoteBoundaryEndPointPercentage = GetPercentageAlongMovementPathAtSplinePoint(NoteBoundaryEndPointIdx);
-	LaneLength = MovementPath->GetSplineLength();
 
-	// Set note boundaries
-	UpdateBoundaries();
+	MovementPathTable.Build(MovementPath, MovementPathSampleSpacing);
+	Simulation.SetPath(&MovementPathTable, NoteBoundaryStartPointPercentage, NoteBoundaryEndPointPercentage);
+}
+
+void ULane::UpdateMovementPathTable()
+{
+	if (MovementPathTable.IsOutOfDate(MovementPath))
+		RebuildMovementPathTable();
 }
 
 void ULane::SetInitialParticleColor(FLinearColor NewParticleColor)
@@ -89,18 +140,8 @@ void ULane::SetInitialParticleColor(FLinearColor NewParticleColor)
 	ParticleColor = NewParticleColor;
 
 	// Set initial particle colours
-	for (int i = 0; i < ParticlesComps[0]->GetNumMaterials(); i++)
-	{
-		UMaterialInstanceDynamic* NewMaterialDynamic = ParticlesComps[0]->CreateDynamicMaterialInstance(i, ParticlesComps[0]->GetMaterial(i));
-		NewMaterialDynamic->SetVectorParameterValue(TEXT("Color"), ParticleColor);
-		ParticlesComps[0]->SetMaterial(i, NewMaterialDynamic);
-	}
-	for (int i = 0; i < ParticlesComps[1]->GetNumMaterials(); i++)
-	{
-		UMaterialInstanceDynamic* NewMaterialDynamic = ParticlesComps[1]->CreateDynamicMaterialInstance(i, ParticlesComps[1]->GetMaterial(i));
-		NewMaterialDynamic->SetVectorParameterValue(TEXT("Color"), ParticleColor);
-		ParticlesComps[1]->SetMaterial(i, NewMaterialDynamic);
-	}
+	for (int i = 0; i < ParticlesComps.Num(); i++)
+		SetParticleCompColor(i, ParticleColor);
 
 	// Set initial ring colour
 	ActiveRingColor = RingIdleColor;
@@ -109,180 +150,191 @@ void ULane::SetInitialParticleColor(FLinearColor NewParticleColor)
 
 void ULane::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
 {
+	RITMO_SCOPE(LaneTick);
+
 	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
 
 	if (GameMode->bIsPlaying)
 	{
+		UpdateMovementPathTable();
 		NoteSpawn();
-		UpdateNotes(DeltaTime);
-		CheckIfNoteWithinBounds();
-
-		if (!bButtonIsPressed)
-		{
-			TouchNotHeld(GameMode->SecondsSinceStart, DeltaTime);
-		}
-
-		AnimateRing(DeltaTime);
-		UpdateQueue();
+		SimulateNotes(DeltaTime, GetSongTime());
+		CommitTick(DeltaTime);
 	}
 }
 
+void ULane::CommitTick(float DeltaTime)
+{
+	RITMO_SCOPE(CommitTick);
+
+	CommitNotes();
+	RitmoStats::SetLaneActiveNotes(LaneIdx, Simulation.GetNotes().NumNotes());
+
+	// Broadcast the misses and finished hold notes SimulateNotes judged
+	ApplyJudgements();
+
+	CheckIfNoteWithinBounds();
+
+	AnimateRing(DeltaTime);
+	UpdateQueue();
+}
 
 void ULane::NoteSpawn()
 {
-	if (NoteIndex < LevelMap.Num() && (LevelMap[NoteIndex].Time - SpawnTimeOffset) <= GameMode->SecondsSinceStart)
-	{
-		if (LevelMap[NoteIndex].Lanes[LaneIdx] == ENoteType::EMPTY ||
-			LevelMap[NoteIndex].Lanes[LaneIdx] == ENoteType::HOLD ||
-			LevelMap[NoteIndex].Lanes[LaneIdx] == ENoteType::END_HOLD)
-			return;
+	RITMO_SCOPE(NoteSpawn);
 
-		// Randomly replace a single note with a special note with a small chance
-		RandSwapForSpecial(LevelMap[NoteIndex].Lanes[LaneIdx]);
+	// Spawn every note that is due by now rather than one per frame, otherwise notes fall behind after a hitch or on low frame rates
+	Simulation.SpawnDueNotes(GetSongTime(), [this](int32 Slot, const FLaneNote& LaneNote, float SpawnDelay)
+	{
+		SpawnNote(Slot, LaneNote);
+	});
+}
 
-		switch (LevelMap[NoteIndex].Lanes[LaneIdx])
-		{
-		case ENoteType::SINGLE:
-			{
-				ActivateNote(GameMode->NotePool->GetPooledObject(ENoteType::SINGLE));
-			}
-			break;
-		case ENoteType::BEG_HOLD:
-			{
-				ActivateNote(GameMode->NotePool->GetPooledObject(ENoteType::HOLD));
-				HoldNoteIndex++;
-			}
-			break;
-		case ENoteType::SWIPE:
-			{
-				ActivateNote(GameMode->NotePool->GetPooledObject(ENoteType::SINGLE));
-			}
-			break;
-		case ENoteType::BOMB:
-			{
-				ActivateNote(GameMode->NotePool->GetPooledObject(ENoteType::BOMB));
-			}
-			break;
-		case ENoteType::IGC:
-			{
-				ActivateNote(GameMode->NotePool->GetPooledObject(ENoteType::IGC));
-			}
-			break;
-		case ENoteType::RANDOM:
-			{
-				ActivateNote(GameMode->NotePool->GetPooledObject(ENoteType::RANDOM));
-			}
-			break;
-		default:
-			break;
-		}
-		NoteIndex++;
-	}
+ABaseNote* ULane::SpawnNote(int32 Slot, const FLaneNote& LaneNote)
+{
+	// Special notes were already swapped in by ResolveSpecialNotes
+	ABaseNote* Note = GameMode->NotePool->GetPooledObject(FLaneNoteStream::GetPooledType(LaneNote.Type));
+	if (OwningLevel)
+		OwningLevel->NotePoolStats.Requests++;
+	ActivateNote(Note, Slot, LaneNote.HoldDuration);
+	return Note;
 }
 
 void ULane::CustomStart(float StartTimeValue)
 {
-	// Update our counters for the notes to start at the needed value
-	for (int i = 0; i < LevelMap.Num(); i++)
-	{
-		if (StartTimeValue < LevelMap[i].Time)
-		{
-			NoteIndex = i;
-			break;
-		}
-	}
+	Seek(StartTimeValue);
+}
 
-	for (int i = 0; i < HoldNoteData.Num(); i++)
+void ULane::Seek(float Time)
+{
+	// Clear the lane
+	for (ABaseNote* Note : NoteActors)
 	{
-		if (StartTimeValue < HoldNoteData[i].Key)
-		{
-			HoldNoteIndex = i;
-			break;
-		}
+		if (Note)
+			Note->Reset();
 	}
+	NoteActors.Reset();
+	FreeNoteHandles.Reset();
+	NoteHandles.Reset();
+	NoteWithinBounds = nullptr;
+	PendingPressTimes.Empty();
+	PendingReleaseTimes.Empty();
+	JudgedNotes.Reset();
+	NoteWithinBoundsSlot = INDEX_NONE;
+
+	// Bring back every note that would be on the lane at the seek time, at the position it would be at. A hold note the button is already
+	// holding stays hittable
+	Simulation.Seek(Time, [this](int32 Slot, const FLaneNote& LaneNote, float TimeSinceSpawn)
+	{
+		ABaseNote* Note = SpawnNote(Slot, LaneNote);
+
+		// Notes that should have been hit before the seek time are only there to be seen, they don't count as misses
+		if (Simulation.GetNotes().IsDone(Slot))
+			Note->bToBeDeactivated = true;
+	}, GetButtonIsPressed());
 }
 
-void ULane::RandSwapForSpecial(ENoteType& NoteType)
+void ULane::ResolveSpecialNotes(int32 Seed)
 {
-	if (NoteType != ENoteType::SINGLE)
-		return;
+	FSpecialNoteOdds Odds;
+	Odds.BombFreq = LevelGeneralParams.bBombsEnabled ? LevelGeneralParams.BombSpawnFreq : 0;
+	Odds.IgcFreq = GameMode->IgcNoteSpawnFreq;
+	Odds.RandomFreq = GameMode->RandNoteSpawnFreq;
 
-	if (LevelGeneralParams.bBombsEnabled && LevelGeneralParams.BombSpawnFreq > 0 && FMath::RandRange(0, LevelGeneralParams.BombSpawnFreq) == 0)
-		NoteType = ENoteType::BOMB;
-	if (GameMode->IgcNoteSpawnFreq > 0 && FMath::RandRange(0, GameMode->IgcNoteSpawnFreq) == 0)
-		NoteType = ENoteType::IGC;
-	if (GameMode->RandNoteSpawnFreq > 0 && FMath::RandRange(0, GameMode->RandNoteSpawnFreq) == 0)
-		NoteType = ENoteType::RANDOM;
+	// Each lane rolls its own sequence, so a lane's notes don't depend on how many notes the other lanes have
+	Simulation.ResolveSpecialNotes(Odds, HashCombine(GetTypeHash(Seed), GetTypeHash(LaneIdx)));
 }
 
 
 void ULane::UpdateNotes(float DeltaTime)
 {
-	for (ABaseNote* Note : Notes)
-	{
-		// Update the State of the note location (needs to be done before the movement for the hold notes to stretch)
-		if (Note->HeadPathPercentage < GetPercentageAlongMovementPathAtSplinePoint(NoteBoundaryStartPointIdx) && Note->NoteState.Location != ENoteDistance::InLane)
-			Note->UpdateDistance(ENoteDistance::InLane);
-		else if (Note->HeadPathPercentage > GetPercentageAlongMovementPathAtSplinePoint(NoteBoundaryStartPointIdx) && Note->TailPathPercentage < GetPercentageAlongMovementPathAtSplinePoint(NoteBoundaryEndPointIdx) && Note->NoteState.Location != ENoteDistance::InButton)
-			Note->UpdateDistance(ENoteDistance::InButton);
-		else if (Note->TailPathPercentage >= GetPercentageAlongMovementPathAtSplinePoint(NoteBoundaryEndPointIdx) && Note->NoteState.Location != ENoteDistance::PastButton)
-			Note->UpdateDistance(ENoteDistance::PastButton);
-
-		// Set the new location of the note
-		float TickPercentage = MoveSpeed * DeltaTime / MovementPathLength;
-		float Dist = MovementPathLength * Note->RootPathPercentage;
-		FVector NewWorldLoc = MovementPath->GetLocationAtDistanceAlongSpline(Dist, ESplineCoordinateSpace::World);
-		FVector NewWorldTan = MovementPath->GetTangentAtDistanceAlongSpline(Dist, ESplineCoordinateSpace::World);
-		FRotator NewWorldRot = MovementPath->GetRotationAtDistanceAlongSpline(Dist, ESplineCoordinateSpace::World);
-		Note->MoveTick(NewWorldLoc, NewWorldTan, NewWorldRot, TickPercentage);
-	}
+	SimulateNotes(DeltaTime, GetSongTime());
+	CommitNotes();
+	ApplyJudgements();
+}
+
+void ULane::SimulateNotes(float DeltaTime, float CurrentTime)
+{
+	RITMO_SCOPE(SimulateNotes);
+
+	Simulation.UpdateNotes(CurrentTime, DeltaTime);
+
+	// Notes whose window is over without a press are judged as missed, and a hold note held to its end is finished. This only touches the
+	// lane's own judge and note queue, the judged notes are acted on in CommitTick
+	Simulation.ExpireMisses(CurrentTime, JudgedNotes);
+	NoteWithinBoundsSlot = Simulation.FindNoteWithinBounds();
+}
+
+void ULane::CommitNotes()
+{
+	const FLaneNoteQueue& Queue = Simulation.GetNotes();
+	const int32 WordsNum = Simulation.GetUpdateMaskWordsNum();
+
+	// Notes are visited from the front of the queue so they are handled in the order they were spawned in
+	const int32 FrontSlot = Queue.GetSlot(0);
+
+	// Update the State of the note location (needs to be done before the movement for the hold notes to stretch)
+	NoteKinematics::ForEachSetBitFrom(Simulation.GetChangedNotesMask(), WordsNum, FrontSlot, [this, &Queue](int32 Slot)
+	{
+		ABaseNote* Note = GetNoteInSlot(Slot);
+		if (Note)
+			Note->UpdateDistance((ENoteDistance)Queue.Kinematics.Location[Slot]);
+	});
 
-	// If a note has been missed 
-	for (ABaseNote* Note : Notes)
+	// Move every note that is still moving as far as the Simulation moved it
+	NoteKinematics::ForEachSetBitFrom(Simulation.GetMovingNotesMask(), WordsNum, FrontSlot, [this](int32 Slot)
 	{
-		FNoteState State = Note->GetState();
-		// If tile is missed - call the tile miss delegate
-		if (State.Location == ENoteDistance::PastButton && !Note->bToBeDeactivated)
+		ABaseNote* Note = GetNoteInSlot(Slot);
+		if (!Note)
+			return;
+
+		if (bTimeDrivenNotes)
 		{
-			if (!Note->bIgnoresMiss)
-			{
-				OnNoteMiss.Broadcast(Note); // Call the NoteMissed function in WorldController
-			}
-			Note->bToBeDeactivated = true;
-			NoteWithinBounds = nullptr;
-			break;
+			AdvanceNote(Note, Simulation.GetNoteAdvance(Slot));
 		}
-
-		// If the note reaches the end of the lane - deactivate it 
-		if (Note->TailPathPercentage >= 1.0f && Note->bToBeDeactivated)
+		else
 		{
-			DeactivateNote(Note);
-			break;
+			FVector NewWorldLoc, NewWorldTan;
+			FRotator NewWorldRot;
+			GetTransformAtPercentageAlongMovementPath(Note->RootPathPercentage, ESplineCoordinateSpace::World, NewWorldLoc, NewWorldTan, NewWorldRot);
+			Note->MoveTick(NewWorldLoc, NewWorldTan, NewWorldRot, Simulation.GetNoteAdvance(Slot));
 		}
-	}
+	});
+
+	// A note that has gone past the button can't be hit any more. Whether it was missed is decided by its time in ApplyJudgements, not here
+	NoteKinematics::ForEachSetBitFrom(Simulation.GetPastButtonNotesMask(), WordsNum, FrontSlot, [this](int32 Slot)
+	{
+		ABaseNote* Note = GetNoteInSlot(Slot);
+		if (!Note)
+			return;
+
+		Note->bToBeDeactivated = true;
+		if (NoteWithinBounds == Note)
+			NoteWithinBounds = nullptr;
+	});
+
+	// If a note reaches the end of the lane - deactivate it
+	Simulation.RemoveFinishedNotes([this, &Queue](int32 Slot)
+	{
+		const int32 Handle = Queue.Kinematics.Handle[Slot];
+		if (ABaseNote* Note = GetNoteInSlot(Slot))
+			Note->Reset();
+		RemoveNoteActor(Handle);
+	});
 }
 
 void ULane::CheckIfNoteWithinBounds()
 {
-	if (Notes.Num() == 0)
+	if (Simulation.GetNotes().IsEmpty())
 		return;
 
-	ABaseNote* NewNoteWithinBounds = nullptr;
 	ButtonParams NewRingParam = ButtonParams::NO_CHANGE;
 
-	for (ABaseNote* Note : Notes)
-	{
-		if (Note->NoteState.Location == ENoteDistance::InButton)
-		{
-			NewNoteWithinBounds = Note;
-			break;
-		}
-	}
-
-	NoteWithinBounds = NewNoteWithinBounds;
+	// Found by SimulateNotes. GetNoteInSlot gives nothing if the note has left the lane since
+	NoteWithinBounds = (NoteWithinBoundsSlot != INDEX_NONE) ? GetNoteInSlot(NoteWithinBoundsSlot) : nullptr;
 
 	// Set button ring mode
-	if (NewRingParam == ButtonParams::NO_CHANGE && Notes.Num() > 0)
+	if (NewRingParam == ButtonParams::NO_CHANGE && !Simulation.GetNotes().IsEmpty())
 	{
 		NewRingParam = ButtonParams::IDLE;
 	}
@@ -308,14 +360,20 @@ void ULane::CheckIfNoteWithinBounds()
 
 void ULane::UpdateQueue()
 {
-	for (ABaseNote* Note : Notes)
+	// Take the notes that were deactivated from outside of the lane off it
+	const FLaneNoteQueue& Queue = Simulation.GetNotes();
+	for (int32 i = 0; i < Queue.Num(); i++)
 	{
-		if (!Note->NoteState.bActive)
+		const int32 Slot = Queue.GetSlot(i);
+		ABaseNote* Note = GetNoteInSlot(Slot);
+		if (Note && !Note->NoteState.bActive)
 		{
-			Notes.Remove(Note);
-			return;
+			RemoveNoteActor(Queue.Kinematics.Handle[Slot]);
+			Simulation.RemoveNote(Slot);
 		}
 	}
+
+	Simulation.RetireNotes();
 }
 
 void ULane::NoteHit(ABaseNote* Note)
@@ -333,6 +391,7 @@ void ULane::NoteMiss(ABaseNote* Note)
 
 void ULane::CompleteMiss()
 {
+	RITMO_INC_COUNTER(DelegateBroadcasts);
 	GameMode->OnPlayerScore.Broadcast(ScoreParams::SCORE_COMPLETE_MISS);
 	
 	AWorldController* Player = Cast<AWorldController>(GetWorld()->GetFirstPlayerController()->GetPawn());
@@ -346,13 +405,25 @@ void ULane::TouchHeld(float SecondsSinceStart, float DeltaTime)
 
 	if (bFirstFrame)
 	{
+		// Make sure the press that started this touch has been handed to the lane
+		if (OwningLevel)
+			OwningLevel->DispatchInputEvents();
+
 		bFirstFrame = false;
 		ActivateButton();
 		
-		if (!NoteWithinBounds)
+		// Whether the press hit anything is decided by when it actually happened, so it doesn't depend on the frame rate or on where the notes are drawn.
+		// Hits, bombs and the misses before the press are all handled by ApplyJudgements
+		if (JudgeInput(PopInputTime(PendingPressTimes, GetSongTime())) == EJudgement::NONE)
 		{
 			bInputValid = false;
-			ACompleteMiss.Broadcast();
+
+			// A press that was too early for the note within the button isn't a complete miss, the note is missed once its window is over
+			if (!NoteWithinBounds)
+			{
+				RITMO_INC_COUNTER(DelegateBroadcasts);
+				ACompleteMiss.Broadcast();
+			}
 		}
 	}
 
@@ -360,22 +431,106 @@ void ULane::TouchHeld(float SecondsSinceStart, float DeltaTime)
 	{
 		ButtonPressLength += DeltaTime;
 
-		if (NoteWithinBounds && bInputValid)
-			ActivateParticleGen();
+		// Keep the particles going for as long as a hold note is held
+		if (bInputValid && Simulation.GetHeldNote() != INDEX_NONE)
+			SustainParticleGen();
+		else
+			StopSustainedParticleGen();
 	}
+}
 
-	if (NoteWithinBounds && bInputValid)
+EJudgement ULane::JudgeInput(float InputTime)
+{
+	const EJudgement Judgement = Simulation.Press(InputTime, JudgedNotes);
+	ApplyJudgements();
+	return Judgement;
+}
+
+EJudgement ULane::JudgeRelease(float ReleaseTime)
+{
+	const EJudgement Judgement = Simulation.Release(ReleaseTime, JudgedNotes);
+	ApplyJudgements();
+	return Judgement;
+}
+
+void ULane::ApplyJudgements()
+{
+	for (const FJudgedNote& Judged : JudgedNotes)
 	{
-		NoteWithinBounds->RegisterTouch(SecondsSinceStart, DeltaTime);
+		RITMO_INC_COUNTER(DelegateBroadcasts);
+		OnNoteJudged.Broadcast(LaneIdx, Judged.Judgement, Judged.Offset);
+
+		// The note can already be off the lane, e.g. when a seek brought it back only to be seen. The Simulation has already taken notes that
+		// were hit off it, their actors are deactivated by NoteHit
+		ABaseNote* Note = NoteActors.IsValidIndex(Judged.Handle) ? NoteActors[Judged.Handle] : nullptr;
+		if (!Note)
+			continue;
+
+		switch (Judged.Judgement)
+		{
+		case EJudgement::PERFECT:
+		case EJudgement::GREAT:
+		case EJudgement::GOOD:
+			// The press that starts a hold note only lets it be held, it is hit once it is let go or held to its end
+			if (!Judged.bHoldStart)
+			{
+				RITMO_INC_COUNTER(DelegateBroadcasts);
+				OnNoteHit.Broadcast(Note);
+			}
+			break;
+		case EJudgement::BOMB:
+			// A bomb is "hit" the same way a note is, the world controller and the level know to punish it by its type
+			RITMO_INC_COUNTER(DelegateBroadcasts);
+			OnNoteHit.Broadcast(Note);
+			break;
+		case EJudgement::MISS:
+			if (!Note->bIgnoresMiss)
+			{
+				RITMO_INC_COUNTER(DelegateBroadcasts);
+				OnNoteMiss.Broadcast(Note); // Call the NoteMissed function in WorldController
+			}
+			Note->bToBeDeactivated = true;
+			if (NoteWithinBounds == Note)
+				NoteWithinBounds = nullptr;
+			break;
+		default:
+			break;
+		}
 	}
+
+	JudgedNotes.Reset();
 }
 
-void ULane::TouchNotHeld(float SecondsSinceStart, float DeltaTime)
+void ULane::QueueInputTime(float InputTime, bool bPressed)
 {
-	if (Cast<ABaseHoldNote>(NoteWithinBounds))
+	(bPressed ? PendingPressTimes : PendingReleaseTimes).Add(InputTime);
+}
+
+float ULane::PopInputTime(TArray<float>& Times, float FrameTime)
+{
+	// A touch is polled within a frame or two of it happening, anything older was never picked up
+	static constexpr float MaxInputAge = 0.1f;
+
+	while (Times.Num())
 	{
-		NoteWithinBounds->RegisterMiss(SecondsSinceStart, DeltaTime);
+		const float InputTime = Times[0];
+		Times.RemoveAt(0, 1, false);
+
+		if (FrameTime - InputTime <= MaxInputAge)
+			return InputTime;
 	}
+	return FrameTime;
+}
+
+bool ULane::IsWithinButton(const FVector2D& ViewportLoc) const
+{
+	return ViewportLoc.X >= ButtonViewportDimensionsN.X && ViewportLoc.X <= ButtonViewportDimensionsP.X &&
+		ViewportLoc.Y >= ButtonViewportDimensionsN.Y && ViewportLoc.Y <= ButtonViewportDimensionsP.Y;
+}
+
+void ULane::TouchNotHeld(float SecondsSinceStart, float DeltaTime)
+{
+	// Deprecated, see Lane.h
 }
 
 void ULane::TouchReleased(const TEnumAsByte<ETouchIndex::Type> TouchIndex)
@@ -385,11 +540,13 @@ void ULane::TouchReleased(const TEnumAsByte<ETouchIndex::Type> TouchIndex)
 	bInputValid = true;
 	bFirstFrame = true;
 	bButtonIsPressed = false;
-	
-	if (NoteWithinBounds)
-	{
-		NoteWithinBounds->TouchReleased();
-	}
+	StopSustainedParticleGen();
+
+	// Same as a press, make sure the release has been handed to the lane so it is judged by when it happened rather than by this frame
+	if (OwningLevel)
+		OwningLevel->DispatchInputEvents();
+
+	JudgeRelease(PopInputTime(PendingReleaseTimes, GetSongTime()));
 }
 
 void ULane::ActivateButton()
@@ -415,18 +572,86 @@ void ULane::DeactivateButton()
 
 void ULane::ActivateParticleGen()
 {
-	for (int i = 0; i < ParticlesComps[ActiveParticleComp]->GetNumMaterials(); i++)
-	{
-		UMaterialInstanceDynamic* NewMaterialDynamic = ParticlesComps[ActiveParticleComp]->CreateDynamicMaterialInstance(i, ParticlesComps[ActiveParticleComp]->GetMaterial(i));
-		NewMaterialDynamic->SetVectorParameterValue(TEXT("Color"), ParticleColor);
-		ParticlesComps[ActiveParticleComp]->SetMaterial(i, NewMaterialDynamic);
-	}
+	RITMO_SCOPE(ActivateParticleGen);
+
+	StopSustainedParticleGen();
+
+	SetParticleCompColor(ActiveParticleComp, ParticleColor);
 	ParticlesComps[ActiveParticleComp]->ActivateSystem();
 
 	(ActiveParticleComp >= ParticlesComps.Num() - 1) ? ActiveParticleComp = 0 : ActiveParticleComp++; // Increase the active particle index
 
 }
 
+void ULane::SustainParticleGen()
+{
+	if (SustainedParticleComp == INDEX_NONE)
+	{
+		SustainedParticleComp = ActiveParticleComp;
+		(ActiveParticleComp >= ParticlesComps.Num() - 1) ? ActiveParticleComp = 0 : ActiveParticleComp++; // Increase the active particle index
+	}
+
+	// The colour can change mid-hold, but it's only written when it does
+	SetParticleCompColor(SustainedParticleComp, ParticleColor);
+
+	// Only restart the system once it has finished on its own, so a looping system just keeps emitting
+	UParticleSystemComponent* ParticleComp = ParticlesComps[SustainedParticleComp];
+	if (!ParticleComp->IsActive())
+		ParticleComp->ActivateSystem();
+}
+
+void ULane::StopSustainedParticleGen()
+{
+	if (SustainedParticleComp == INDEX_NONE)
+		return;
+
+	// Stop emitting but let the particles that are already out finish
+	ParticlesComps[SustainedParticleComp]->DeactivateSystem();
+	SustainedParticleComp = INDEX_NONE;
+}
+
+void ULane::CreateParticleMaterials()
+{
+	ParticleMaterials.Empty();
+	ParticleMaterialsOffsets.Empty();
+	SustainedParticleComp = INDEX_NONE;
+	ActiveParticleComp = 0;
+
+	for (UParticleSystemComponent* ParticleComp : ParticlesComps)
+	{
+		ParticleMaterialsOffsets.Add(ParticleMaterials.Num());
+
+		for (int i = 0; i < ParticleComp->GetNumMaterials(); i++)
+		{
+			UMaterialInstanceDynamic* MaterialDynamic = ParticleComp->CreateDynamicMaterialInstance(i, ParticleComp->GetMaterial(i));
+			RITMO_INC_COUNTER(MIDsCreated);
+			ParticleComp->SetMaterial(i, MaterialDynamic);
+			ParticleMaterials.Add(MaterialDynamic);
+		}
+	}
+	ParticleMaterialsOffsets.Add(ParticleMaterials.Num());
+}
+
+void ULane::SetParticleCompColor(int CompIdx, const FLinearColor& Color)
+{
+	for (int i = ParticleMaterialsOffsets[CompIdx]; i < ParticleMaterialsOffsets[CompIdx + 1]; i++)
+		GetMaterialParameters().SetVector(ParticleMaterials[i], "Color", Color);
+}
+
+void ULane::SetRingRadius(float Radius)
+{
+	if (OwningLevel)
+		OwningLevel->SetRingRadius(LaneIdx, RingMaterial, Radius);
+	else
+		GetMaterialParameters().SetScalar(RingMaterial, "Radius", Radius);
+}
+
+FMaterialParameterCache& ULane::GetMaterialParameters()
+{
+	// A lane that isn't part of a level (yet) still skips repeated writes, it just doesn't share the cache
+	return OwningLevel ? OwningLevel->MaterialParameters : LocalMaterialParameters;
+}
+
 void ULane::SwitchRing(ButtonParams Event)
 {
 	switch (Event)
@@ -437,11 +662,11 @@ void ULane::SwitchRing(ButtonParams Event)
 		if (LastRingEvent != ButtonParams::IDLE)
 		{
 			LastRingEvent = ButtonParams::IDLE;
-			Ring1Material->SetVectorParameterValue("Color", ActiveRingColor);
+			GetMaterialParameters().SetVector(Ring1Material, "Color", ActiveRingColor);
 			ActiveRingColor = RingIdleColor;
 			RingRadiusValue = 0.0f;
-			RingMaterial->SetScalarParameterValue("Radius", RingRadiusValue);
-			RingMaterial->SetVectorParameterValue("Color", ActiveRingColor);
+			SetRingRadius(RingRadiusValue);
+			GetMaterialParameters().SetVector(RingMaterial, "Color", ActiveRingColor);
 			bRingAnimIncrease = true;
 		}
 		break;
@@ -449,11 +674,11 @@ void ULane::SwitchRing(ButtonParams Event)
 		if (LastRingEvent != ButtonParams::NOTE_WITHIN_BOUNDS)
 		{
 			LastRingEvent = ButtonParams::NOTE_WITHIN_BOUNDS;
-			Ring1Material->SetVectorParameterValue("Color", ActiveRingColor);
+			GetMaterialParameters().SetVector(Ring1Material, "Color", ActiveRingColor);
 			ActiveRingColor = RingWithinBoundsColor;
 			RingRadiusValue = 0.0f;
-			RingMaterial->SetScalarParameterValue("Radius", RingRadiusValue);
-			RingMaterial->SetVectorParameterValue("Color", ActiveRingColor);
+			SetRingRadius(RingRadiusValue);
+			GetMaterialParameters().SetVector(RingMaterial, "Color", ActiveRingColor);
 			bRingAnimIncrease = true;
 		}
 		break;
@@ -461,11 +686,11 @@ void ULane::SwitchRing(ButtonParams Event)
 		if (LastRingEvent != ButtonParams::NOTE_HIT)
 		{
 			LastRingEvent = ButtonParams::NOTE_HIT;
-			Ring1Material->SetVectorParameterValue("Color", ActiveRingColor);
+			GetMaterialParameters().SetVector(Ring1Material, "Color", ActiveRingColor);
 			ActiveRingColor = RingHitColor;
 			RingRadiusValue = 0.0f;
-			RingMaterial->SetScalarParameterValue("Radius", RingRadiusValue);
-			RingMaterial->SetVectorParameterValue("Color", ActiveRingColor);
+			SetRingRadius(RingRadiusValue);
+			GetMaterialParameters().SetVector(RingMaterial, "Color", ActiveRingColor);
 			bRingAnimIncrease = true;
 		}
 		break;
@@ -473,11 +698,11 @@ void ULane::SwitchRing(ButtonParams Event)
 		if (LastRingEvent != ButtonParams::NOTE_MISS)
 		{
 			LastRingEvent = ButtonParams::NOTE_MISS;
-			Ring1Material->SetVectorParameterValue("Color", ActiveRingColor);
+			GetMaterialParameters().SetVector(Ring1Material, "Color", ActiveRingColor);
 			ActiveRingColor = RingMissColor;
 			RingRadiusValue = 0.0f;
-			RingMaterial->SetScalarParameterValue("Radius", RingRadiusValue);
-			RingMaterial->SetVectorParameterValue("Color", ActiveRingColor);
+			SetRingRadius(RingRadiusValue);
+			GetMaterialParameters().SetVector(RingMaterial, "Color", ActiveRingColor);
 			bRingAnimIncrease = true;
 		}
 		break;
@@ -485,13 +710,18 @@ void ULane::SwitchRing(ButtonParams Event)
 		break;
 	}
 
+	RITMO_INC_COUNTER(DelegateBroadcasts);
 	OnButtonEvent.Broadcast(LaneIdx, Event, ActiveRingColor);
 }
 
-void ULane::LoadNotes(TArray<FLevelMapRow> Rows, TArray<TPair<float, float>> HoldNoteData)
+void ULane::LoadNotes(const TArray<FLevelMapRow>& Rows, const TArray<TPair<float, float>>& HoldNoteData)
+{
+	LoadNotes(FLaneNoteStream::Compile(Rows, LaneIdx, HoldNoteData));
+}
+
+void ULane::LoadNotes(TSharedPtr<const FLaneNoteStream> NewNoteStream)
 {
-	LevelMap = Rows;
-	this->HoldNoteData = HoldNoteData;
+	Simulation.LoadNotes(NewNoteStream);
 }
 
 void ULane::AnimateRing(float DeltaTime)
@@ -504,29 +734,65 @@ void ULane::AnimateRing(float DeltaTime)
 		// If the ring has been completely filled - stop the animation
 		if (RingRadiusValue >= 1.0f)
 		{
-			Ring1Material->SetVectorParameterValue("Color", ActiveRingColor);
+			GetMaterialParameters().SetVector(Ring1Material, "Color", ActiveRingColor);
 			RingRadiusValue = 0.0f;
 			bRingAnimIncrease = false;
 		}
 
-		RingMaterial->SetScalarParameterValue("Radius", RingRadiusValue);
+		SetRingRadius(RingRadiusValue);
 	}
 }
 
 void ULane::DeactivateNote(ABaseNote* const Note)
 {
 	Note->Reset();
-	Notes.Remove(Note);
+
+	const int32* HandlePtr = NoteHandles.Find(Note);
+	if (!HandlePtr)
+		return;
+
+	const int32 Handle = *HandlePtr;
+	const int32 Slot = Simulation.GetNotes().FindSlotOfHandle(Handle);
+	if (Slot != INDEX_NONE)
+		Simulation.RemoveNote(Slot);
+	RemoveNoteActor(Handle);
+}
+
+ABaseNote* ULane::GetNoteInSlot(int32 Slot) const
+{
+	const FLaneNoteQueue& Queue = Simulation.GetNotes();
+	const int32 Handle = Queue.IsLive(Slot) ? Queue.Kinematics.Handle[Slot] : INDEX_NONE;
+	return (Handle != INDEX_NONE) ? NoteActors[Handle] : nullptr;
+}
+
+int32 ULane::AddNoteActor(ABaseNote* Note)
+{
+	const int32 Handle = FreeNoteHandles.Num() ? FreeNoteHandles.Pop(false) : NoteActors.AddDefaulted();
+	NoteActors[Handle] = Note;
+	NoteHandles.Add(Note, Handle);
+	return Handle;
+}
+
+void ULane::RemoveNoteActor(int32 Handle)
+{
+	if (!NoteActors.IsValidIndex(Handle) || !NoteActors[Handle])
+		return;
+
+	NoteHandles.Remove(NoteActors[Handle]);
+	NoteActors[Handle] = nullptr;
+	FreeNoteHandles.Add(Handle);
 }
 
-void ULane::ActivateNote(ABaseNote* const Note)
+void ULane::ActivateNote(ABaseNote* const Note, int32 Slot, float HoldDuration)
 {
 	Note->ParentLane = this;
 	Note->UpdateDistance(ENoteDistance::InLane);
 
 	if (Note->GetType() == ENoteType::HOLD)
 	{
-		Note->SetHoldDuration(HoldNoteData[HoldNoteIndex].Value, GameMode->Player->EndLoc - GameMode->Player->StartLoc);
+		// A lane set up on its own (SetUpStandalone) has no player, the hold is measured along the lane instead
+		const FVector PlayerPath = GameMode->Player ? GameMode->Player->EndLoc - GameMode->Player->StartLoc : GetEndLoc() - GetStartLoc();
+		Note->SetHoldDuration(HoldDuration, PlayerPath);
 	}
 
 	Note->SetActorLocation(GetStartLoc());
@@ -539,7 +805,31 @@ void ULane::ActivateNote(ABaseNote* const Note)
 	Note->SetStopped(false);
 	Note->SetActive(true); // Activate the note once it has all of the information it needs
 
-	Notes.Add(Note);
+	// Move the note to where the Simulation put it, i.e. where it would have been by now had it spawned exactly on time
+	const float Root = Simulation.GetNotes().Kinematics.Root[Slot];
+	if (Root > 0.0f)
+		AdvanceNote(Note, Root);
+
+	Simulation.SetNoteHandle(Slot, AddNoteActor(Note));
+}
+
+void ULane::AdvanceNote(ABaseNote* const Note, float Percentage)
+{
+	// Hold notes only start stretching their next body point once the previous one is fully extended, so they are moved
+	// in steps no bigger than a 60fps frame. Every other note moves linearly and can be moved in one go
+	const float MaxStep = (Note->GetType() == ENoteType::HOLD) ? Simulation.GetMoveSpeed() / 60.0f / MovementPathLength : Percentage;
+
+	FVector NewWorldLoc, NewWorldTan;
+	FRotator NewWorldRot;
+
+	while (Percentage > 0.0f)
+	{
+		const float Step = FMath::Min(Percentage, MaxStep);
+		Percentage -= Step;
+
+		GetTransformAtPercentageAlongMovementPath(Note->RootPathPercentage + Step, ESplineCoordinateSpace::World, NewWorldLoc, NewWorldTan, NewWorldRot);
+		Note->MoveTick(NewWorldLoc, NewWorldTan, NewWorldRot, Step);
+	}
 }
 
 void ULane::UpdateBoundaries()
@@ -547,23 +837,31 @@ void ULane::UpdateBoundaries()
 	FVector RingBounds = RingMeshComponent->GetStaticMesh()->GetBoundingBox().GetSize() * RingMeshComponent->GetComponentScale();
 	ButtonDimensions = FVector2D(RingBounds.X / 2, RingBounds.Y / 2);
 
-	NoteBoundaryStart = MovementPath->GetLocationAtDistanceAlongSpline(GetPercentageAlongMovementPathAtSplinePoint(NoteBoundaryStartPointIdx), ESplineCoordinateSpace::Type::World);
-	NoteBoundaryEnd = MovementPath->GetLocationAtDistanceAlongSpline(GetPercentageAlongMovementPathAtSplinePoint(NoteBoundaryEndPointIdx), ESplineCoordinateSpace::Type::World);
+	NoteBoundaryStart = GetLocAtPercentageAlongMovementPath(NoteBoundaryStartPointPercentage, ESplineCoordinateSpace::Type::World);
+	NoteBoundaryEnd = GetLocAtPercentageAlongMovementPath(NoteBoundaryEndPointPercentage, ESplineCoordinateSpace::Type::World);
 }
 
 void ULane::ResetLane()
 {
 	ButtonLoc = OrigButtonLoc;
-	MoveSpeed = OwningLevel->MoveSpeed;
-
-	Notes.Empty();
-	NoteIndex = 0;
-	HoldNoteIndex = 0;
+	Simulation.JudgementWindows = JudgementWindows;
+	Simulation.bTimeDrivenNotes = bTimeDrivenNotes;
+	Simulation.Reset(OwningLevel->MoveSpeed);
+	Simulation.ReserveNotes(NoteQueueCapacity);
+
+	NoteActors.Reset();
+	FreeNoteHandles.Reset();
+	NoteHandles.Reset();
+	PendingPressTimes.Empty();
+	PendingReleaseTimes.Empty();
+	JudgedNotes.Reset();
+	NoteWithinBoundsSlot = INDEX_NONE;
+	StopSustainedParticleGen();
 
 	if (RingMaterial && Ring1Material)
 	{
-		RingMaterial->SetScalarParameterValue("Radius", 0.0f);
-		Ring1Material->SetScalarParameterValue("Radius", 1.0f);
+		SetRingRadius(0.0f);
+		GetMaterialParameters().SetScalar(Ring1Material, "Radius", 1.0f);
 	}
 
 	AWorldController* Player = Cast<AWorldController>(GetWorld()->GetFirstPlayerController()->GetPawn());
@@ -581,6 +879,9 @@ void ULane::ResetLane()
 	ACompleteMiss.Clear();
 	ACompleteMiss.AddUniqueDynamic(this, &ULane::CompleteMiss);
 
+	OnNoteJudged.Clear();
+	OnNoteJudged.AddUniqueDynamic(OwningLevel, &ABaseRitmoLevel::NoteJudged);
+
 	OnButtonEvent.Clear();
 	OnButtonEvent.AddUniqueDynamic(OwningLevel, &ABaseRitmoLevel::ButtonEvent);
 
@@ -604,11 +905,21 @@ void ULane::SetParticleColor(FLinearColor Color)
 
 float ULane::SetMoveSpeed(float NewSpeed)
 {
-	MoveSpeed = NewSpeed;
-	SpawnTimeOffset = ((GetButtonPercentageAlongMovementPath() * MovementPath->GetSplineLength()) / MoveSpeed) * GameMode->GameSpeed;
+	// Time driven notes on the lane jump to where they have to be to still reach the button on time at the new speed
+	Simulation.SetMoveSpeed(GetSongTime(), NewSpeed, GameMode->GameSpeed);
 	ReceiveNewMoveSpeed(NewSpeed);
 	UpdateBoundaries();
-	return SpawnTimeOffset;
+	return Simulation.GetSpawnTimeOffset();
+}
+
+float ULane::GetSongTime() const
+{
+	return OwningLevel ? OwningLevel->GetSongTime() : GameMode->SecondsSinceStart;
+}
+
+float ULane::GetTravelledDistance(float Time) const
+{
+	return Simulation.GetTravelledDistance(Time);
 }
 
 float ULane::GetPercentageAlongMovementPathAtSplinePoint(int PointIdx)
@@ -618,18 +929,65 @@ float ULane::GetPercentageAlongMovementPathAtSplinePoint(int PointIdx)
 
 FVector ULane::GetLocAtPercentageAlongMovementPath(float Percentage, ESplineCoordinateSpace::Type CoordinateSpace) 
 {
-	const float Distance = Percentage * MovementPath->GetSplineLength();
-	return MovementPath->GetLocationAtDistanceAlongSpline(Distance, CoordinateSpace);
+	if (!MovementPathTable.IsBuilt())
+		return MovementPath->GetLocationAtDistanceAlongSpline(Percentage * MovementPath->GetSplineLength(), CoordinateSpace);
+
+	const FVector LocalLoc = MovementPathTable.GetLocation(Percentage);
+	return (CoordinateSpace == ESplineCoordinateSpace::World) ? MovementPath->GetComponentTransform().TransformPosition(LocalLoc) : LocalLoc;
 }
 
 FVector ULane::GetTanAtPercentageAlongMovementPath(float Percentage, ESplineCoordinateSpace::Type CoordinateSpace)
 {
-	const float Distance = Percentage * MovementPath->GetSplineLength();
-	return MovementPath->GetTangentAtDistanceAlongSpline(Distance, CoordinateSpace);
+	if (!MovementPathTable.IsBuilt())
+		return MovementPath->GetTangentAtDistanceAlongSpline(Percentage * MovementPath->GetSplineLength(), CoordinateSpace);
+
+	const FVector LocalTan = MovementPathTable.GetTangent(Percentage);
+	return (CoordinateSpace == ESplineCoordinateSpace::World) ? MovementPath->GetComponentTransform().TransformVector(LocalTan) : LocalTan;
 }
 
 FRotator ULane::GetRotAtPercentageAlongMovementPath(float Percentage, ESplineCoordinateSpace::Type CoordinateSpace)
 {
-	const float Distance = Percentage * MovementPath->GetSplineLength();
-	return MovementPath->GetRotationAtDistanceAlongSpline(Distance, CoordinateSpace);
-}
\ No newline at end of file
+	if (!MovementPathTable.IsBuilt())
+		return MovementPath->GetRotationAtDistanceAlongSpline(Percentage * MovementPath->GetSplineLength(), CoordinateSpace);
+
+	const FQuat LocalRot = MovementPathTable.GetRotation(Percentage);
+	return (CoordinateSpace == ESplineCoordinateSpace::World) ? (MovementPath->GetComponentQuat() * LocalRot).Rotator() : LocalRot.Rotator();
+}
+
+void ULane::GetTransformAtPercentageAlongMovementPath(float Percentage, ESplineCoordinateSpace::Type CoordinateSpace, FVector& OutLoc, FVector& OutTan, FRotator& OutRot)
+{
+	if (!MovementPathTable.IsBuilt())
+	{
+		OutLoc = GetLocAtPercentageAlongMovementPath(Percentage, CoordinateSpace);
+		OutTan = GetTanAtPercentageAlongMovementPath(Percentage, CoordinateSpace);
+		OutRot = GetRotAtPercentageAlongMovementPath(Percentage, CoordinateSpace);
+		return;
+	}
+
+	FQuat LocalRot;
+	MovementPathTable.Sample(Percentage, OutLoc, OutTan, LocalRot);
+
+	if (CoordinateSpace == ESplineCoordinateSpace::World)
+	{
+		const FTransform& PathTransform = MovementPath->GetComponentTransform();
+		OutLoc = PathTransform.TransformPosition(OutLoc);
+		OutTan = PathTransform.TransformVector(OutTan);
+		LocalRot = PathTransform.GetRotation() * LocalRot;
+	}
+	OutRot = LocalRot.Rotator();
+}
+
+TArray<ABaseNote*> ULane::GetActiveNotes() const
+{
+	const FLaneNoteQueue& Queue = Simulation.GetNotes();
+
+	TArray<ABaseNote*> ActiveNotes;
+	ActiveNotes.Reserve(Queue.NumNotes());
+
+	for (int32 i = 0; i < Queue.Num(); i++)
+	{
+		if (ABaseNote* Note = GetNoteInSlot(Queue.GetSlot(i)))
+			ActiveNotes.Add(Note);
+	}
+	return ActiveNotes;
+}
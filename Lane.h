@@ -1,4 +1,5 @@
-/*  This is a Lane component class which the notes move on.
+/*  This is a Lane component class which the notes move on. The gameplay itself (spawning, where the notes are, which of them can be hit,
+	when they leave the lane, judging) lives in its FLaneSimulation, the lane drives it and keeps the note actors, button and effects in sync with it.
 
 	Copyright (C) 2020-2021 Ilya Tsykunov (ilya@ilyatsykunov.com)
 */
@@ -8,6 +9,11 @@
 // Ritmo classes
 #include "RhythmGameGameMode.h"
 #include "../RitmoLevelMeta.h"
+#include "MovementPathTable.h"
+#include "LaneNoteStream.h"
+#include "LaneSimulation.h"
+#include "NoteJudgement.h"
+#include "MaterialParameterCache.h"
 
 // Unreal includes
 #include "Engine.h"
@@ -43,6 +49,7 @@ DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnNoteFinished, ABaseNote*, Note);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnNoteMiss, ABaseNote*, Note);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE(FOnCompleteMiss);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_ThreeParams(FOnButtonEvent, int, LaneIdx, ButtonParams, Event, FLinearColor, Color);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_ThreeParams(FOnNoteJudged, int, LaneIdx, EJudgement, Judgement, float, Offset);
 
 UCLASS(ClassGroup = (Custom), meta = (BlueprintSpawnableComponent))
 class RHYTHMGAME_API ULane : public USceneComponent
@@ -82,12 +89,39 @@ public:
 	*/
 	virtual void			SetParameters(int NewLaneIdx, int NewMoveSpeed, FVector SizeMultiplier, UMaterialInstanceDynamic* Ring0Mat,	UMaterialInstanceDynamic* Ring1Mat, UMaterialInstanceDynamic* LaneMat = nullptr);
 
+	/* Sets the lane up to move notes on its own, without a level, a player or rings, e.g. for ULaneBenchmarkCommandlet. Finds the movement path
+	* among the children and starts the lane from the beginning. The song time is the game mode's SecondsSinceStart
+	* @param NewLaneIdx				- The index of the lane
+	* @param NewMoveSpeed			- The speed of the notes
+	* @param BoundaryStartPointIdx	- Point of the movement path the button starts at
+	* @param BoundaryEndPointIdx	- Point of the movement path the button ends at
+	*/
+	void					SetUpStandalone(int NewLaneIdx, float NewMoveSpeed, int BoundaryStartPointIdx, int BoundaryEndPointIdx);
+
 
-	/* Moves the notes in its array and manages their location states, also handles note misses where they reach the end of the lane
+	/* Moves the notes on the lane and manages their location states, and takes them off the lane once they reach its end.
+	* Locations are worked out by the Simulation, note actors are only touched when their state or transform changes
 	* @param DeltaTime - DeltaTime..
 	*/
 	void					UpdateNotes(float DeltaTime);
 
+	/* The simulation half of UpdateNotes: works out where every note is and how far it moves (see FLaneSimulation::UpdateNotes), judges the
+	* notes whose window is over and finds the note within the button. Judged notes are only collected, CommitTick acts on them.
+	* Doesn't touch any UObject, so the level can run it for every lane at once on worker threads
+	* @param DeltaTime		- DeltaTime..
+	* @param CurrentTime	- Seconds since the start of the level
+	*/
+	void					SimulateNotes(float DeltaTime, float CurrentTime);
+
+	/* The game thread half of UpdateNotes: applies the results of SimulateNotes to the note actors and takes the notes that reached the end off the lane
+	*/
+	void					CommitNotes();
+
+	/* Everything the lane does each frame after the notes have been simulated. Must run on the game thread
+	* @param DeltaTime - DeltaTime..
+	*/
+	void					CommitTick(float DeltaTime);
+
 
 	/*
 	* What colour are the particles
@@ -124,18 +158,19 @@ public:
 	virtual void			CompleteMiss();
 
 
-	/* Each frame a button is held on this lane, if a note is within the button range, pass along the values
+	/* Each frame a button is held on this lane. The first frame of a touch judges the press, after that it only keeps the effects of a held hold note going
 	* @param SecondsSinceStart - How long since the start of the level has passed
 	* @param DeltaTime		   - DeltaTime..
 	*/
 	UFUNCTION()
 	void TouchHeld(float SecondsSinceStart, float DeltaTime);
 
-	/* Each frame a button is not held on this lane, if a note is within the button range, pass along the values. This isn't currently used
+	/* Deprecated, does nothing. Letting go of a hold note is judged by its time in TouchReleased, so nothing has to happen on the frames the
+	* button isn't held. Only kept so delegates that are still bound to it keep working, don't bind anything new to it
 	* @param SecondsSinceStart - How long since the start of the level has passed
 	* @param DeltaTime		   - DeltaTime..
 	*/
-	UFUNCTION()
+	UFUNCTION(meta = (DeprecatedFunction, DeprecationMessage = "Does nothing, letting go of a hold note is judged in TouchReleased"))
 	void TouchNotHeld(float SecondsSinceStart, float DeltaTime);
 
 	/* When we release the button after pressing / holding it
@@ -144,6 +179,33 @@ public:
 	void TouchReleased(const TEnumAsByte<ETouchIndex::Type> TouchIndex);
 
 
+	/* Judges a press of the button against the time of the next note of the lane, then hits / misses the notes it judged (see ApplyJudgements)
+	* @param InputTime - When the button was pressed, in seconds since the start of the level
+	* @return		   - The judgement, BOMB if a bomb was pressed, NONE if no note was close enough to the press
+	*/
+	UFUNCTION(BlueprintCallable)
+	EJudgement				JudgeInput(float InputTime);
+
+	/* Judges letting go of the button against the end of the hold note being held, if any, then hits or misses it (see ApplyJudgements)
+	* @param ReleaseTime - When the button was let go, in seconds since the start of the level
+	*/
+	EJudgement				JudgeRelease(float ReleaseTime);
+
+	/* Acts on every note in JudgedNotes and empties it: broadcasts OnNoteJudged, then OnNoteHit for notes that were hit (and bombs that were
+	* pressed) and OnNoteMiss for notes that were missed. This is the only place notes are scored, the note actors only show where they are
+	*/
+	void					ApplyJudgements();
+
+	/* Gives the lane the exact time of a press / release that landed on its button. TouchHeld and TouchReleased use it instead of the frame time
+	* @param InputTime	- When the event happened, in seconds since the start of the level
+	* @param bPressed	- Whether it was a press or a release
+	*/
+	void					QueueInputTime(float InputTime, bool bPressed);
+
+	/* Returns whether the input viewport location is within the button of this lane
+	*/
+	bool					IsWithinButton(const FVector2D& ViewportLoc) const;
+
 	/* When we press the button - switch the ring state and fire particles if necessary
 	*/
 	UFUNCTION()
@@ -160,10 +222,18 @@ public:
 	virtual  void			SetParticleColor(FLinearColor Color);
 
 
-	/* Each frame we hit a note - we keep the particles going
+	/* Fires a single burst of particles, e.g. when a note is hit
 	*/
 	virtual void			ActivateParticleGen();
 
+	/* Each frame a note is held - keeps one particle system emitting instead of restarting it every frame
+	*/
+	virtual void			SustainParticleGen();
+
+	/* When a note stops being held - stops the sustained particle system from emitting more particles
+	*/
+	virtual void			StopSustainedParticleGen();
+
 
 	/* When we start a new level / restart. Set default values
 	*/
@@ -183,11 +253,19 @@ public:
 	virtual void			DeactivateNote(ABaseNote* const Note);
 
 	/* Given a note, set it up to use the lane
-	* @param Note - The note to add
+	* @param Note			- The note to add
+	* @param Slot			- Slot of the note in the Simulation's note queue. The note is moved to where the Simulation put it, e.g. forward if it spawned late
+	* @param HoldDuration	- How long the note has to be held for. Only used by hold notes
 	*/
-	virtual void			ActivateNote(ABaseNote* const Note);
+	virtual void			ActivateNote(ABaseNote* const Note, int32 Slot, float HoldDuration = 0.0f);
 
-	/* This should be removed - not needed anymore
+	/* Moves a note forward along the movement path outside of the regular frame update, e.g. to catch up a note that spawned late
+	* @param Note		- The note to move
+	* @param Percentage	- How far to move it as % of the movement path
+	*/
+	void					AdvanceNote(ABaseNote* const Note, float Percentage);
+
+	/* Drops notes that were deactivated outside of the lane and frees up every empty slot at the front of the note queue
 	*/
 	void					UpdateQueue();
 
@@ -195,26 +273,57 @@ public:
 	*/
 	void					SwitchRing(ButtonParams Event);
 
-	/* After we've loaded the map, give the notes to each lane
+	/* After we've loaded the map, give the notes to each lane. The rows are compiled into the lane's own note stream once, here
 	* @param Rows			- Array containing the note types and times to spawn them at
 	* @param HoldNoteData	- Information about the duration of hold notes we refer to when spawning them 
 	*/
-	void					LoadNotes(TArray<FLevelMapRow> Rows, TArray<TPair<float, float>> HoldNoteData);
+	void					LoadNotes(const TArray<FLevelMapRow>& Rows, const TArray<TPair<float, float>>& HoldNoteData);
 
+	/* Gives the lane an already compiled note stream. The stream is never modified so it can be kept and shared between restarts
+	* @param NewNoteStream	- The notes of this lane
+	*/
+	void					LoadNotes(TSharedPtr<const FLaneNoteStream> NewNoteStream);
 
-	/* Each lane is responsible for spawning its own notes, it does so here each frame
+
+	/* Each lane is responsible for spawning its own notes, it does so here each frame. Every note that is due by now is spawned
 	*/
 	void					NoteSpawn();
 
 
-	/* If we want to start at a point that isn't 0s (test mode) we can set that up here
+	/* If we want to start at a point that isn't 0s (test mode) we can set that up here. Same as Seek
 	*/
 	void					CustomStart(float StartTimeValue);
 
-	/* Every note has a chance to be a bomb, igc or random note, this decides it
-	* @param NoteType& - The note to potentially change
+	/* Jumps the lane to any point of the song. Clears the lane and brings back every note that would be on it at that time, at the right position.
+	* A hold note that is in the middle of being held at that time carries on being held if the button is down, every other note before the
+	* time is only shown. The note stream is binary searched, so this only costs as much as the notes it brings back
+	* @param Time - Seconds since the start of the level to jump to. The level's song clock must already be set to it
+	*/
+	UFUNCTION(BlueprintCallable)
+	void					Seek(float Time);
+
+	/* Spawns the actor of a note the Simulation put on the lane from the object pool
+	* @param Slot		- Slot of the note in the Simulation's note queue
+	* @param LaneNote	- The note to spawn
+	* @return			- The spawned note
+	*/
+	ABaseNote*				SpawnNote(int32 Slot, const FLaneNote& LaneNote);
+
+	/* Every single note has a chance to be a bomb, igc or random note. This decides it for the whole chart at once, so spawning a note only
+	* reads its type from the note stream. Call after LoadNotes and before the lane is reset
+	* @param Seed - Seed of this run. The same seed always gives the same notes
+	*/
+	void					ResolveSpecialNotes(int32 Seed);
+
+	/* Returns the current time of the song from the owning level's song clock, in seconds since the start of the level
 	*/
-	void					RandSwapForSpecial(ENoteType& NoteType);
+	float					GetSongTime() const;
+
+	/* Returns how far (in units) a note moving from the start of the song would have travelled along the movement path by the input time.
+	* Takes every move speed change into account, so a note's position is always (this - where it started) / the path length
+	* @param Time - Seconds since the start of the level
+	*/
+	float					GetTravelledDistance(float Time) const;
 
 	/* Returns the % of how far the point is along the movement path of this lane
 	*/
@@ -232,24 +341,36 @@ public:
 	*/
 	FRotator				GetRotAtPercentageAlongMovementPath(float Percentage, ESplineCoordinateSpace::Type CoordinateSpace);
 
+	/* Returns the location, tangent and rotation of the input % along the movement path of this lane with a single lookup
+	*/
+	void					GetTransformAtPercentageAlongMovementPath(float Percentage, ESplineCoordinateSpace::Type CoordinateSpace, FVector& OutLoc, FVector& OutTan, FRotator& OutRot);
+
+	/* Re-samples the movement path and updates everything derived from it (length, start / end, note boundaries). Call this whenever the path spline is changed
+	*/
+	void					RebuildMovementPathTable();
+
+	/* Rebuilds the movement path table if the path spline was changed since it was last built. Called on the game thread before the notes are simulated
+	*/
+	void					UpdateMovementPathTable();
+
 
 	/* ############################################# ACCESSORS  ############################################# */
 
 	UFUNCTION(BlueprintCallable)	inline FVector					GetEndLoc()								{ return EndLoc; }
 	UFUNCTION(BlueprintCallable)	inline FVector					GetStartLoc()							{ return StartLoc; }
 	UFUNCTION(BlueprintCallable)	inline int						GetLaneIdx()							{ return LaneIdx; }
-	UFUNCTION(BlueprintCallable)	inline float					GetMoveSpeed()							{ return MoveSpeed; }
+	UFUNCTION(BlueprintCallable)	inline float					GetMoveSpeed()							{ return Simulation.GetMoveSpeed(); }
 	UFUNCTION(BlueprintCallable)	inline bool 					GetReversed()							{ return bReversed; }
 	UFUNCTION(BlueprintCallable)	inline float					GetLaneLength()							{ return LaneLength; }					// Returns the size of the lane mesh along the X axis 
 	UFUNCTION(BlueprintCallable)	inline bool						IsInputValid()							{ return bInputValid; }
 	UFUNCTION(BlueprintCallable)	inline bool 					GetButtonHit()							{ return bButtonHit; }
 	UFUNCTION(BlueprintCallable)	inline FVector2D				GetButtonDimensions()					{ return ButtonDimensions; }
-	UFUNCTION(BlueprintCallable)	inline float					GetSpawnTimeOffset()					{ return SpawnTimeOffset; }
+	UFUNCTION(BlueprintCallable)	inline float					GetSpawnTimeOffset()					{ return Simulation.GetSpawnTimeOffset(); }
 	UFUNCTION(BlueprintCallable)	inline bool						GetButtonIsMoving()						{ return bButtonIsMoving; }
 	UFUNCTION(BlueprintCallable)	inline bool 					GetButtonIsPressed()					{ return bButtonIsPressed; }
 	UFUNCTION(BlueprintCallable)	inline FVector2D				GetButtonViewportLoc()					{ return ButtonViewportLoc; }
-	UFUNCTION(BlueprintCallable)	inline FVector 					GetNoteBoundaryStart()					{ return GetLocAtPercentageAlongMovementPath(GetPercentageAlongMovementPathAtSplinePoint(NoteBoundaryStartPointIdx), ESplineCoordinateSpace::World); }
-	UFUNCTION(BlueprintCallable)	inline FVector 					GetNoteBoundaryEnd()					{ return GetLocAtPercentageAlongMovementPath(GetPercentageAlongMovementPathAtSplinePoint(NoteBoundaryEndPointIdx), ESplineCoordinateSpace::World); }
+	UFUNCTION(BlueprintCallable)	inline FVector 					GetNoteBoundaryStart()					{ return GetLocAtPercentageAlongMovementPath(NoteBoundaryStartPointPercentage, ESplineCoordinateSpace::World); }
+	UFUNCTION(BlueprintCallable)	inline FVector 					GetNoteBoundaryEnd()					{ return GetLocAtPercentageAlongMovementPath(NoteBoundaryEndPointPercentage, ESplineCoordinateSpace::World); }
 	UFUNCTION(BlueprintCallable)	inline float 					GetButtonPressLength()					{ return ButtonPressLength; }
 	UFUNCTION(BlueprintCallable)	inline FVector2D				GetButtonViewportDimensionsN()			{ return ButtonViewportDimensionsN; } 	// Get negative dimensions of the button (left and top points)
 	UFUNCTION(BlueprintCallable)	inline FVector2D				GetButtonViewportDimensionsP()			{ return ButtonViewportDimensionsP; } 	// Get positive dimensions of the button (right and bottom points)
@@ -259,9 +380,15 @@ public:
 	UFUNCTION(BlueprintCallable)	inline float					GetNoteBoundaryStartPointIdx()			{ return NoteBoundaryStartPointIdx; }
 	UFUNCTION(BlueprintCallable)	inline float					GetNoteBoundaryEndPointIdx()			{ return NoteBoundaryEndPointIdx; }
 	// Returns float between 0 and 1 that represents the position of the middle of the button as % along the movement path
-	UFUNCTION(BlueprintCallable)	inline float					GetButtonPercentageAlongMovementPath()	{ return (GetPercentageAlongMovementPathAtSplinePoint(NoteBoundaryEndPointIdx) - GetPercentageAlongMovementPathAtSplinePoint(NoteBoundaryStartPointIdx)) / 2 + GetPercentageAlongMovementPathAtSplinePoint(NoteBoundaryStartPointIdx); }
+	UFUNCTION(BlueprintCallable)	inline float					GetButtonPercentageAlongMovementPath()	{ return (NoteBoundaryEndPointPercentage - NoteBoundaryStartPointPercentage) / 2 + NoteBoundaryStartPointPercentage; }
 	UFUNCTION(BlueprintCallable)	inline USplineComponent*		GetMovementPath()						{ return MovementPath; }
 	UFUNCTION(BlueprintCallable)	inline float					GetMovementPathLength()					{ return MovementPathLength; }
+	// Returns the curvature (1 / radius) of the tightest bend of the movement path, 0 if the path is straight
+	UFUNCTION(BlueprintCallable)	inline float					GetMovementPathMaxCurvature()			{ return MovementPathTable.GetMaxCurvature(); }
+									inline TSharedPtr<const FLaneNoteStream> GetNoteStream() const		{ return Simulation.GetNoteStream(); }
+									inline TSharedPtr<const FLaneNoteStream> GetLoadedNoteStream() const	{ return Simulation.GetLoadedNoteStream(); }
+	// Returns the notes currently on the lane, oldest first
+	UFUNCTION(BlueprintCallable)	TArray<ABaseNote*>				GetActiveNotes() const;
 
 	/* ############################################# MODIFIERS  ############################################# */
 
@@ -290,9 +417,13 @@ public:
 	// Called on user input or when a note either enters or leaves the bounds 
 	UPROPERTY(BlueprintAssignable)			FOnButtonEvent				OnButtonEvent;
 
+	// Called whenever a press is judged against a note, or a note goes past the button without being pressed (MISS)
+	UPROPERTY(BlueprintAssignable)			FOnNoteJudged				OnNoteJudged;
+
 	/* ############################################# PUBLIC VARIABLES ############################################# */
 
-	UPROPERTY(BlueprintReadOnly, VisibleAnywhere)				TArray<ABaseNote*>		Notes;
+	// The actors of the notes on the lane, by the handle of their note in the Simulation's note queue. Free handles are nullptr
+	UPROPERTY(VisibleAnywhere)									TArray<ABaseNote*>		NoteActors;
 	UPROPERTY(BlueprintReadOnly, VisibleAnywhere)				TArray<ABaseNote*>		ReverseNotes;
 	UPROPERTY(BlueprintReadOnly, VisibleAnywhere)				ABaseNote*				NoteWithinBounds;
 	UPROPERTY(BlueprintReadOnly)								bool					bHoldingNote;	// This is for debugging really and isn't used for anything gameplay related
@@ -308,7 +439,7 @@ protected:
 	void					DrawSwipeNotes(float DeltaTime);
 	// Update the boundaries within which notes can be hit
 	void					UpdateBoundaries();
-	// Sets the bNoteWithinBounds to true if any note is within the bounds of the button
+	// Sets NoteWithinBounds to the note the Simulation says can be hit within the bounds of the button, if any
 	void					CheckIfNoteWithinBounds();
 	// Gradually fills the button ring with a new colour
 	void					AnimateRing(float DeltaTime);
@@ -320,17 +451,53 @@ protected:
 	UPROPERTY()							float							LaneLength;	
 	UPROPERTY()							FVector							StartLoc;
 	UPROPERTY()							FVector							EndLoc;
-	UPROPERTY()							float							MoveSpeed;
 	UPROPERTY()							USplineComponent*				MovementPath;
 	UPROPERTY()							float							MovementPathLength;
+	// Distance between two samples of the baked movement path. Smaller values follow tight bends more closely at the cost of memory
+	UPROPERTY(EditAnywhere)				float							MovementPathSampleSpacing = 10.0f;
+	// Baked copy of the MovementPath that every per-frame path query goes through
+										FMovementPathTable				MovementPathTable;
+
+	// When true every note's position is worked out from the song time instead of being moved forward by DeltaTime each frame
+	UPROPERTY(EditAnywhere)				bool							bTimeDrivenNotes = false;
+
+	// How many notes can be on the lane at once before the note queue has to grow
+	UPROPERTY(EditAnywhere)				int32							NoteQueueCapacity = 64;
+
+	// Notes, move speed and judging of this lane, without any of the actors
+										FLaneSimulation					Simulation;
+
+	// Handles of NoteActors that are free to be given to the next note
+										TArray<int32>					FreeNoteHandles;
 
-	UPROPERTY()							float							SpawnTimeOffset;
+	// The handle of every note actor on the lane, so a note deactivated from outside is found without searching NoteActors
+										TMap<ABaseNote*, int32>			NoteHandles;
 
-	// <Time value of entry, duration>
-	TArray<TPair<float, float>>									HoldNoteData;
-	int															HoldNoteIndex = 0;
-	TArray<FLevelMapRow>										LevelMap;
-	int															NoteIndex = 0;
+	// Returns the actor of the note in the input slot of the Simulation's note queue, or nullptr if the slot is empty
+	ABaseNote*				GetNoteInSlot(int32 Slot) const;
+	// Gives the note actor a handle for its note in the Simulation's note queue
+	int32					AddNoteActor(ABaseNote* Note);
+	// Lets go of the note actor with the input handle
+	void					RemoveNoteActor(int32 Handle);
+
+	// How close to a note's time a press has to be to count. Given to the Simulation when the lane is reset
+	UPROPERTY(EditAnywhere)				FJudgementWindows				JudgementWindows;
+
+	// Notes judged by the simulation that ApplyJudgements hasn't acted on yet
+										TArray<FJudgedNote>				JudgedNotes;
+
+	// Slot of the note that can be hit within the button as of the last SimulateNotes, INDEX_NONE if there isn't one
+										int32							NoteWithinBoundsSlot = INDEX_NONE;
+
+	// Times of presses / releases on this lane that haven't been picked up by TouchHeld / TouchReleased yet, oldest first
+										TArray<float>					PendingPressTimes;
+										TArray<float>					PendingReleaseTimes;
+
+	/* Takes the oldest pending input time. Times too old to still belong to the current touch are dropped
+	* @param Times		- PendingPressTimes or PendingReleaseTimes
+	* @param FrameTime	- The time of this frame, returned if there is no pending time
+	*/
+	float					PopInputTime(TArray<float>& Times, float FrameTime);
 
 
 	/* ########################################## OBJECT POINTERS ####################################### */
@@ -385,6 +552,23 @@ protected:
 	UPROPERTY()						TArray<UParticleSystemComponent*>				ParticlesComps;
 	UPROPERTY()						int												ActiveParticleComp = 0;
 	UPROPERTY()						FLinearColor									ParticleColor;
+	// Material instances of every particle component, created once in CreateParticleMaterials. Component i owns [Offsets[i], Offsets[i + 1])
+	UPROPERTY()						TArray<UMaterialInstanceDynamic*>				ParticleMaterials;
+									TArray<int>										ParticleMaterialsOffsets;
+	// The particle component kept emitting while a note is held, INDEX_NONE if none
+									int												SustainedParticleComp = INDEX_NONE;
+
+	// Gives every material slot of every particle component its own material instance, once
+	void					CreateParticleMaterials();
+	// Writes the colour to the materials of a particle component, only if it's different from the last one written
+	void					SetParticleCompColor(int CompIdx, const FLinearColor& Color);
+
+	// Sets how far the ring is filled in with its new colour (0 - 1), through the level so it can be shared by every ring
+	void					SetRingRadius(float Radius);
+	// The level's material parameter cache every material write of the lane goes through, or LocalMaterialParameters if the lane has no level
+	FMaterialParameterCache& GetMaterialParameters();
+	// Used instead of the level's cache while the lane has no OwningLevel
+	FMaterialParameterCache							LocalMaterialParameters;
 
 	public:
 	UPROPERTY(BlueprintReadOnly)	ABaseRitmoLevel*								OwningLevel;
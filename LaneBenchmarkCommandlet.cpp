@@ -0,0 +1,576 @@
+/*  Copyright (C) 2020-2021 Ilya Tsykunov (ilya@ilyatsykunov.com)
+*/
+
+#include "LaneBenchmarkCommandlet.h"
+
+#include "Lane.h"
+#include "BaseNote.h"
+#include "LaneNoteStream.h"
+#include "LaneSimulation.h"
+#include "MovementPathTable.h"
+#include "NoteKinematics.h"
+#include "SplineMeshHoldNote.h"
+#include "Components/SplineComponent.h"
+#include "Dom/JsonObject.h"
+#include "Engine/GameInstance.h"
+#include "Engine/World.h"
+#include "HAL/MemoryBase.h"
+#include "Misc/App.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/JsonSerializer.h"
+#include "Serialization/JsonWriter.h"
+
+/* ############################################# ALLOCATION COUNTING ############################################# */
+
+// Passes everything on to the real allocator and counts the allocations the benchmark's own thread makes while bCounting is set
+class FCountingMalloc : public FMalloc
+{
+public:
+
+	/* Puts the counting allocator in front of GMalloc until it is destroyed. It only forwards, so memory from before it was put in
+	* and after it was taken out again can be freed either way
+	*/
+	FCountingMalloc() : InnerMalloc(GMalloc), ThreadId(FPlatformTLS::GetCurrentThreadId())
+	{
+		GMalloc = this;
+	}
+
+	virtual ~FCountingMalloc()
+	{
+		check(GMalloc == this);
+		GMalloc = InnerMalloc;
+	}
+
+	virtual void*			Malloc(SIZE_T Count, uint32 Alignment) override						{ CountAllocation(); return InnerMalloc->Malloc(Count, Alignment); }
+	virtual void*			TryMalloc(SIZE_T Count, uint32 Alignment) override						{ CountAllocation(); return InnerMalloc->TryMalloc(Count, Alignment); }
+	virtual void*			Realloc(void* Original, SIZE_T Count, uint32 Alignment) override		{ CountAllocation(); return InnerMalloc->Realloc(Original, Count, Alignment); }
+	virtual void*			TryRealloc(void* Original, SIZE_T Count, uint32 Alignment) override		{ CountAllocation(); return InnerMalloc->TryRealloc(Original, Count, Alignment); }
+	virtual void			Free(void* Original) override											{ InnerMalloc->Free(Original); }
+	virtual SIZE_T			QuantizeSize(SIZE_T Count, uint32 Alignment) override					{ return InnerMalloc->QuantizeSize(Count, Alignment); }
+	virtual bool			GetAllocationSize(void* Original, SIZE_T& SizeOut) override				{ return InnerMalloc->GetAllocationSize(Original, SizeOut); }
+	virtual void			Trim(bool bTrimThreadCaches) override									{ InnerMalloc->Trim(bTrimThreadCaches); }
+	virtual void			SetupTLSCachesOnCurrentThread() override								{ InnerMalloc->SetupTLSCachesOnCurrentThread(); }
+	virtual void			ClearAndDisableTLSCachesOnCurrentThread() override						{ InnerMalloc->ClearAndDisableTLSCachesOnCurrentThread(); }
+	virtual void			InitializeStatsMetadata() override										{ InnerMalloc->InitializeStatsMetadata(); }
+	virtual void			UpdateStats() override													{ InnerMalloc->UpdateStats(); }
+	virtual void			GetAllocatorStats(FGenericMemoryStats& OutStats) override				{ InnerMalloc->GetAllocatorStats(OutStats); }
+	virtual void			DumpAllocatorStats(FOutputDevice& Ar) override							{ InnerMalloc->DumpAllocatorStats(Ar); }
+	virtual bool			IsInternallyThreadSafe() const override									{ return InnerMalloc->IsInternallyThreadSafe(); }
+	virtual bool			ValidateHeap() override													{ return InnerMalloc->ValidateHeap(); }
+	virtual const TCHAR*	GetDescriptiveName() override											{ return InnerMalloc->GetDescriptiveName(); }
+
+	// Allocations counted since this was last reset
+	uint32		AllocationsNum = 0;
+	bool		bCounting = false;
+
+private:
+
+	inline void CountAllocation()
+	{
+		if (bCounting && FPlatformTLS::GetCurrentThreadId() == ThreadId)
+			AllocationsNum++;
+	}
+
+	FMalloc*	InnerMalloc;
+	uint32		ThreadId;
+};
+
+/* ############################################# RESULTS ############################################# */
+
+struct FBenchmarkResult
+{
+	FString			Name;
+	// Time spent in the benchmarked path and allocations it made, per recorded frame
+	TArray<double>	FrameNs;
+	TArray<uint32>	FrameAllocations;
+};
+
+// Adds up the benchmarked parts of a frame, which can be split between lanes and notes
+class FFrameTimer
+{
+public:
+
+	FFrameTimer(FBenchmarkResult& InResult, FCountingMalloc& InMalloc, int32 FramesNum) : Result(InResult), Malloc(InMalloc)
+	{
+		Result.FrameNs.Reserve(FramesNum);
+		Result.FrameAllocations.Reserve(FramesNum);
+	}
+
+	inline void Start()
+	{
+		Malloc.bCounting = true;
+		StartCycles = FPlatformTime::Cycles64();
+	}
+
+	inline void Stop()
+	{
+		FrameCycles += FPlatformTime::Cycles64() - StartCycles;
+		Malloc.bCounting = false;
+	}
+
+	/* Records the frame, unless it is a warm up frame, and starts the next one
+	*/
+	void EndFrame(bool bRecord)
+	{
+		if (bRecord)
+		{
+			Result.FrameNs.Add(FPlatformTime::GetSecondsPerCycle64() * FrameCycles * 1e9);
+			Result.FrameAllocations.Add(Malloc.AllocationsNum);
+		}
+		FrameCycles = 0;
+		Malloc.AllocationsNum = 0;
+	}
+
+private:
+
+	FBenchmarkResult&	Result;
+	FCountingMalloc&	Malloc;
+	uint64				StartCycles = 0;
+	uint64				FrameCycles = 0;
+};
+
+// Nearest rank percentile of sorted values
+static double GetPercentile(const TArray<double>& SortedValues, double Percentile)
+{
+	if (SortedValues.Num() == 0)
+		return 0.0;
+
+	return SortedValues[FMath::Clamp(FMath::CeilToInt(Percentile * SortedValues.Num()) - 1, 0, SortedValues.Num() - 1)];
+}
+
+/* ############################################# HOLD NOTES ############################################# */
+
+// Drives pooled hold notes along the lanes the same way ULane::ActivateNote and ULane::CommitNotes do, so the real ASplineMeshHoldNote::SetActive
+// and ASplineMeshHoldNote::MoveTick can be timed on their own. Where the notes are comes from the headless FLaneSimulation of each lane
+class FBenchmarkHoldNotes
+{
+public:
+
+	FBenchmarkHoldNotes(ARhythmGameGameMode* InGameMode, const TArray<ULane*>& InLanes) : GameMode(InGameMode), Lanes(InLanes)
+	{
+		NoteActors.SetNum(Lanes.Num());
+	}
+
+	/* Gives every note back to the pool, for the start and the end of a benchmark
+	*/
+	void Reset()
+	{
+		for (TArray<ASplineMeshHoldNote*>& LaneNotes : NoteActors)
+		{
+			for (ASplineMeshHoldNote* Note : LaneNotes)
+			{
+				if (Note)
+					Note->Reset();
+			}
+			LaneNotes.Reset();
+		}
+	}
+
+	/* Spawns the hold notes that are due on the lane. Only SetActive is timed, not the rest of ULane::ActivateNote
+	* @param SetActiveTimer - Timer to add SetActive to, nullptr to not time it
+	*/
+	void SpawnDue(int32 LaneIdx, FLaneSimulation& Simulation, float Time, FFrameTimer* SetActiveTimer)
+	{
+		ULane* Lane = Lanes[LaneIdx];
+
+		Simulation.SpawnDueNotes(Time, [&](int32 Slot, const FLaneNote& LaneNote, float SpawnDelay)
+		{
+			if (LaneNote.Type != ENoteType::HOLD)
+				return;
+
+			ASplineMeshHoldNote* Note = Cast<ASplineMeshHoldNote>(GameMode->NotePool->GetPooledObject(ENoteType::HOLD));
+			Note->ParentLane = Lane;
+			Note->UpdateDistance(ENoteDistance::InLane);
+			Note->SetHoldDuration(LaneNote.HoldDuration, Lane->GetEndLoc() - Lane->GetStartLoc());
+			Note->SetActorLocation(Lane->GetStartLoc());
+			Note->AttachToComponent(Lane, FAttachmentTransformRules::KeepWorldTransform);
+			Note->SetActorHiddenInGame(false);
+			Note->SetStopped(false);
+
+			if (SetActiveTimer) SetActiveTimer->Start();
+			Note->SetActive(true);
+			if (SetActiveTimer) SetActiveTimer->Stop();
+
+			// Catch up a note that spawned late, same as ULane::ActivateNote
+			const float Root = Simulation.GetNotes().Kinematics.Root[Slot];
+			if (Root > 0.0f)
+				Lane->AdvanceNote(Note, Root);
+
+			Simulation.SetNoteHandle(Slot, NoteActors[LaneIdx].Add(Note));
+		});
+	}
+
+	/* Moves the hold notes of the lane as far as the Simulation moved them, frame by frame like ULane does without bTimeDrivenNotes, and
+	* gives the notes that reached the end of the path back to the pool. Only MoveTick is timed
+	* @param MoveTickTimer - Timer to add MoveTick to, nullptr to not time it
+	*/
+	void Move(int32 LaneIdx, FLaneSimulation& Simulation, float Time, float DeltaTime, FFrameTimer* MoveTickTimer)
+	{
+		ULane* Lane = Lanes[LaneIdx];
+
+		Simulation.UpdateNotes(Time, DeltaTime);
+
+		const FLaneNoteQueue& Queue = Simulation.GetNotes();
+		const int32 WordsNum = Simulation.GetUpdateMaskWordsNum();
+		const int32 FrontSlot = Queue.GetSlot(0);
+
+		NoteKinematics::ForEachSetBitFrom(Simulation.GetChangedNotesMask(), WordsNum, FrontSlot, [&](int32 Slot)
+		{
+			if (ASplineMeshHoldNote* Note = GetNote(LaneIdx, Queue, Slot))
+				Note->UpdateDistance((ENoteDistance)Queue.Kinematics.Location[Slot]);
+		});
+
+		NoteKinematics::ForEachSetBitFrom(Simulation.GetMovingNotesMask(), WordsNum, FrontSlot, [&](int32 Slot)
+		{
+			ASplineMeshHoldNote* Note = GetNote(LaneIdx, Queue, Slot);
+			if (!Note)
+				return;
+
+			FVector NewWorldLoc, NewWorldTan;
+			FRotator NewWorldRot;
+			Lane->GetTransformAtPercentageAlongMovementPath(Note->RootPathPercentage, ESplineCoordinateSpace::World, NewWorldLoc, NewWorldTan, NewWorldRot);
+
+			if (MoveTickTimer) MoveTickTimer->Start();
+			Note->MoveTick(NewWorldLoc, NewWorldTan, NewWorldRot, Simulation.GetNoteAdvance(Slot));
+			if (MoveTickTimer) MoveTickTimer->Stop();
+		});
+
+		Simulation.RemoveFinishedNotes([&](int32 Slot)
+		{
+			if (ASplineMeshHoldNote* Note = GetNote(LaneIdx, Queue, Slot))
+			{
+				Note->Reset();
+				NoteActors[LaneIdx][Queue.Kinematics.Handle[Slot]] = nullptr;
+			}
+		});
+		Simulation.RetireNotes();
+	}
+
+private:
+
+	// Returns the hold note in the input slot of the lane's note queue, nullptr if the slot is empty or holds any other note
+	ASplineMeshHoldNote* GetNote(int32 LaneIdx, const FLaneNoteQueue& Queue, int32 Slot) const
+	{
+		const int32 Handle = Queue.IsLive(Slot) ? Queue.Kinematics.Handle[Slot] : INDEX_NONE;
+		return (Handle != INDEX_NONE) ? NoteActors[LaneIdx][Handle] : nullptr;
+	}
+
+	ARhythmGameGameMode*					GameMode;
+	const TArray<ULane*>&					Lanes;
+	// The notes of every lane by their handle in the lane's note queue. Notes that have left the lane are nullptr
+	TArray<TArray<ASplineMeshHoldNote*>>	NoteActors;
+};
+
+/* ############################################# COMMANDLET ############################################# */
+
+ULaneBenchmarkCommandlet::ULaneBenchmarkCommandlet()
+{
+	IsClient = false;
+	IsEditor = false;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 ULaneBenchmarkCommandlet::Main(const FString& Params)
+{
+	int32 LanesNum = 3;
+	FSyntheticChartParams ChartParams;
+	ChartParams.NotesPerSecond = 6.0f;
+	ChartParams.HoldRatio = 0.3f;
+	ChartParams.HoldLength = 1.0f;
+	float Seconds = 120.0f;
+	int32 FramesPerSecond = 60;
+	float MoveSpeed = 1000.0f;
+	float PathLength = 3000.0f;
+	int32 Seed = 1;
+	int32 WarmupFrames = 60;
+	FString OnlyList;
+	FString OutputFilename = FPaths::ProjectSavedDir() / TEXT("Benchmarks") / FString::Printf(TEXT("LaneBenchmark-%s.json"), *FDateTime::Now().ToString());
+
+	FParse::Value(*Params, TEXT("lanes="), LanesNum);
+	FParse::Value(*Params, TEXT("nps="), ChartParams.NotesPerSecond);
+	FParse::Value(*Params, TEXT("holdratio="), ChartParams.HoldRatio);
+	FParse::Value(*Params, TEXT("holdlength="), ChartParams.HoldLength);
+	FParse::Value(*Params, TEXT("seconds="), Seconds);
+	FParse::Value(*Params, TEXT("fps="), FramesPerSecond);
+	FParse::Value(*Params, TEXT("speed="), MoveSpeed);
+	FParse::Value(*Params, TEXT("length="), PathLength);
+	FParse::Value(*Params, TEXT("seed="), Seed);
+	FParse::Value(*Params, TEXT("warmup="), WarmupFrames);
+	FParse::Value(*Params, TEXT("only="), OnlyList, false);
+	FParse::Value(*Params, TEXT("output="), OutputFilename);
+
+	if (LanesNum <= 0 || FramesPerSecond <= 0 || MoveSpeed <= 0.0f || PathLength <= 0.0f || Seconds <= 0.0f)
+	{
+		UE_LOG(LogTemp, Error, TEXT("LaneBenchmark: -lanes, -fps, -speed, -length and -seconds have to be above 0"));
+		return 1;
+	}
+
+	TArray<FString> Only;
+	OnlyList.ParseIntoArray(Only, TEXT(","));
+
+	/* ############################################# WORLD ############################################# */
+
+	// A world of its own with the project's game mode, so the lanes and notes are the real ones and the notes come from the real note pool
+	UGameInstance* GameInstance = NewObject<UGameInstance>(GEngine);
+	GameInstance->AddToRoot();
+	GameInstance->InitializeStandalone(TEXT("LaneBenchmark"));
+	UWorld* World = GameInstance->GetWorld();
+
+	const FURL URL;
+	World->SetGameMode(URL);
+	World->InitializeActorsForPlay(URL);
+	World->BeginPlay();
+
+	auto DestroyWorld = [GameInstance, World]()
+	{
+		GEngine->DestroyWorldContext(World);
+		World->DestroyWorld(false);
+		GameInstance->Shutdown();
+		GameInstance->RemoveFromRoot();
+	};
+
+	ARhythmGameGameMode* GameMode = Cast<ARhythmGameGameMode>(World->GetAuthGameMode());
+	if (!GameMode || !GameMode->NotePool)
+	{
+		UE_LOG(LogTemp, Error, TEXT("LaneBenchmark: the default game mode has to be a RhythmGameGameMode with a note pool"));
+		DestroyWorld();
+		return 1;
+	}
+
+	// The hold note benchmarks time ASplineMeshHoldNote, which needs the pool to give out spline mesh hold notes
+	ABaseNote* PooledHoldNote = GameMode->NotePool->GetPooledObject(ENoteType::HOLD);
+	const bool bSplineMeshHoldNotes = Cast<ASplineMeshHoldNote>(PooledHoldNote) != nullptr;
+	if (PooledHoldNote)
+		PooledHoldNote->Reset();
+	if (!bSplineMeshHoldNotes)
+		UE_LOG(LogTemp, Warning, TEXT("LaneBenchmark: the note pool doesn't give out spline mesh hold notes, skipping SetActive and MoveTick"));
+
+	// Every lane gets the same path, a bend out to the button and back, so hold note segments are sized and sampled like on a curved lane. The
+	// button is between its two middle points
+	TArray<ULane*> LaneCmps;
+	for (int32 i = 0; i < LanesNum; i++)
+	{
+		AActor* LaneActor = World->SpawnActor<AActor>();
+		ULane* Lane = NewObject<ULane>(LaneActor, TEXT("Lane"));
+		LaneActor->SetRootComponent(Lane);
+
+		USplineComponent* PathSpline = NewObject<USplineComponent>(LaneActor, TEXT("Path"));
+		PathSpline->SetupAttachment(Lane);
+		PathSpline->SetSplinePoints({ FVector::ZeroVector, FVector(PathLength * 0.45f, PathLength / 10, 0.0f), FVector(PathLength * 0.55f, PathLength / 10, 0.0f),
+			FVector(PathLength, 0.0f, 0.0f) }, ESplineCoordinateSpace::Local);
+
+		Lane->RegisterComponent();
+		PathSpline->RegisterComponent();
+		Lane->SetUpStandalone(i, MoveSpeed, 1, 2);
+		LaneCmps.Add(Lane);
+	}
+
+	FMovementPathTable PathTable;
+	PathTable.Build(LaneCmps[0]->GetMovementPath(), 10.0f);
+	const float ButtonStart = LaneCmps[0]->GetPercentageAlongMovementPathAtSplinePoint(1);
+	const float ButtonEnd = LaneCmps[0]->GetPercentageAlongMovementPathAtSplinePoint(2);
+
+	ChartParams.NotesNum = FMath::CeilToInt(ChartParams.NotesPerSecond * Seconds);
+	TArray<FLaneSimulation> Lanes;
+	Lanes.SetNum(LanesNum);
+
+	float EndTime = 0.0f;
+	for (int32 i = 0; i < LanesNum; i++)
+	{
+		TSharedRef<const FLaneNoteStream> NoteStream = FLaneNoteStream::Generate(ChartParams, HashCombine(GetTypeHash(Seed), GetTypeHash(i)));
+		if (NoteStream->Num() > 0)
+		{
+			const FLaneNote LastNote = NoteStream->GetNote(NoteStream->Num() - 1);
+			EndTime = FMath::Max(EndTime, LastNote.Time + LastNote.HoldDuration);
+		}
+
+		LaneCmps[i]->LoadNotes(NoteStream);
+		Lanes[i].SetPath(&PathTable, ButtonStart, ButtonEnd);
+		Lanes[i].LoadNotes(NoteStream);
+	}
+
+	// Run until the last note has gone past the end of the path
+	const float DeltaTime = 1.0f / FramesPerSecond;
+	const int32 FramesNum = FMath::CeilToInt((EndTime + PathTable.GetLength() / MoveSpeed) / DeltaTime);
+
+	FBenchmarkHoldNotes HoldNotes(GameMode, LaneCmps);
+
+	TArray<FBenchmarkResult> Results;
+	Results.Reserve(8);
+
+	{
+		// Only counts allocations while the benchmarks run, GMalloc is the original one again once this goes out of scope
+		FCountingMalloc CountingMalloc;
+
+		// Starts every lane from the beginning and runs Frame(Time, Timer) for every frame, with the song time of the lanes set to Time
+		auto RunBenchmark = [&](const TCHAR* Name, TFunctionRef<void(float, FFrameTimer&)> Frame)
+		{
+			if (Only.Num() && !Only.Contains(Name))
+				return;
+
+			for (int32 i = 0; i < LanesNum; i++)
+			{
+				LaneCmps[i]->SetUpStandalone(i, MoveSpeed, 1, 2);
+				Lanes[i].SetMoveSpeed(0.0f, MoveSpeed);
+				Lanes[i].Reset(MoveSpeed);
+			}
+			HoldNotes.Reset();
+
+			FBenchmarkResult& Result = Results.AddDefaulted_GetRef();
+			Result.Name = Name;
+
+			FFrameTimer Timer(Result, CountingMalloc, FramesNum);
+			for (int32 FrameIdx = 0; FrameIdx < FramesNum; FrameIdx++)
+			{
+				const float Time = FrameIdx * DeltaTime;
+				GameMode->SecondsSinceStart = Time;
+				Frame(Time, Timer);
+				Timer.EndFrame(FrameIdx >= WarmupFrames);
+			}
+		};
+
+		RunBenchmark(TEXT("NoteSpawn"), [&](float Time, FFrameTimer& Timer)
+		{
+			for (ULane* Lane : LaneCmps)
+			{
+				Timer.Start();
+				Lane->NoteSpawn();
+				Timer.Stop();
+
+				Lane->UpdateNotes(DeltaTime);
+				Lane->UpdateQueue();
+			}
+		});
+
+		RunBenchmark(TEXT("UpdateNotes"), [&](float Time, FFrameTimer& Timer)
+		{
+			for (ULane* Lane : LaneCmps)
+			{
+				Lane->NoteSpawn();
+
+				Timer.Start();
+				Lane->UpdateNotes(DeltaTime);
+				Timer.Stop();
+
+				Lane->UpdateQueue();
+			}
+		});
+
+		RunBenchmark(TEXT("LaneStep"), [&](float Time, FFrameTimer& Timer)
+		{
+			for (FLaneSimulation& Lane : Lanes)
+			{
+				Timer.Start();
+				Lane.Step(Time, DeltaTime);
+				Timer.Stop();
+			}
+		});
+
+		if (bSplineMeshHoldNotes)
+		{
+			// The hold note benchmarks run the same frames, only what is timed differs
+			auto HoldFrame = [&](float Time, FFrameTimer& Timer, bool bTimeSetActive)
+			{
+				for (int32 LaneIdx = 0; LaneIdx < LanesNum; LaneIdx++)
+				{
+					HoldNotes.SpawnDue(LaneIdx, Lanes[LaneIdx], Time, bTimeSetActive ? &Timer : nullptr);
+					HoldNotes.Move(LaneIdx, Lanes[LaneIdx], Time, DeltaTime, bTimeSetActive ? nullptr : &Timer);
+				}
+			};
+
+			// Hold notes are moved frame by frame, the way ULane moves them unless bTimeDrivenNotes is set
+			for (FLaneSimulation& Lane : Lanes)
+				Lane.bTimeDrivenNotes = false;
+
+			RunBenchmark(TEXT("SetActive"), [&](float Time, FFrameTimer& Timer) { HoldFrame(Time, Timer, true); });
+			RunBenchmark(TEXT("MoveTick"), [&](float Time, FFrameTimer& Timer) { HoldFrame(Time, Timer, false); });
+		}
+
+		HoldNotes.Reset();
+	}
+
+	DestroyWorld();
+
+	/* ############################################# OUTPUT ############################################# */
+
+	TSharedRef<FJsonObject> Root = MakeShared<FJsonObject>();
+	Root->SetStringField(TEXT("benchmark"), TEXT("LaneBenchmark"));
+	Root->SetNumberField(TEXT("formatVersion"), 1);
+
+	TSharedRef<FJsonObject> Build = MakeShared<FJsonObject>();
+	Build->SetStringField(TEXT("version"), FApp::GetBuildVersion());
+	Build->SetStringField(TEXT("configuration"), LexToString(FApp::GetBuildConfiguration()));
+	Build->SetStringField(TEXT("platform"), FPlatformProperties::IniPlatformName());
+	Build->SetStringField(TEXT("cpu"), FPlatformMisc::GetCPUBrand().TrimStartAndEnd());
+	Root->SetObjectField(TEXT("build"), Build);
+
+	TSharedRef<FJsonObject> Parameters = MakeShared<FJsonObject>();
+	Parameters->SetNumberField(TEXT("lanes"), LanesNum);
+	Parameters->SetNumberField(TEXT("notesPerSecond"), ChartParams.NotesPerSecond);
+	Parameters->SetNumberField(TEXT("holdRatio"), ChartParams.HoldRatio);
+	Parameters->SetNumberField(TEXT("holdLength"), ChartParams.HoldLength);
+	Parameters->SetNumberField(TEXT("notesPerLane"), ChartParams.NotesNum);
+	Parameters->SetNumberField(TEXT("framesPerSecond"), FramesPerSecond);
+	Parameters->SetNumberField(TEXT("frames"), FramesNum);
+	Parameters->SetNumberField(TEXT("warmupFrames"), WarmupFrames);
+	Parameters->SetNumberField(TEXT("moveSpeed"), MoveSpeed);
+	Parameters->SetNumberField(TEXT("pathLength"), PathTable.GetLength());
+	Parameters->SetNumberField(TEXT("seed"), Seed);
+	Root->SetObjectField(TEXT("parameters"), Parameters);
+
+	TArray<TSharedPtr<FJsonValue>> ResultValues;
+	for (FBenchmarkResult& Result : Results)
+	{
+		Result.FrameNs.Sort();
+
+		double NsSum = 0.0;
+		for (double Ns : Result.FrameNs)
+			NsSum += Ns;
+
+		uint64 AllocationsSum = 0;
+		uint32 AllocationsMax = 0;
+		for (uint32 Allocations : Result.FrameAllocations)
+		{
+			AllocationsSum += Allocations;
+			AllocationsMax = FMath::Max(AllocationsMax, Allocations);
+		}
+
+		const int32 RecordedNum = FMath::Max(Result.FrameNs.Num(), 1);
+
+		TSharedRef<FJsonObject> NsPerFrame = MakeShared<FJsonObject>();
+		NsPerFrame->SetNumberField(TEXT("mean"), NsSum / RecordedNum);
+		NsPerFrame->SetNumberField(TEXT("p50"), GetPercentile(Result.FrameNs, 0.5));
+		NsPerFrame->SetNumberField(TEXT("p90"), GetPercentile(Result.FrameNs, 0.9));
+		NsPerFrame->SetNumberField(TEXT("p99"), GetPercentile(Result.FrameNs, 0.99));
+		NsPerFrame->SetNumberField(TEXT("max"), GetPercentile(Result.FrameNs, 1.0));
+
+		TSharedRef<FJsonObject> AllocationsPerFrame = MakeShared<FJsonObject>();
+		AllocationsPerFrame->SetNumberField(TEXT("mean"), (double)AllocationsSum / RecordedNum);
+		AllocationsPerFrame->SetNumberField(TEXT("max"), AllocationsMax);
+
+		TSharedRef<FJsonObject> ResultObject = MakeShared<FJsonObject>();
+		ResultObject->SetStringField(TEXT("name"), Result.Name);
+		ResultObject->SetNumberField(TEXT("frames"), Result.FrameNs.Num());
+		ResultObject->SetObjectField(TEXT("nsPerFrame"), NsPerFrame);
+		ResultObject->SetObjectField(TEXT("allocationsPerFrame"), AllocationsPerFrame);
+		ResultValues.Add(MakeShared<FJsonValueObject>(ResultObject));
+
+		UE_LOG(LogTemp, Display, TEXT("LaneBenchmark: %-12s p50 %10.0f ns  p90 %10.0f ns  p99 %10.0f ns  max %10.0f ns  %.2f allocations per frame"), *Result.Name,
+			GetPercentile(Result.FrameNs, 0.5), GetPercentile(Result.FrameNs, 0.9), GetPercentile(Result.FrameNs, 0.99), GetPercentile(Result.FrameNs, 1.0),
+			(double)AllocationsSum / RecordedNum);
+	}
+	Root->SetArrayField(TEXT("results"), ResultValues);
+
+	FString Output;
+	TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create(&Output);
+	if (!FJsonSerializer::Serialize(Root, Writer) || !FFileHelper::SaveStringToFile(Output, *OutputFilename))
+	{
+		UE_LOG(LogTemp, Error, TEXT("LaneBenchmark: couldn't write the results to %s"), *OutputFilename);
+		return 1;
+	}
+
+	UE_LOG(LogTemp, Display, TEXT("LaneBenchmark: results written to %s"), *OutputFilename);
+	return 0;
+}
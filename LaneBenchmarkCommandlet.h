@@ -0,0 +1,41 @@
+/*  Microbenchmarks of the note hot paths, run on a generated chart so every build is measured on the same notes. Each benchmark times only
+	its own path, frame by frame, and counts the allocations it makes on the way:
+
+		NoteSpawn	- Spawning the notes that are due, actors from the note pool included (ULane::NoteSpawn)
+		UpdateNotes	- Moving every note on the lane and taking the ones at the end of the path off it (ULane::UpdateNotes)
+		LaneStep	- A whole headless FLaneSimulation::Step
+		SetActive	- Laying out the body of every hold note that spawns (ASplineMeshHoldNote::SetActive)
+		MoveTick	- Moving the body of every hold note on the lane along the path (ASplineMeshHoldNote::MoveTick)
+
+	The lanes and notes are the real ones, spawned into a world of their own with the project's game mode, which has to have a note pool. Lanes
+	are set up with ULane::SetUpStandalone, so there is no level, player or button around them. SetActive and MoveTick are skipped if the pool's
+	hold notes aren't ASplineMeshHoldNotes.
+
+		UE4Editor-Cmd RhythmGame -run=LaneBenchmark [-lanes=3] [-nps=6] [-holdratio=0.3] [-holdlength=1] [-seconds=120] [-fps=60]
+			[-speed=1000] [-length=3000] [-seed=1] [-warmup=60] [-only=MoveTick,SetActive] [-output=Results.json]
+
+	Results go to a JSON file (Saved/Benchmarks by default) with ns per frame percentiles and allocations per frame of every benchmark, next to
+	the parameters and build they were run with.
+
+	Copyright (C) 2020-2021 Ilya Tsykunov (ilya@ilyatsykunov.com)
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+
+// Keep this last
+#include "LaneBenchmarkCommandlet.generated.h"
+
+UCLASS()
+class RHYTHMGAME_API ULaneBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+
+	ULaneBenchmarkCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
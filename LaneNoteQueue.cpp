@@ -0,0 +1,167 @@
+/*  Copyright (C) 2020-2021 Ilya Tsykunov (ilya@ilyatsykunov.com)
+*/
+
+#include "LaneNoteQueue.h"
+
+#include "EnumTypes.h"
+#include "NoteKinematics.h"
+
+namespace
+{
+	// Copies the used slots of a per-slot array into a bigger one, unwrapped so the front ends up in slot 0
+	template<typename ElementType>
+	void UnwrapInto(TArray<ElementType>& Array, int32 NewCapacity, int32 Front, int32 Count)
+	{
+		TArray<ElementType> NewArray;
+		NewArray.SetNumZeroed(NewCapacity);
+		for (int32 i = 0; i < Count; i++)
+			NewArray[i] = Array[(Front + i) & (Array.Num() - 1)];
+
+		Array = MoveTemp(NewArray);
+	}
+
+	// Same for a per-slot mask
+	TArray<uint64> UnwrapMask(const TArray<uint64>& Mask, int32 OldCapacity, int32 NewCapacity, int32 Front, int32 Count)
+	{
+		TArray<uint64> NewMask;
+		NewMask.Init(0, NoteKinematics::GetMaskWordsNum(NewCapacity));
+		for (int32 i = 0; i < Count; i++)
+		{
+			const int32 OldSlot = (Front + i) & (OldCapacity - 1);
+			NewMask[i / 64] |= ((Mask[OldSlot / 64] >> (OldSlot % 64)) & 1) << (i % 64);
+		}
+		return NewMask;
+	}
+}
+
+void FLaneNoteQueue::Reserve(int32 NewCapacity)
+{
+	// The per-slot masks are processed 64 slots at a time
+	NewCapacity = FMath::RoundUpToPowerOfTwo(FMath::Max(NewCapacity, 64));
+	if (NewCapacity <= GetCapacity())
+		return;
+
+	const int32 OldCapacity = GetCapacity();
+
+	// The masks are rebuilt for the unwrapped slots first, they need the old capacity
+	LiveMask = UnwrapMask(LiveMask, OldCapacity, NewCapacity, Front, Count);
+	ParkedMask = UnwrapMask(ParkedMask, OldCapacity, NewCapacity, Front, Count);
+	DoneMask = UnwrapMask(DoneMask, OldCapacity, NewCapacity, Front, Count);
+
+	UnwrapInto(Kinematics.Head, NewCapacity, Front, Count);
+	UnwrapInto(Kinematics.Root, NewCapacity, Front, Count);
+	UnwrapInto(Kinematics.Tail, NewCapacity, Front, Count);
+	UnwrapInto(Kinematics.Location, NewCapacity, Front, Count);
+	UnwrapInto(Kinematics.StartDistance, NewCapacity, Front, Count);
+	UnwrapInto(Kinematics.Length, NewCapacity, Front, Count);
+	UnwrapInto(Kinematics.NoteIdx, NewCapacity, Front, Count);
+	UnwrapInto(Kinematics.Handle, NewCapacity, Front, Count);
+
+	Front = 0;
+
+	// The notes were moved to the front, so every handle points at a new slot
+	for (int32 Slot = 0; Slot < Count; Slot++)
+	{
+		if (IsLive(Slot) && Kinematics.Handle[Slot] != INDEX_NONE)
+			HandleSlots[Kinematics.Handle[Slot]] = Slot;
+	}
+}
+
+int32 FLaneNoteQueue::Add(int32 NoteIdx)
+{
+	if (Count == GetCapacity())
+	{
+		if (Count > 0)
+			UE_LOG(LogTemp, Warning, TEXT("Lane note queue is full (%i notes), growing it"), Count);
+		Reserve(GetCapacity() * 2);
+	}
+
+	const int32 Slot = GetSlot(Count);
+	SetBit(LiveMask, Slot, true);
+	SetBit(ParkedMask, Slot, false);
+	SetBit(DoneMask, Slot, false);
+	Kinematics.Head[Slot] = 0.0f;
+	Kinematics.Root[Slot] = 0.0f;
+	Kinematics.Tail[Slot] = 0.0f;
+	Kinematics.Location[Slot] = (uint8)ENoteDistance::InLane;
+	Kinematics.StartDistance[Slot] = 0.0f;
+	Kinematics.Length[Slot] = 0.0f;
+	Kinematics.NoteIdx[Slot] = NoteIdx;
+	Kinematics.Handle[Slot] = INDEX_NONE;
+
+	Count++;
+	NotesNum++;
+	return Slot;
+}
+
+void FLaneNoteQueue::RemoveSlot(int32 Slot)
+{
+	if (IsLive(Slot))
+	{
+		SetBit(LiveMask, Slot, false);
+		SetHandle(Slot, INDEX_NONE);
+		NotesNum--;
+	}
+}
+
+void FLaneNoteQueue::SetHandle(int32 Slot, int32 Handle)
+{
+	const int32 OldHandle = Kinematics.Handle[Slot];
+	if (HandleSlots.IsValidIndex(OldHandle))
+		HandleSlots[OldHandle] = INDEX_NONE;
+
+	Kinematics.Handle[Slot] = Handle;
+	if (Handle == INDEX_NONE)
+		return;
+
+	if (Handle >= HandleSlots.Num())
+	{
+		const int32 OldNum = HandleSlots.Num();
+		HandleSlots.SetNumUninitialized(Handle + 1, false);
+		for (int32 i = OldNum; i < HandleSlots.Num(); i++)
+			HandleSlots[i] = INDEX_NONE;
+	}
+	HandleSlots[Handle] = Slot;
+}
+
+int32 FLaneNoteQueue::FindSlotOfNoteIdx(int32 NoteIdx) const
+{
+	if (NoteIdx == INDEX_NONE)
+		return INDEX_NONE;
+
+	for (int32 i = 0; i < Count; i++)
+	{
+		const int32 Slot = GetSlot(i);
+		if (IsLive(Slot) && Kinematics.NoteIdx[Slot] == NoteIdx)
+			return Slot;
+	}
+	return INDEX_NONE;
+}
+
+int32 FLaneNoteQueue::RetireFront()
+{
+	int32 RetiredNum = 0;
+	while (Count > 0 && !IsLive(Front))
+	{
+		Front = (Front + 1) & (GetCapacity() - 1);
+		Count--;
+		RetiredNum++;
+	}
+	return RetiredNum;
+}
+
+void FLaneNoteQueue::Empty()
+{
+	for (uint64& Word : LiveMask)
+		Word = 0;
+	for (uint64& Word : ParkedMask)
+		Word = 0;
+	for (uint64& Word : DoneMask)
+		Word = 0;
+	for (int32& Slot : HandleSlots)
+		Slot = INDEX_NONE;
+
+	Front = 0;
+	Count = 0;
+	NotesNum = 0;
+}
@@ -0,0 +1,113 @@
+/*  Fixed capacity ring buffer holding the notes that are currently on a lane, in the order they were spawned in.
+	Notes are never shifted around: a note that is removed leaves an empty slot behind, and empty slots are dropped
+	once they reach the front of the queue.
+
+	The queue keeps the values the lane works with every frame (head / root / tail % and location) in flat per-slot
+	arrays and doesn't know about the note actors at all: whoever owns the note of a slot (ULane's note actors) keeps
+	it by the slot's handle. It is owned by FLaneSimulation.
+
+	Copyright (C) 2020-2021 Ilya Tsykunov (ilya@ilyatsykunov.com)
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+// The per-slot values of the notes on the lane
+struct FLaneNoteKinematics
+{
+	TArray<float>	Head;
+	TArray<float>	Root;
+	TArray<float>	Tail;
+	// ENoteDistance
+	TArray<uint8>	Location;
+	// The lane's travelled distance at which the note was at the start of the path. Only used when notes are time driven
+	TArray<float>	StartDistance;
+	// Length of the note as % of the path, 0 for anything but hold notes
+	TArray<float>	Length;
+	// Index of the note in the lane's note stream
+	TArray<int32>	NoteIdx;
+	// What the owner of the note keeps it by, e.g. ULane's index into its note actors. INDEX_NONE until one is set
+	TArray<int32>	Handle;
+};
+
+struct FLaneNoteQueue
+{
+	/* Sets the number of notes the queue can hold before it has to grow. Rounded up to a power of two, 64 at least
+	*/
+	void		Reserve(int32 NewCapacity);
+
+	/* Adds a note to the back of the queue, in the lane, with every % at 0. If the queue is full it grows, which reallocates and moves
+	* the slots around, so the capacity should be set high enough up front
+	* @param NoteIdx	- Index of the note in the lane's note stream
+	* @return			- The slot the note was put in
+	*/
+	int32		Add(int32 NoteIdx);
+
+	/* Leaves an empty slot in the place of the note in the input slot
+	*/
+	void		RemoveSlot(int32 Slot);
+
+	/* Finds the slot of the note with the input index in the lane's note stream
+	* @return - The slot, INDEX_NONE if that note isn't in the queue
+	*/
+	int32		FindSlotOfNoteIdx(int32 NoteIdx) const;
+
+	/* Sets what the owner of the note in the input slot keeps it by
+	* @param Handle - A small index, e.g. into an array the owner keeps. INDEX_NONE to clear it
+	*/
+	void		SetHandle(int32 Slot, int32 Handle);
+
+	/* Returns the slot of the note with the input handle in constant time
+	* @return - The slot, INDEX_NONE if no note in the queue has it
+	*/
+	inline int32 FindSlotOfHandle(int32 Handle) const				{ return HandleSlots.IsValidIndex(Handle) ? HandleSlots[Handle] : INDEX_NONE; }
+
+	/* Drops every empty slot from the front of the queue
+	* @return - The number of slots dropped
+	*/
+	int32		RetireFront();
+
+	/* Removes every note, keeping the capacity
+	*/
+	void		Empty();
+
+	/* Number of slots in use, including empty slots that haven't been dropped yet. Use this with GetSlot to walk the queue front to back
+	*/
+	inline int32			Num() const								{ return Count; }
+	// Number of notes in the queue
+	inline int32			NumNotes() const						{ return NotesNum; }
+	inline bool				IsEmpty() const							{ return NotesNum == 0; }
+	inline int32			GetCapacity() const						{ return Kinematics.NoteIdx.Num(); }
+	inline int32			GetMaskWordsNum() const					{ return LiveMask.Num(); }
+	// Returns the slot of the input index counting from the front
+	inline int32			GetSlot(int32 Idx) const				{ return (Front + Idx) & (GetCapacity() - 1); }
+	// Returns whether the input slot holds a note
+	inline bool				IsLive(int32 Slot) const				{ return GetBit(LiveMask, Slot); }
+
+	// One bit per slot that holds a note
+	inline const uint64*	GetLiveMask() const						{ return LiveMask.GetData(); }
+	// One bit per slot whose note has stopped moving for good
+	inline const uint64*	GetParkedMask() const					{ return ParkedMask.GetData(); }
+	inline void				SetParked(int32 Slot)					{ SetBit(ParkedMask, Slot, true); }
+	// One bit per slot whose note can't be hit any more: it went past the button, was missed or is only there to be seen after a seek
+	inline bool				IsDone(int32 Slot) const				{ return GetBit(DoneMask, Slot); }
+	inline void				SetDone(int32 Slot)						{ SetBit(DoneMask, Slot, true); }
+
+							FLaneNoteKinematics		Kinematics;
+
+private:
+
+	inline bool				GetBit(const TArray<uint64>& Mask, int32 Slot) const	{ return (Mask[Slot / 64] >> (Slot % 64)) & 1; }
+	inline void				SetBit(TArray<uint64>& Mask, int32 Slot, bool bValue)	{ bValue ? Mask[Slot / 64] |= 1ull << (Slot % 64) : Mask[Slot / 64] &= ~(1ull << (Slot % 64)); }
+
+					TArray<uint64>			LiveMask;
+					TArray<uint64>			ParkedMask;
+					TArray<uint64>			DoneMask;
+	// Slot of the note with each handle, INDEX_NONE for handles no note in the queue has
+					TArray<int32>			HandleSlots;
+	// Slot of the oldest note
+					int32					Front = 0;
+					int32					Count = 0;
+					int32					NotesNum = 0;
+};
@@ -0,0 +1,213 @@
+/*  Copyright (C) 2020-2021 Ilya Tsykunov (ilya@ilyatsykunov.com)
+*/
+
+#include "LaneNoteStream.h"
+
+#include "Algo/BinarySearch.h"
+
+TSharedRef<const FLaneNoteStream> FLaneNoteStream::Compile(const TArray<FLevelMapRow>& Rows, int32 LaneIdx, const TArray<TPair<float, float>>& HoldNoteData)
+{
+	TSharedRef<FLaneNoteStream> Stream = MakeShared<FLaneNoteStream>();
+	int32 HoldNoteIdx = 0;
+
+	for (const FLevelMapRow& Row : Rows)
+	{
+		FLaneNote Note;
+		Note.Time = Row.Time;
+
+		switch (Row.Lanes[LaneIdx])
+		{
+		case ENoteType::SINGLE:
+		case ENoteType::SWIPE:
+		case ENoteType::BOMB:
+		case ENoteType::IGC:
+		case ENoteType::RANDOM:
+			Note.Type = Row.Lanes[LaneIdx];
+			break;
+		case ENoteType::BEG_HOLD:
+			Note.Type = ENoteType::HOLD;
+			Note.HoldDuration = HoldNoteData.IsValidIndex(HoldNoteIdx) ? HoldNoteData[HoldNoteIdx].Value : 0.0f;
+			Stream->MaxHoldDuration = FMath::Max(Stream->MaxHoldDuration, Note.HoldDuration);
+			HoldNoteIdx++;
+			break;
+		default:
+			// EMPTY, HOLD and END_HOLD don't spawn anything
+			continue;
+		}
+
+		Stream->Notes.Add(Note);
+	}
+
+	Stream->Notes.Shrink();
+	Stream->NotesNum = Stream->Notes.Num();
+	return Stream;
+}
+
+TSharedRef<const FLaneNoteStream> FLaneNoteStream::FromBinaryChart(TSharedRef<const FBinaryChart> Chart, int32 LaneIdx)
+{
+	TSharedRef<FLaneNoteStream> Stream = MakeShared<FLaneNoteStream>();
+	if (LaneIdx >= Chart->GetLanesNum())
+		return Stream;
+
+	const FBinaryChartLane& Lane = Chart->GetLane(LaneIdx);
+	Stream->Chart = Chart;
+	Stream->ChartLaneIdx = LaneIdx;
+	Stream->NotesNum = Lane.NotesNum;
+	Stream->MaxHoldDuration = Chart->TicksToSeconds(Lane.MaxHoldTicks);
+
+	// Add up the deltas once, notes are read one at a time while the lane plays
+	const FBinaryChartRecord* Records = Chart->GetRecords(LaneIdx);
+	Stream->NoteTimes.SetNumUninitialized(Stream->NotesNum);
+	uint32 Ticks = 0;
+	for (int32 i = 0; i < Stream->NotesNum; i++)
+	{
+		Ticks += Records[i].DeltaTicks;
+		Stream->NoteTimes[i] = Chart->TicksToSeconds(Ticks);
+	}
+	return Stream;
+}
+
+TSharedRef<const FLaneNoteStream> FLaneNoteStream::ResolveSpecialNotes(TSharedRef<const FLaneNoteStream> Source, const FSpecialNoteOdds& Odds, int32 Seed)
+{
+	TSharedRef<FLaneNoteStream> Stream = MakeShared<FLaneNoteStream>();
+	// Special notes always go on top of the notes themselves, so a stream that already has them hands over its source, the types are rolled again
+	Stream->Source = Source->Source.IsValid() ? Source->Source : TSharedPtr<const FLaneNoteStream>(Source);
+	Stream->NotesNum = Source->Num();
+	Stream->MaxHoldDuration = Source->MaxHoldDuration;
+	Stream->Types.SetNumUninitialized(Stream->NotesNum);
+
+	FRandomStream Random(Seed);
+	Source->ForEachNote([&Stream, &Odds, &Random](int32 NoteIdx, const FLaneNote& Note)
+	{
+		// Notes that aren't single notes keep their type, including the source's own special notes
+		ENoteType Type = Note.Type;
+		if (Type == ENoteType::SINGLE)
+		{
+			// Every roll is made whether or not an earlier one swapped the note, and later ones win, same as the spawn time swap used to
+			if (Odds.BombFreq > 0 && Random.RandRange(0, Odds.BombFreq) == 0)
+				Type = ENoteType::BOMB;
+			if (Odds.IgcFreq > 0 && Random.RandRange(0, Odds.IgcFreq) == 0)
+				Type = ENoteType::IGC;
+			if (Odds.RandomFreq > 0 && Random.RandRange(0, Odds.RandomFreq) == 0)
+				Type = ENoteType::RANDOM;
+		}
+
+		Stream->Types[NoteIdx] = Type;
+	});
+
+	return Stream;
+}
+
+TSharedRef<const FLaneNoteStream> FLaneNoteStream::Generate(const FSyntheticChartParams& Params, int32 Seed)
+{
+	TSharedRef<FLaneNoteStream> Stream = MakeShared<FLaneNoteStream>();
+	FRandomStream Random(Seed);
+	Stream->Notes.Reserve(Params.NotesNum);
+
+	// Gaps and holds are spread 50% either side of their average
+	const float AverageGap = 1.0f / FMath::Max(Params.NotesPerSecond, KINDA_SMALL_NUMBER);
+
+	float Time = 1.0f;
+	for (int32 i = 0; i < Params.NotesNum; i++)
+	{
+		FLaneNote Note;
+		Note.Time = Time;
+		Note.Type = ENoteType::SINGLE;
+
+		if (Random.GetFraction() < Params.HoldRatio)
+		{
+			Note.Type = ENoteType::HOLD;
+			Note.HoldDuration = Params.HoldLength * Random.FRandRange(0.5f, 1.5f);
+			Stream->MaxHoldDuration = FMath::Max(Stream->MaxHoldDuration, Note.HoldDuration);
+		}
+
+		Stream->Notes.Add(Note);
+		Time += Note.HoldDuration + AverageGap * Random.FRandRange(0.5f, 1.5f);
+	}
+
+	Stream->NotesNum = Stream->Notes.Num();
+	return Stream;
+}
+
+FLaneNote FLaneNoteStream::GetNote(int32 Idx) const
+{
+	if (Chart.IsValid())
+		return DecodeRecord(Chart->GetRecords(ChartLaneIdx)[Idx], NoteTimes[Idx]);
+
+	if (Source.IsValid())
+	{
+		FLaneNote Note = Source->GetNote(Idx);
+		Note.Type = Types[Idx];
+		return Note;
+	}
+
+	return Notes[Idx];
+}
+
+int32 FLaneNoteStream::LowerBound(float Time) const
+{
+	if (Chart.IsValid())
+		return Algo::LowerBound(NoteTimes, Time);
+
+	if (Source.IsValid())
+		return Source->LowerBound(Time);
+
+	return Algo::LowerBoundBy(Notes, Time, [](const FLaneNote& Note) { return Note.Time; });
+}
+
+ENoteType FLaneNoteStream::GetPooledType(ENoteType Type)
+{
+	// Swipe notes are spawned as single notes
+	return (Type == ENoteType::SWIPE) ? ENoteType::SINGLE : Type;
+}
+
+void FLaneNoteStream::GetLifetimes(float SpawnTimeOffset, float PathTime, TArray<FNoteLifetime>& OutLifetimes) const
+{
+	OutLifetimes.Reserve(OutLifetimes.Num() + NotesNum);
+
+	ForEachNote([SpawnTimeOffset, PathTime, &OutLifetimes](int32 NoteIdx, const FLaneNote& Note)
+	{
+		// Never spawned, see FLaneNoteStream::DecodeRecord
+		if (Note.Type == ENoteType::EMPTY)
+			return;
+
+		FNoteLifetime Lifetime;
+		Lifetime.SpawnTime = Note.Time - SpawnTimeOffset;
+		// Same as ULane::Seek, a hold note stays on the lane until its tail has travelled the path
+		Lifetime.EndTime = Lifetime.SpawnTime + PathTime + Note.HoldDuration;
+		Lifetime.PooledType = GetPooledType(Note.Type);
+		OutLifetimes.Add(Lifetime);
+	});
+}
+
+void FLaneNoteStream::GetPeakConcurrentNotes(const TArray<FNoteLifetime>& Lifetimes, TMap<ENoteType, int32>& OutPeaks)
+{
+	// <Time, +1 when a note spawns / -1 when it leaves, type>
+	struct FEvent
+	{
+		float		Time;
+		int32		Change;
+		ENoteType	Type;
+	};
+
+	TArray<FEvent> Events;
+	Events.Reserve(Lifetimes.Num() * 2);
+	for (const FNoteLifetime& Lifetime : Lifetimes)
+	{
+		Events.Add({ Lifetime.SpawnTime, 1, Lifetime.PooledType });
+		Events.Add({ Lifetime.EndTime, -1, Lifetime.PooledType });
+	}
+
+	// A note that spawns in the same frame another one leaves can't take its place, so spawns come first
+	Events.Sort([](const FEvent& A, const FEvent& B) { return A.Time < B.Time || (A.Time == B.Time && A.Change > B.Change); });
+
+	TMap<ENoteType, int32> Current;
+	for (const FEvent& Event : Events)
+	{
+		int32& Count = Current.FindOrAdd(Event.Type);
+		Count += Event.Change;
+
+		int32& Peak = OutPeaks.FindOrAdd(Event.Type);
+		Peak = FMath::Max(Peak, Count);
+	}
+}
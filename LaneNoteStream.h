@@ -0,0 +1,183 @@
+/*  The notes of a single lane, compiled once from the level map when the level is loaded. Rows that are empty for the lane
+	and the hold / end of hold markers are dropped, so the lane only ever walks the notes it actually has to spawn.
+
+	A stream loaded from a binary chart keeps the chart alive and reads the lane's records in place, only the absolute time of every note
+	is added up once when it is loaded. The special notes of a run are kept as one type per note on top of the stream they were rolled from.
+
+	Copyright (C) 2020-2021 Ilya Tsykunov (ilya@ilyatsykunov.com)
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "EnumTypes.h"
+#include "BinaryChart.h"
+#include "NoteMap.h"
+
+// A single note the lane has to spawn
+struct FLaneNote
+{
+	// Time (s) at which the note reaches the button. The note spawns at Time - the lane's SpawnTimeOffset
+	float		Time = 0.0f;
+	// How long the note has to be held for. Only used by hold notes
+	float		HoldDuration = 0.0f;
+	// SINGLE, HOLD, SWIPE, BOMB, IGC or RANDOM
+	ENoteType	Type = ENoteType::EMPTY;
+};
+
+// When a note is on a lane, from when it spawns to when it has gone past the end of the path
+struct FNoteLifetime
+{
+	float		SpawnTime = 0.0f;
+	float		EndTime = 0.0f;
+	// Object pool type the note is spawned from
+	ENoteType	PooledType = ENoteType::EMPTY;
+};
+
+// How often single notes are swapped for special notes. A single note is swapped when a roll of 0 - Freq comes up 0, 0 never swaps it
+struct FSpecialNoteOdds
+{
+	int32	BombFreq = 0;
+	int32	IgcFreq = 0;
+	int32	RandomFreq = 0;
+};
+
+// What a generated chart looks like, see FLaneNoteStream::Generate
+struct FSyntheticChartParams
+{
+	int32	NotesNum = 2000;
+	// Average notes per second, not counting the time spent holding hold notes
+	float	NotesPerSecond = 3.0f;
+	// Fraction (0 - 1) of the notes that are hold notes
+	float	HoldRatio = 0.2f;
+	// Average hold duration (s)
+	float	HoldLength = 0.9f;
+};
+
+struct FLaneNoteStream
+{
+	/* Turns the level map into the compact, time ordered list of notes of one lane
+	* @param Rows			- Array containing the note types and times to spawn them at
+	* @param LaneIdx		- Which lane of the rows to compile
+	* @param HoldNoteData	- <Time value of entry, duration> of every hold note of this lane, in order
+	*/
+	static TSharedRef<const FLaneNoteStream> Compile(const TArray<FLevelMapRow>& Rows, int32 LaneIdx, const TArray<TPair<float, float>>& HoldNoteData);
+
+	/* Reads the notes of one lane of a binary chart straight from the chart's records. Only the note times are worked out up front, the
+	* stream keeps the chart (and so the mapped file) alive for as long as it is used
+	* @param Chart		- The binary chart
+	* @param LaneIdx	- Which lane of the chart to read
+	*/
+	static TSharedRef<const FLaneNoteStream> FromBinaryChart(TSharedRef<const FBinaryChart> Chart, int32 LaneIdx);
+
+	/* Returns the stream with single notes swapped for bomb, igc and random notes. Only the type of every note is stored, the rest is
+	* still read from the source stream. The rolls come from a stream seeded with the input seed, so the same seed always gives the same notes
+	* @param Source	- The stream as it was compiled from the chart
+	* @param Odds	- How often each special note replaces a single note
+	* @param Seed	- Seed of this run and lane
+	*/
+	static TSharedRef<const FLaneNoteStream> ResolveSpecialNotes(TSharedRef<const FLaneNoteStream> Source, const FSpecialNoteOdds& Odds, int32 Seed);
+
+	/* Makes up the notes of a lane: single notes with hold notes mixed in, never overlapping. Used to run and benchmark the lane without a chart
+	* @param Params	- How many notes, how dense and how many of them are hold notes
+	* @param Seed	- The same seed always gives the same notes
+	*/
+	static TSharedRef<const FLaneNoteStream> Generate(const FSyntheticChartParams& Params, int32 Seed);
+
+	/* Returns the index of the first note that reaches the button at or after the input time
+	*/
+	int32 LowerBound(float Time) const;
+
+	/* Which object pool type a note of the input type is spawned from
+	*/
+	static ENoteType GetPooledType(ENoteType Type);
+
+	/* Adds when each note of the stream is on the lane to the input array
+	* @param SpawnTimeOffset	- How long before its time a note spawns on the lane
+	* @param PathTime			- How long it takes a note to travel the whole movement path
+	* @param OutLifetimes		- Array to add the lifetimes to
+	*/
+	void GetLifetimes(float SpawnTimeOffset, float PathTime, TArray<FNoteLifetime>& OutLifetimes) const;
+
+	/* Works out the most notes of each pool type that are on the lanes at the same time
+	* @param Lifetimes	- Lifetimes of the notes of every lane, see GetLifetimes
+	* @param OutPeaks	- <Pool type, most notes of that type at once>
+	*/
+	static void GetPeakConcurrentNotes(const TArray<FNoteLifetime>& Lifetimes, TMap<ENoteType, int32>& OutPeaks);
+
+	/* Returns a note of the stream in constant time
+	*/
+	FLaneNote GetNote(int32 Idx) const;
+
+	/* Calls Func(int32 NoteIdx, const FLaneNote&) for every note of the stream, in order
+	*/
+	template<typename FuncType>
+	void ForEachNote(FuncType Func) const
+	{
+		if (!Source.IsValid())
+		{
+			ForEachSourceNote(Func);
+			return;
+		}
+
+		// The source is never a stream with special notes of its own, see ResolveSpecialNotes
+		Source->ForEachSourceNote([this, &Func](int32 i, FLaneNote Note)
+		{
+			Note.Type = Types[i];
+			Func(i, Note);
+		});
+	}
+
+	inline int32			Num() const						{ return NotesNum; }
+	inline FLaneNote		operator[](int32 Idx) const		{ return GetNote(Idx); }
+
+	// The longest hold in the stream
+	float				MaxHoldDuration = 0.0f;
+
+private:
+
+	/* ForEachNote of a stream without special notes: walks the chart's records or the compiled notes
+	*/
+	template<typename FuncType>
+	void ForEachSourceNote(FuncType Func) const
+	{
+		if (Chart.IsValid())
+		{
+			const FBinaryChartRecord* Records = Chart->GetRecords(ChartLaneIdx);
+			for (int32 i = 0; i < NotesNum; i++)
+				Func(i, DecodeRecord(Records[i], NoteTimes[i]));
+		}
+		else
+		{
+			for (int32 i = 0; i < NotesNum; i++)
+				Func(i, Notes[i]);
+		}
+	}
+
+	/* Turns a binary chart record of the stream's lane into a note
+	* @param Time - Absolute time of the record (s)
+	*/
+	inline FLaneNote DecodeRecord(const FBinaryChartRecord& Record, float Time) const
+	{
+		FLaneNote Note;
+		Note.Time = Time;
+		Note.HoldDuration = Chart->TicksToSeconds(Record.GetHoldTicks());
+		// The type byte isn't checked when the chart is opened, a note of a type the lane can't spawn is skipped like an empty row
+		Note.Type = Record.IsValidType() ? Record.GetType() : ENoteType::EMPTY;
+		return Note;
+	}
+
+	// The notes, when the stream was compiled from a level map or generated
+	TArray<FLaneNote>					Notes;
+	int32								NotesNum = 0;
+
+	// The chart the notes are read from, when the stream came from a binary chart, and the absolute time (s) of each of its notes so
+	// a note doesn't have to be decoded from a keyframe every time it is read
+	TSharedPtr<const FBinaryChart>		Chart;
+	int32								ChartLaneIdx = 0;
+	TArray<float>						NoteTimes;
+
+	// The stream the special notes were rolled for and the type of every note with the special notes swapped in
+	TSharedPtr<const FLaneNoteStream>	Source;
+	TArray<ENoteType>					Types;
+};
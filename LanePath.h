@@ -0,0 +1,40 @@
+/*  The path the notes of a lane travel along, as the gameplay code sees it. In the game this is the lane's baked movement path
+	(FMovementPathTable), the headless simulation can use a plain straight line instead.
+
+	Copyright (C) 2020-2021 Ilya Tsykunov (ilya@ilyatsykunov.com)
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class ILanePath
+{
+public:
+
+	virtual ~ILanePath() {}
+
+	/* Returns the length of the path in units
+	*/
+	virtual float	GetLength() const = 0;
+
+	/* Returns the location at the input % along the path, in the path's own space. Percentages outside 0-1 are clamped
+	*/
+	virtual FVector	GetLocation(float Percentage) const = 0;
+};
+
+// A straight line from Start to End
+class FStraightLanePath : public ILanePath
+{
+public:
+
+	FStraightLanePath(const FVector& InStart, const FVector& InEnd) : Start(InStart), End(InEnd) {}
+
+	virtual float	GetLength() const override						{ return FVector::Dist(Start, End); }
+	virtual FVector	GetLocation(float Percentage) const override	{ return FMath::Lerp(Start, End, FMath::Clamp(Percentage, 0.0f, 1.0f)); }
+
+private:
+
+	FVector	Start;
+	FVector	End;
+};
@@ -0,0 +1,346 @@
+/*  Copyright (C) 2020-2021 Ilya Tsykunov (ilya@ilyatsykunov.com)
+*/
+
+#include "LaneSimulation.h"
+
+#include "Math/RandomStream.h"
+
+void FLaneSimulation::SetPath(const ILanePath* NewPath, float NewBoundaryStart, float NewBoundaryEnd)
+{
+	Path = NewPath;
+	BoundaryStart = NewBoundaryStart;
+	BoundaryEnd = NewBoundaryEnd;
+}
+
+void FLaneSimulation::LoadNotes(TSharedPtr<const FLaneNoteStream> NewNoteStream)
+{
+	LoadedNoteStream = NewNoteStream;
+	NoteStream = NewNoteStream;
+	NoteIndex = 0;
+	Judge.Reset(NoteStream);
+}
+
+void FLaneSimulation::ResolveSpecialNotes(const FSpecialNoteOdds& Odds, int32 Seed)
+{
+	if (!LoadedNoteStream.IsValid())
+		return;
+
+	NoteStream = FLaneNoteStream::ResolveSpecialNotes(LoadedNoteStream.ToSharedRef(), Odds, Seed);
+	NoteIndex = 0;
+	Judge.Reset(NoteStream);
+}
+
+void FLaneSimulation::SetMoveSpeed(float Time, float NewSpeed, float GameSpeed)
+{
+	// Restart the travelled distance from now at the new speed, so notes carry on from exactly where they are
+	TravelEpochDistance = GetTravelledDistance(Time);
+	TravelEpochTime = Time;
+
+	MoveSpeed = NewSpeed;
+	SpawnTimeOffset = (NewSpeed > 0.0f) ? ((GetButtonPercentage() * GetPathLength()) / NewSpeed) * GameSpeed : 0.0f;
+
+	const float PathLength = GetPathLength();
+	if (!NoteStream.IsValid() || PathLength <= 0.0f)
+		return;
+
+	// Notes on the lane are put where they would be had they spawned at the new speed, so they still reach the button at their time.
+	// Notes that are done with the button keep going from where they are
+	FLaneNoteKinematics& Kinematics = Notes.Kinematics;
+	for (int32 i = 0; i < Notes.Num(); i++)
+	{
+		const int32 Slot = Notes.GetSlot(i);
+		if (!Notes.IsLive(Slot))
+			continue;
+
+		const FLaneNote LaneNote = NoteStream->GetNote(Kinematics.NoteIdx[Slot]);
+		if (LaneNote.Time + LaneNote.HoldDuration <= Time)
+			continue;
+
+		Kinematics.StartDistance[Slot] = GetTravelledDistance(LaneNote.Time - SpawnTimeOffset);
+		if (LaneNote.Type == ENoteType::HOLD)
+			Kinematics.Length[Slot] = LaneNote.HoldDuration * NewSpeed / PathLength;
+	}
+}
+
+void FLaneSimulation::Reset(float NewSpeed)
+{
+	MoveSpeed = NewSpeed;
+	TravelEpochTime = 0.0f;
+	TravelEpochDistance = 0.0f;
+
+	NoteIndex = 0;
+	Judge.Reset(NoteStream);
+	Notes.Empty();
+	bButtonPressed = false;
+	Stats = FLaneSimulationStats();
+	ClearUpdateMasks();
+}
+
+void FLaneSimulation::BeginSeek(float Time, bool bButtonDown)
+{
+	NoteIndex = 0;
+	Judge.Reset(NoteStream, Time, bButtonDown);
+	Notes.Empty();
+	bButtonPressed = bButtonDown;
+	ClearUpdateMasks();
+
+	// Start the travelled distance from the seek time
+	TravelEpochTime = Time;
+	TravelEpochDistance = 0.0f;
+}
+
+EJudgement FLaneSimulation::Press(float Time, TArray<FJudgedNote>& OutJudged)
+{
+	bButtonPressed = true;
+
+	const int32 FirstIdx = OutJudged.Num();
+	const EJudgement Judgement = Judge.Judge(Time, JudgementWindows, OutJudged);
+
+	if (Judgement == EJudgement::NONE)
+		Stats.CompleteMisses++;
+	TakeJudgements(OutJudged, FirstIdx);
+
+	return Judgement;
+}
+
+EJudgement FLaneSimulation::Release(float Time, TArray<FJudgedNote>& OutJudged)
+{
+	bButtonPressed = false;
+
+	const int32 FirstIdx = OutJudged.Num();
+	const EJudgement Judgement = Judge.JudgeRelease(Time, JudgementWindows, OutJudged);
+	TakeJudgements(OutJudged, FirstIdx);
+	return Judgement;
+}
+
+void FLaneSimulation::ExpireMisses(float Time, TArray<FJudgedNote>& OutJudged)
+{
+	const int32 FirstIdx = OutJudged.Num();
+	Judge.ExpireMisses(Time, JudgementWindows, OutJudged);
+	TakeJudgements(OutJudged, FirstIdx);
+}
+
+void FLaneSimulation::TakeJudgements(TArray<FJudgedNote>& Judged, int32 FirstIdx)
+{
+	for (int32 i = FirstIdx; i < Judged.Num(); i++)
+	{
+		FJudgedNote& Note = Judged[i];
+
+		// The note can already be off the lane, e.g. when a seek brought it back only to be seen
+		const int32 Slot = Notes.FindSlotOfNoteIdx(Note.NoteIdx);
+		if (Slot != INDEX_NONE)
+			Note.Handle = Notes.Kinematics.Handle[Slot];
+
+		switch (Note.Judgement)
+		{
+		case EJudgement::PERFECT:	Stats.Perfect++;	break;
+		case EJudgement::GREAT:		Stats.Great++;		break;
+		case EJudgement::GOOD:		Stats.Good++;		break;
+		case EJudgement::MISS:
+			Stats.Miss++;
+			if (Slot != INDEX_NONE)
+				Notes.SetDone(Slot);
+			continue;
+		case EJudgement::BOMB:
+			// A bomb that was pressed goes off and leaves the lane
+			Stats.Bombs++;
+			if (Slot != INDEX_NONE)
+				Notes.RemoveSlot(Slot);
+			continue;
+		default:
+			continue;
+		}
+
+		// Only presses that hit count towards the mean offset
+		Stats.OffsetSum += Note.Offset;
+
+		// The press that starts a hold note only lets it be held, it leaves the lane once it is let go or held to its end
+		if (!Note.bHoldStart && Slot != INDEX_NONE)
+			Notes.RemoveSlot(Slot);
+	}
+}
+
+int32 FLaneSimulation::AddNote(int32 NoteIdx, const FLaneNote& LaneNote, float Time, float SpawnDelay)
+{
+	const float PathLength = GetPathLength();
+	const int32 Slot = Notes.Add(NoteIdx);
+	FLaneNoteKinematics& Kinematics = Notes.Kinematics;
+
+	Kinematics.StartDistance[Slot] = GetTravelledDistance(Time - SpawnDelay);
+	if (PathLength > 0.0f)
+	{
+		Kinematics.Length[Slot] = (LaneNote.Type == ENoteType::HOLD) ? LaneNote.HoldDuration * MoveSpeed / PathLength : 0.0f;
+		Kinematics.Root[Slot] = (GetTravelledDistance(Time) - Kinematics.StartDistance[Slot]) / PathLength;
+		Kinematics.Head[Slot] = Kinematics.Root[Slot];
+		Kinematics.Tail[Slot] = Kinematics.Root[Slot] - Kinematics.Length[Slot];
+	}
+	return Slot;
+}
+
+void FLaneSimulation::UpdateNotes(float Time, float DeltaTime)
+{
+	FLaneNoteKinematics& Kinematics = Notes.Kinematics;
+	const int32 SlotsNum = Notes.GetCapacity();
+	const int32 WordsNum = Notes.GetMaskWordsNum();
+
+	ChangedNotesMask.SetNumUninitialized(WordsNum, false);
+	MovingNotesMask.SetNumUninitialized(WordsNum, false);
+	PastButtonNotesMask.SetNumUninitialized(WordsNum, false);
+	FinishedNotesMask.SetNumUninitialized(WordsNum, false);
+	NoteAdvances.SetNumUninitialized(SlotsNum, false);
+
+	// Only a note whose tail has reached the end of the path can't move again. A note that didn't move (paused clock, zero move speed) keeps being updated
+	for (int32 Word = 0; Word < WordsNum; Word++)
+		MovingNotesMask[Word] = Notes.GetLiveMask()[Word] & ~Notes.GetParkedMask()[Word];
+
+	const float PathLength = GetPathLength();
+	if (PathLength <= 0.0f)
+	{
+		ClearUpdateMasks();
+		return;
+	}
+
+	// Work out how far every note moves
+	if (bTimeDrivenNotes)
+	{
+		// Straight to where the note should be at this time, so no error builds up from update to update
+		NoteKinematics::ComputeTimeDrivenAdvances(Kinematics.StartDistance.GetData(), Kinematics.Root.GetData(), SlotsNum, GetTravelledDistance(Time),
+			PathLength, NoteAdvances.GetData());
+	}
+	else
+	{
+		const float TickPercentage = MoveSpeed * DeltaTime / PathLength;
+		for (int32 Slot = 0; Slot < SlotsNum; Slot++)
+			NoteAdvances[Slot] = TickPercentage;
+	}
+
+	NoteKinematics::ForEachSetBit(MovingNotesMask.GetData(), WordsNum, [this, &Kinematics](int32 Slot)
+	{
+		Kinematics.Root[Slot] += NoteAdvances[Slot];
+		Kinematics.Head[Slot] = Kinematics.Root[Slot];
+		Kinematics.Tail[Slot] = Kinematics.Root[Slot] - Kinematics.Length[Slot];
+
+		if (Kinematics.Tail[Slot] >= 1.0f)
+			Notes.SetParked(Slot);
+	});
+
+	// The head of a hold note that is being held stays at the button while the rest of the note goes into it
+	const int32 HeldSlot = bButtonPressed ? Notes.FindSlotOfNoteIdx(Judge.GetHeldNote()) : INDEX_NONE;
+	if (HeldSlot != INDEX_NONE)
+		Kinematics.Head[HeldSlot] = FMath::Min(Kinematics.Root[HeldSlot], GetButtonPercentage());
+
+	NoteKinematics::ClassifyDistances(Kinematics.Head.GetData(), Kinematics.Tail.GetData(), Kinematics.Location.GetData(), Notes.GetLiveMask(), SlotsNum,
+		BoundaryStart, BoundaryEnd, ChangedNotesMask.GetData(), PastButtonNotesMask.GetData());
+
+	// A note that has gone past the button can't be hit any more. Whether it was missed is decided by its time in ExpireMisses, not here
+	NoteKinematics::ForEachSetBit(PastButtonNotesMask.GetData(), WordsNum, [this](int32 Slot) { Notes.SetDone(Slot); });
+
+	// Notes are taken off the lane once they have travelled the whole path
+	NoteKinematics::FindAtOrPast(Kinematics.Tail.GetData(), Notes.GetLiveMask(), SlotsNum, 1.0f, FinishedNotesMask.GetData());
+}
+
+void FLaneSimulation::ClearUpdateMasks()
+{
+	// The slots can move around when the queue grows, so results of an update from before it was cleared would point at the wrong notes
+	ChangedNotesMask.Reset();
+	MovingNotesMask.Reset();
+	PastButtonNotesMask.Reset();
+	FinishedNotesMask.Reset();
+}
+
+int32 FLaneSimulation::FindNoteWithinBounds() const
+{
+	for (int32 i = 0; i < Notes.Num(); i++)
+	{
+		// Notes that are already done with (missed, or brought back by Seek only to be seen) can't be hit any more
+		const int32 Slot = Notes.GetSlot(i);
+		if (Notes.IsLive(Slot) && !Notes.IsDone(Slot) && Notes.Kinematics.Location[Slot] == (uint8)ENoteDistance::InButton)
+			return Slot;
+	}
+	return INDEX_NONE;
+}
+
+void FLaneSimulation::Step(float Time, float DeltaTime)
+{
+	SpawnDueNotes(Time, [](int32 Slot, const FLaneNote& LaneNote, float SpawnDelay) {});
+	UpdateNotes(Time, DeltaTime);
+
+	StepJudged.Reset();
+	ExpireMisses(Time, StepJudged);
+
+	RemoveFinishedNotes([](int32 Slot) {});
+	RetireNotes();
+}
+
+TArray<FScriptedInput> FLaneSimulation::ScriptInputs(const FLaneNoteStream& Stream, const FScriptedInputParams& Params, int32 Seed)
+{
+	FRandomStream Rand(Seed);
+	TArray<FScriptedInput> Inputs;
+
+	Stream.ForEachNote([&Params, &Rand, &Inputs](int32 NoteIdx, const FLaneNote& Note)
+	{
+		if (Rand.GetFraction() < Params.MissRate)
+			return;
+
+		const float PressTime = Note.Time + Rand.FRandRange(-Params.Accuracy, Params.Accuracy);
+		const float ReleaseTime = (Note.Type == ENoteType::HOLD) ? Note.Time + Note.HoldDuration + Rand.FRandRange(-Params.Accuracy, Params.Accuracy) : PressTime + 0.05f;
+		Inputs.Add({ PressTime, true });
+		Inputs.Add({ ReleaseTime, false });
+
+		if (Rand.GetFraction() < Params.StrayPressRate)
+		{
+			Inputs.Add({ ReleaseTime + 0.3f, true });
+			Inputs.Add({ ReleaseTime + 0.35f, false });
+		}
+	});
+
+	Inputs.StableSort([](const FScriptedInput& A, const FScriptedInput& B) { return A.Time < B.Time; });
+	return Inputs;
+}
+
+void FLaneSimulation::Play(const TArray<FScriptedInput>& Inputs, float EndTime, float DeltaTime)
+{
+	TArray<FJudgedNote> Judged;
+
+	int32 InputIdx = 0;
+	for (int32 Frame = 0; Frame * DeltaTime < EndTime; Frame++)
+	{
+		const float Time = Frame * DeltaTime;
+		for (; InputIdx < Inputs.Num() && Inputs[InputIdx].Time <= Time; InputIdx++)
+		{
+			Judged.Reset();
+			if (Inputs[InputIdx].bPressed)
+				Press(Inputs[InputIdx].Time, Judged);
+			else
+				Release(Inputs[InputIdx].Time, Judged);
+		}
+
+		Step(Time, DeltaTime);
+	}
+}
+
+uint32 FLaneSimulation::GetStateHash() const
+{
+	uint32 Hash = GetTypeHash(NoteIndex);
+	Hash = HashCombine(Hash, GetTypeHash(Judge.GetCursor()));
+	Hash = HashCombine(Hash, GetTypeHash(Stats.Perfect));
+	Hash = HashCombine(Hash, GetTypeHash(Stats.Great));
+	Hash = HashCombine(Hash, GetTypeHash(Stats.Good));
+	Hash = HashCombine(Hash, GetTypeHash(Stats.Miss));
+	Hash = HashCombine(Hash, GetTypeHash(Stats.CompleteMisses));
+	Hash = HashCombine(Hash, GetTypeHash(Stats.Bombs));
+
+	const FLaneNoteKinematics& Kinematics = Notes.Kinematics;
+	for (int32 i = 0; i < Notes.Num(); i++)
+	{
+		const int32 Slot = Notes.GetSlot(i);
+		if (!Notes.IsLive(Slot))
+			continue;
+
+		Hash = HashCombine(Hash, GetTypeHash(Kinematics.NoteIdx[Slot]));
+		Hash = HashCombine(Hash, GetTypeHash(Kinematics.Head[Slot]));
+		Hash = HashCombine(Hash, GetTypeHash(Kinematics.Tail[Slot]));
+		Hash = HashCombine(Hash, GetTypeHash(Kinematics.Location[Slot]));
+	}
+	return Hash;
+}
@@ -0,0 +1,337 @@
+/*  The gameplay of a single lane without any of the engine around it: when notes spawn, how far they have travelled, where they are
+	relative to the button, hold progress and judging presses / releases against the notes' times. It only knows the lane's path
+	through ILanePath and doesn't touch any UObject, so it can be stepped on its own (see ULaneSimulationCommandlet).
+
+	ULane owns one and runs all of its notes through it: the simulation keeps the notes on the lane in its FLaneNoteQueue and decides
+	where they are, which of them can be hit and when they leave the lane, the lane only moves the note actors to match.
+
+	Copyright (C) 2020-2021 Ilya Tsykunov (ilya@ilyatsykunov.com)
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "EnumTypes.h"
+#include "LanePath.h"
+#include "LaneNoteQueue.h"
+#include "LaneNoteStream.h"
+#include "NoteJudgement.h"
+#include "NoteKinematics.h"
+
+// Counts of everything that was judged on the lane since it was reset
+struct FLaneSimulationStats
+{
+	int32	Perfect = 0;
+	int32	Great = 0;
+	int32	Good = 0;
+	int32	Miss = 0;
+	// Presses that weren't close enough to any note
+	int32	CompleteMisses = 0;
+	// Presses that went to a bomb
+	int32	Bombs = 0;
+	int32	SpawnedNotes = 0;
+	// Sum of the offsets of every press that hit a note, to work out the mean offset
+	double	OffsetSum = 0.0;
+};
+
+// A press or release scripted for a run of the lane without a player, see FLaneSimulation::ScriptInputs
+struct FScriptedInput
+{
+	// Seconds since the start of the level
+	float	Time = 0.0f;
+	bool	bPressed = false;
+};
+
+// How the presses and releases of FLaneSimulation::ScriptInputs are made up
+struct FScriptedInputParams
+{
+	// How far (s) either side of a note's time, or the end of a hold note, a press or release can be
+	float	Accuracy = 0.05f;
+	// Fraction (0 - 1) of the notes that aren't pressed at all
+	float	MissRate = 0.05f;
+	// Fraction (0 - 1) of the pressed notes that are followed by a press at nothing
+	float	StrayPressRate = 0.0f;
+};
+
+class FLaneSimulation
+{
+public:
+
+	/* Sets the path the notes travel along and where on it the button is
+	* @param NewPath			- Path of the lane, has to outlive the simulation
+	* @param NewBoundaryStart	- % along the path where the button starts
+	* @param NewBoundaryEnd		- % along the path where the button ends
+	*/
+	void		SetPath(const ILanePath* NewPath, float NewBoundaryStart, float NewBoundaryEnd);
+
+	/* Gives the lane its notes. The stream is kept as loaded so ResolveSpecialNotes can be run again for every run
+	*/
+	void		LoadNotes(TSharedPtr<const FLaneNoteStream> NewNoteStream);
+
+	/* Swaps single notes for special notes for this run, see FLaneNoteStream::ResolveSpecialNotes
+	*/
+	void		ResolveSpecialNotes(const FSpecialNoteOdds& Odds, int32 Seed);
+
+	/* Changes the speed of the notes from the input time on, and how long before its time a note has to spawn to reach the button on time.
+	* Notes on the lane that haven't finished with the button are moved so they still reach it at their time, and hold notes are stretched
+	* to their length at the new speed
+	* @param Time		- Seconds since the start of the level
+	* @param NewSpeed	- Units per second
+	* @param GameSpeed	- Multiplier of the game speed
+	*/
+	void		SetMoveSpeed(float Time, float NewSpeed, float GameSpeed = 1.0f);
+
+	/* Starts the lane again from the start of the level at the input speed, keeping the spawn time offset
+	*/
+	void		Reset(float NewSpeed);
+
+	/* Returns how far (in units) a note moving from the start of the song would have travelled along the path by the input time
+	*/
+	inline float GetTravelledDistance(float Time) const		{ return TravelEpochDistance + (Time - TravelEpochTime) * MoveSpeed; }
+
+	/* Puts every note that is due to spawn by the input time on the lane, at where it would be had it spawned on time, and calls
+	* OnSpawn(int32 Slot, const FLaneNote&, float SpawnDelay) for each of them in order
+	* @param Time - Seconds since the start of the level
+	*/
+	template<typename FuncType>
+	void		SpawnDueNotes(float Time, FuncType OnSpawn)
+	{
+		if (!NoteStream.IsValid())
+			return;
+
+		const FLaneNoteStream& Stream = *NoteStream;
+		for (; NoteIndex < Stream.Num(); NoteIndex++)
+		{
+			const FLaneNote LaneNote = Stream.GetNote(NoteIndex);
+			if (LaneNote.Time - SpawnTimeOffset > Time)
+				break;
+			if (LaneNote.Type == ENoteType::EMPTY)
+				continue;
+
+			Stats.SpawnedNotes++;
+
+			// How late the note is compared to when it should have spawned
+			const float SpawnDelay = Time - (LaneNote.Time - SpawnTimeOffset);
+			OnSpawn(AddNote(NoteIndex, LaneNote, Time, SpawnDelay), LaneNote, SpawnDelay);
+		}
+	}
+
+	/* Jumps the lane to any point of the song. Puts every note that would be on the lane at that time back on it and calls
+	* OnNoteOnLane(int32 Slot, const FLaneNote&, float TimeSinceSpawn) for each of them. Notes that should have been hit before that time
+	* are only there to be seen, they can't be hit or missed, except for a hold note that is in the middle of being held while the button
+	* is down. The note stream is binary searched, so this only costs as much as the notes it brings back
+	* @param Time			- Seconds since the start of the level to jump to
+	* @param bButtonDown	- Whether the button is held at the seek time
+	*/
+	template<typename FuncType>
+	void		Seek(float Time, FuncType OnNoteOnLane, bool bButtonDown = false)
+	{
+		BeginSeek(Time, bButtonDown);
+		if (!NoteStream.IsValid() || MoveSpeed <= 0.0f)
+			return;
+
+		const FLaneNoteStream& Stream = *NoteStream;
+
+		// How long it takes a note to travel the whole path
+		const float PathTime = GetPathLength() / MoveSpeed;
+
+		// No note that reaches the button before this can still be on the lane, so start from the first one after it
+		NoteIndex = Stream.LowerBound(Time + SpawnTimeOffset - PathTime - Stream.MaxHoldDuration);
+
+		// Bring back every note that would be on the lane at the seek time
+		for (; NoteIndex < Stream.Num(); NoteIndex++)
+		{
+			const FLaneNote LaneNote = Stream.GetNote(NoteIndex);
+			const float SpawnTime = LaneNote.Time - SpawnTimeOffset;
+			if (SpawnTime > Time)
+				break;
+
+			if (SpawnTime + PathTime + LaneNote.HoldDuration <= Time || LaneNote.Type == ENoteType::EMPTY)
+				continue;
+
+			const int32 Slot = AddNote(NoteIndex, LaneNote, Time, Time - SpawnTime);
+			if (LaneNote.Time < Time && NoteIndex != Judge.GetHeldNote())
+				Notes.SetDone(Slot);
+
+			OnNoteOnLane(Slot, LaneNote, Time - SpawnTime);
+		}
+	}
+
+	/* Moves every note on the lane to where it is at the input time and works out where each of them is relative to the button. The head
+	* of a hold note that is being held stays at the button while the rest of the note goes into it. A note that has gone past the button
+	* can't be hit any more. Doesn't take any note off the lane (see RemoveFinishedNotes), and touches nothing but the lane itself so
+	* lanes can be updated on worker threads. What changed is left in the per-slot masks below
+	* @param Time		- Seconds since the start of the level
+	* @param DeltaTime	- Seconds since the last update. Only used when the notes aren't time driven
+	*/
+	void		UpdateNotes(float Time, float DeltaTime);
+
+	/* Takes the notes that reached the end of the path off the lane, calling OnRemove(int32 Slot) for each of them before it goes
+	*/
+	template<typename FuncType>
+	void		RemoveFinishedNotes(FuncType OnRemove)
+	{
+		NoteKinematics::ForEachSetBitFrom(FinishedNotesMask.GetData(), FinishedNotesMask.Num(), Notes.GetSlot(0), [this, &OnRemove](int32 Slot)
+		{
+			if (!Notes.IsLive(Slot))
+				return;
+
+			OnRemove(Slot);
+			Notes.RemoveSlot(Slot);
+		});
+	}
+
+	/* Takes a note off the lane, e.g. when its actor was deactivated from outside of the lane
+	*/
+	inline void	RemoveNote(int32 Slot)								{ Notes.RemoveSlot(Slot); }
+
+	/* Frees up the empty slots at the front of the note queue. Call once per frame, after every note that is done with was removed
+	*/
+	inline void	RetireNotes()										{ Notes.RetireFront(); }
+
+	/* Sets what the owner of the note in the input slot keeps it by, given back in FJudgedNote::Handle
+	*/
+	inline void	SetNoteHandle(int32 Slot, int32 Handle)				{ Notes.SetHandle(Slot, Handle); }
+
+	/* Sets the number of notes that can be on the lane at once before the note queue has to grow
+	*/
+	inline void	ReserveNotes(int32 Capacity)						{ Notes.Reserve(Capacity); }
+
+	/* Returns the slot of the first note on the lane within the button that can still be hit, INDEX_NONE if there isn't one
+	*/
+	int32		FindNoteWithinBounds() const;
+
+	/* Judges a press against the times of the notes
+	* @param Time		- When the button was pressed, in seconds since the start of the level
+	* @param OutJudged	- Every note that was judged, see FLaneJudge::Judge
+	* @return			- The judgement, BOMB if a bomb was pressed, NONE if no note was close enough
+	*/
+	EJudgement	Press(float Time, TArray<FJudgedNote>& OutJudged);
+
+	/* Judges letting go of the button against the end of the hold note being held, if any
+	* @param Time		- When the button was let go, in seconds since the start of the level
+	* @param OutJudged	- The hold note, if one was being held
+	* @return			- The judgement, NONE if no hold note was being held
+	*/
+	EJudgement	Release(float Time, TArray<FJudgedNote>& OutJudged);
+
+	/* Judges every note whose window is over by the input time without a press as missed, and finishes a hold note held to its end
+	* @param OutJudged - Every note that was judged
+	*/
+	void		ExpireMisses(float Time, TArray<FJudgedNote>& OutJudged);
+
+	/* Moves the lane to the input time on its own, the same way ULane does every frame: spawns the notes that are due, updates every note,
+	* misses every note whose window is over and takes the notes that reached the end of the path off the lane. Used when the lane runs
+	* without note actors
+	* @param Time		- Seconds since the start of the level
+	* @param DeltaTime	- Seconds since the last step
+	*/
+	void		Step(float Time, float DeltaTime);
+
+	/* Makes up a player for the input notes: a press for most of them, the release at the end of hold notes (or right after the press
+	* for every other note) and the odd press at nothing
+	* @param Stream	- The notes to play, bombs included
+	* @param Params	- How accurate the player is
+	* @param Seed	- The same seed always gives the same inputs
+	* @return		- The inputs, in time order
+	*/
+	static TArray<FScriptedInput> ScriptInputs(const FLaneNoteStream& Stream, const FScriptedInputParams& Params, int32 Seed);
+
+	/* Steps the lane from the start of the level to the input time at a fixed frame rate, judging every scripted input at its own time
+	* rather than the frame's, the same as timestamped touches in the game
+	* @param Inputs		- Presses and releases in time order, see ScriptInputs
+	* @param EndTime	- Seconds since the start of the level to step to
+	* @param DeltaTime	- Seconds per frame
+	*/
+	void		Play(const TArray<FScriptedInput>& Inputs, float EndTime, float DeltaTime);
+
+	/* Returns a hash of the state of the lane, equal for two lanes that were given the same notes and input
+	*/
+	uint32		GetStateHash() const;
+
+	// How close to a note's time a press has to be to count
+	FJudgementWindows	JudgementWindows;
+
+	// When true every note's position is worked out from the song time instead of being moved forward by DeltaTime each update
+	bool				bTimeDrivenNotes = true;
+
+	inline float								GetMoveSpeed() const		{ return MoveSpeed; }
+	inline float								GetSpawnTimeOffset() const	{ return SpawnTimeOffset; }
+	inline float								GetPathLength() const		{ return Path ? Path->GetLength() : 0.0f; }
+	inline float								GetButtonPercentage() const	{ return (BoundaryEnd - BoundaryStart) / 2 + BoundaryStart; }
+	inline TSharedPtr<const FLaneNoteStream>	GetNoteStream() const		{ return NoteStream; }
+	// The notes as they were loaded, without the special notes of this run
+	inline TSharedPtr<const FLaneNoteStream>	GetLoadedNoteStream() const	{ return LoadedNoteStream; }
+	inline const FLaneSimulationStats&			GetStats() const			{ return Stats; }
+	// The notes on the lane, oldest first
+	inline const FLaneNoteQueue&				GetNotes() const			{ return Notes; }
+	// Per-slot results of the last UpdateNotes: notes whose location changed, that moved, that just went past the button and that reached the end of the path
+	// Number of words of the masks below, 0 until UpdateNotes runs after a reset or seek
+	inline int32								GetUpdateMaskWordsNum() const	{ return ChangedNotesMask.Num(); }
+	inline const uint64*						GetChangedNotesMask() const		{ return ChangedNotesMask.GetData(); }
+	inline const uint64*						GetMovingNotesMask() const		{ return MovingNotesMask.GetData(); }
+	inline const uint64*						GetPastButtonNotesMask() const	{ return PastButtonNotesMask.GetData(); }
+	inline const uint64*						GetFinishedNotesMask() const	{ return FinishedNotesMask.GetData(); }
+	// How far the note in the input slot moved in the last UpdateNotes, as % of the path
+	inline float								GetNoteAdvance(int32 Slot) const	{ return NoteAdvances[Slot]; }
+	inline bool									IsButtonPressed() const		{ return bButtonPressed; }
+	// Index in the note stream of the hold note being held, INDEX_NONE if there isn't one
+	inline int32								GetHeldNote() const			{ return Judge.GetHeldNote(); }
+
+private:
+
+	/* Clears the lane and the judge for a jump to the input time
+	*/
+	void		BeginSeek(float Time, bool bButtonDown);
+
+	/* Forgets the results of the last UpdateNotes, so nothing acts on them until the next one
+	*/
+	void		ClearUpdateMasks();
+
+	/* Puts a note of the stream on the lane where it is at the input time
+	* @param NoteIdx	- Index of the note in the note stream
+	* @param LaneNote	- The note
+	* @param Time		- Seconds since the start of the level
+	* @param SpawnDelay	- How long ago the note spawned
+	* @return			- The slot of the note
+	*/
+	int32		AddNote(int32 NoteIdx, const FLaneNote& LaneNote, float Time, float SpawnDelay);
+
+	/* Acts on the judged notes from the input index on: adds them to the stats, takes the notes that were hit off the lane and marks the
+	* notes that were missed as done with. Fills in the handle of every judged note that was on the lane
+	*/
+	void		TakeJudgements(TArray<FJudgedNote>& Judged, int32 FirstIdx);
+
+	const ILanePath*					Path = nullptr;
+	float								BoundaryStart = 0.0f;
+	float								BoundaryEnd = 0.0f;
+
+	// The notes of the lane as loaded and with the special notes of this run swapped in
+	TSharedPtr<const FLaneNoteStream>	LoadedNoteStream;
+	TSharedPtr<const FLaneNoteStream>	NoteStream;
+	// Index of the next note in the NoteStream to spawn
+	int32								NoteIndex = 0;
+	FLaneJudge							Judge;
+
+	float								MoveSpeed = 0.0f;
+	float								SpawnTimeOffset = 0.0f;
+	// The time of the last move speed change and the distance travelled by then
+	float								TravelEpochTime = 0.0f;
+	float								TravelEpochDistance = 0.0f;
+
+	// Notes on the lane and the state of the button
+	FLaneNoteQueue						Notes;
+	bool								bButtonPressed = false;
+
+	// Per-slot results of the last UpdateNotes, kept around so they aren't reallocated every update
+	TArray<uint64>						ChangedNotesMask;
+	TArray<uint64>						MovingNotesMask;
+	TArray<uint64>						PastButtonNotesMask;
+	TArray<uint64>						FinishedNotesMask;
+	TArray<float>						NoteAdvances;
+
+	// Notes judged by the last Step, kept so the array isn't reallocated every step
+	TArray<FJudgedNote>					StepJudged;
+
+	FLaneSimulationStats				Stats;
+};
@@ -0,0 +1,152 @@
+/*  Copyright (C) 2020-2021 Ilya Tsykunov (ilya@ilyatsykunov.com)
+*/
+
+#include "LaneSimulationCommandlet.h"
+
+#include "BinaryChart.h"
+#include "LaneNoteStream.h"
+#include "LanePath.h"
+#include "LaneSimulation.h"
+
+ULaneSimulationCommandlet::ULaneSimulationCommandlet()
+{
+	IsClient = false;
+	IsEditor = false;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 ULaneSimulationCommandlet::Main(const FString& Params)
+{
+	FString ChartFilename;
+	int32 LanesNum = 3;
+	FSyntheticChartParams ChartParams;
+	int32 Seed = 1;
+	int32 FramesPerSecond = 60;
+	float MoveSpeed = 1000.0f;
+	float PathLength = 3000.0f;
+	FScriptedInputParams InputParams;
+	FSpecialNoteOdds Odds;
+	int32 RepeatNum = 1;
+
+	FParse::Value(*Params, TEXT("chart="), ChartFilename);
+	FParse::Value(*Params, TEXT("lanes="), LanesNum);
+	FParse::Value(*Params, TEXT("notes="), ChartParams.NotesNum);
+	FParse::Value(*Params, TEXT("nps="), ChartParams.NotesPerSecond);
+	FParse::Value(*Params, TEXT("holdratio="), ChartParams.HoldRatio);
+	FParse::Value(*Params, TEXT("holdlength="), ChartParams.HoldLength);
+	FParse::Value(*Params, TEXT("seed="), Seed);
+	FParse::Value(*Params, TEXT("fps="), FramesPerSecond);
+	FParse::Value(*Params, TEXT("speed="), MoveSpeed);
+	FParse::Value(*Params, TEXT("length="), PathLength);
+	FParse::Value(*Params, TEXT("accuracy="), InputParams.Accuracy);
+	FParse::Value(*Params, TEXT("missrate="), InputParams.MissRate);
+	FParse::Value(*Params, TEXT("strayrate="), InputParams.StrayPressRate);
+	FParse::Value(*Params, TEXT("bombfreq="), Odds.BombFreq);
+	FParse::Value(*Params, TEXT("repeat="), RepeatNum);
+
+	if (FramesPerSecond <= 0 || MoveSpeed <= 0.0f || PathLength <= 0.0f)
+	{
+		UE_LOG(LogTemp, Error, TEXT("LaneSimulation: -fps, -speed and -length have to be above 0"));
+		return 1;
+	}
+
+	// The notes of every lane, from the chart or made up from the seed
+	TArray<TSharedRef<const FLaneNoteStream>> LaneStreams;
+	if (!ChartFilename.IsEmpty())
+	{
+		TSharedPtr<const FBinaryChart> Chart = FBinaryChart::Open(ChartFilename);
+		if (!Chart.IsValid())
+		{
+			UE_LOG(LogTemp, Error, TEXT("LaneSimulation: couldn't open binary chart %s"), *ChartFilename);
+			return 1;
+		}
+
+		for (int32 i = 0; i < Chart->GetLanesNum(); i++)
+			LaneStreams.Add(FLaneNoteStream::FromBinaryChart(Chart.ToSharedRef(), i));
+	}
+	else
+	{
+		for (int32 i = 0; i < LanesNum; i++)
+			LaneStreams.Add(FLaneNoteStream::Generate(ChartParams, HashCombine(GetTypeHash(Seed), GetTypeHash(i))));
+	}
+	LanesNum = LaneStreams.Num();
+
+	// The button sits in the middle of the path, the same as on a lane whose boundaries are at 45% and 55%
+	const FStraightLanePath Path(FVector::ZeroVector, FVector(PathLength, 0.0f, 0.0f));
+	TArray<FLaneSimulation> Lanes;
+	Lanes.SetNum(LanesNum);
+
+	// Script a press for every note, off by up to Accuracy seconds, and the release at the end of hold notes. Some notes aren't pressed at all
+	TArray<TArray<FScriptedInput>> LaneInputs;
+	LaneInputs.SetNum(LanesNum);
+
+	float EndTime = 0.0f;
+	for (int32 LaneIdx = 0; LaneIdx < LanesNum; LaneIdx++)
+	{
+		FLaneSimulation& Lane = Lanes[LaneIdx];
+		Lane.SetPath(&Path, 0.45f, 0.55f);
+		Lane.LoadNotes(LaneStreams[LaneIdx]);
+
+		// Bombs are swapped in once, like at the start of a run of the level, and are pressed like every other note
+		Lane.ResolveSpecialNotes(Odds, HashCombine(GetTypeHash(Seed), GetTypeHash(LaneIdx)));
+
+		const FLaneNoteStream& Stream = *Lane.GetNoteStream();
+		if (Stream.Num() > 0)
+		{
+			const FLaneNote LastNote = Stream.GetNote(Stream.Num() - 1);
+			EndTime = FMath::Max(EndTime, LastNote.Time + LastNote.HoldDuration);
+		}
+
+		LaneInputs[LaneIdx] = FLaneSimulation::ScriptInputs(Stream, InputParams, HashCombine(GetTypeHash(Seed), GetTypeHash(LanesNum + LaneIdx)));
+	}
+
+	// Run until the last note has gone past the end of the path
+	EndTime += PathLength / MoveSpeed + 1.0f;
+	const float DeltaTime = 1.0f / FramesPerSecond;
+	const int32 FramesNum = FMath::CeilToInt(EndTime / DeltaTime);
+
+	uint32 StateHash = 0;
+	double BestSeconds = TNumericLimits<double>::Max();
+	for (int32 Run = 0; Run < FMath::Max(RepeatNum, 1); Run++)
+	{
+		StateHash = 0;
+
+		// The lanes don't depend on each other, so each one is played through on its own
+		const double StartSeconds = FPlatformTime::Seconds();
+		for (int32 LaneIdx = 0; LaneIdx < LanesNum; LaneIdx++)
+		{
+			FLaneSimulation& Lane = Lanes[LaneIdx];
+			Lane.SetMoveSpeed(0.0f, MoveSpeed);
+			Lane.Reset(MoveSpeed);
+			Lane.Play(LaneInputs[LaneIdx], EndTime, DeltaTime);
+		}
+		BestSeconds = FMath::Min(BestSeconds, FPlatformTime::Seconds() - StartSeconds);
+
+		for (const FLaneSimulation& Lane : Lanes)
+			StateHash = HashCombine(StateHash, Lane.GetStateHash());
+	}
+
+	FLaneSimulationStats Total;
+	for (const FLaneSimulation& Lane : Lanes)
+	{
+		const FLaneSimulationStats& Stats = Lane.GetStats();
+		Total.Perfect += Stats.Perfect;
+		Total.Great += Stats.Great;
+		Total.Good += Stats.Good;
+		Total.Miss += Stats.Miss;
+		Total.CompleteMisses += Stats.CompleteMisses;
+		Total.Bombs += Stats.Bombs;
+		Total.SpawnedNotes += Stats.SpawnedNotes;
+		Total.OffsetSum += Stats.OffsetSum;
+	}
+	const int32 JudgedNum = Total.Perfect + Total.Great + Total.Good;
+
+	UE_LOG(LogTemp, Display, TEXT("LaneSimulation: %d lanes, %d notes, %d frames at %d fps (%.1f s of song)"), LanesNum, Total.SpawnedNotes, FramesNum, FramesPerSecond, EndTime);
+	UE_LOG(LogTemp, Display, TEXT("LaneSimulation: %.3f ms, %.0f frames per second"), BestSeconds * 1000.0, BestSeconds > 0.0 ? FramesNum / BestSeconds : 0.0);
+	UE_LOG(LogTemp, Display, TEXT("LaneSimulation: perfect %d, great %d, good %d, miss %d, complete misses %d, bombs %d, mean offset %.4f s"),
+		Total.Perfect, Total.Great, Total.Good, Total.Miss, Total.CompleteMisses, Total.Bombs, JudgedNum > 0 ? Total.OffsetSum / JudgedNum : 0.0);
+	UE_LOG(LogTemp, Display, TEXT("LaneSimulation: state hash %08x"), StateHash);
+
+	return 0;
+}
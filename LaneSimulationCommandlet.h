@@ -0,0 +1,33 @@
+/*  Runs the lanes of a chart without a world, note actors or rendering: every lane is an FLaneSimulation on a straight path, stepped at a
+	fixed frame rate with presses and releases scripted from a seed. Prints how many frames it got through per second, the judgements and a
+	hash of the end state, so two runs with the same arguments can be compared.
+
+		UE4Editor-Cmd RhythmGame -run=LaneSimulation [-chart=Song.rchart] [-lanes=3] [-notes=2000] [-nps=3] [-holdratio=0.2] [-holdlength=0.9]
+			[-seed=1] [-fps=60] [-speed=1000] [-length=3000] [-accuracy=0.05] [-missrate=0.05] [-strayrate=0] [-bombfreq=0] [-repeat=1]
+
+	Without -chart a chart of -notes notes per lane is generated from the seed, see FLaneNoteStream::Generate. With -bombfreq single notes
+	are swapped for bombs from the seed the same way a level does (see FLaneNoteStream::ResolveSpecialNotes). The inputs are made up by
+	FLaneSimulation::ScriptInputs.
+
+	Copyright (C) 2020-2021 Ilya Tsykunov (ilya@ilyatsykunov.com)
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+
+// Keep this last
+#include "LaneSimulationCommandlet.generated.h"
+
+UCLASS()
+class RHYTHMGAME_API ULaneSimulationCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+
+	ULaneSimulationCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
@@ -0,0 +1,73 @@
+/*  Copyright (C) 2020-2021 Ilya Tsykunov (ilya@ilyatsykunov.com)
+*/
+
+#include "MaterialParameterCache.h"
+
+#include "Materials/MaterialInstanceDynamic.h"
+#include "Materials/MaterialParameterCollectionInstance.h"
+
+bool FMaterialParameterCache::SetScalar(UMaterialInstanceDynamic* Material, FName Name, float Value)
+{
+	if (!Material)
+		return false;
+
+	float& Cached = Scalars.FindOrAdd(FParameterKey(Material, Name), TNumericLimits<float>::Max());
+	if (Cached == Value)
+	{
+		FrameStats.SkippedWrites++;
+		return false;
+	}
+
+	Cached = Value;
+	Material->SetScalarParameterValue(Name, Value);
+	FrameStats.Writes++;
+	return true;
+}
+
+bool FMaterialParameterCache::SetVector(UMaterialInstanceDynamic* Material, FName Name, const FLinearColor& Value)
+{
+	if (!Material)
+		return false;
+
+	FLinearColor* Cached = Vectors.Find(FParameterKey(Material, Name));
+	if (Cached && *Cached == Value)
+	{
+		FrameStats.SkippedWrites++;
+		return false;
+	}
+
+	Vectors.Add(FParameterKey(Material, Name), Value);
+	Material->SetVectorParameterValue(Name, Value);
+	FrameStats.Writes++;
+	return true;
+}
+
+bool FMaterialParameterCache::SetCollectionScalar(UMaterialParameterCollectionInstance* Collection, FName Name, float Value)
+{
+	if (!Collection)
+		return false;
+
+	float& Cached = Scalars.FindOrAdd(FParameterKey(Collection, Name), TNumericLimits<float>::Max());
+	if (Cached == Value)
+	{
+		FrameStats.SkippedWrites++;
+		return false;
+	}
+
+	Cached = Value;
+	Collection->SetScalarParameterValue(Name, Value);
+	FrameStats.CollectionWrites++;
+	return true;
+}
+
+void FMaterialParameterCache::Empty()
+{
+	Scalars.Empty();
+	Vectors.Empty();
+}
+
+void FMaterialParameterCache::BeginFrame()
+{
+	LastFrameStats = FrameStats;
+	FrameStats = FMaterialParameterWriteStats();
+}
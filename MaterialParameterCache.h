@@ -0,0 +1,66 @@
+/*  Remembers the last value written to every parameter of every dynamic material instance and material parameter collection,
+	and skips writes that wouldn't change anything. Each write that does go through has to update the material's render proxy,
+	so most of the per-frame material writes (ring animation, post processing) don't need to happen at all.
+
+	Counts the writes made and skipped every frame so the savings can be checked.
+
+	Copyright (C) 2020-2021 Ilya Tsykunov (ilya@ilyatsykunov.com)
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/ObjectKey.h"
+
+class UMaterialInstanceDynamic;
+class UMaterialParameterCollectionInstance;
+
+struct FMaterialParameterWriteStats
+{
+	// Writes that went through to a material instance
+	int32	Writes = 0;
+	// Writes that went through to a material parameter collection
+	int32	CollectionWrites = 0;
+	// Writes that were skipped because the value was already set
+	int32	SkippedWrites = 0;
+};
+
+struct FMaterialParameterCache
+{
+	/* Sets a scalar parameter of a material instance if it isn't already set to the input value
+	* @return - Whether the value was written
+	*/
+	bool		SetScalar(UMaterialInstanceDynamic* Material, FName Name, float Value);
+
+	/* Sets a vector parameter of a material instance if it isn't already set to the input value
+	* @return - Whether the value was written
+	*/
+	bool		SetVector(UMaterialInstanceDynamic* Material, FName Name, const FLinearColor& Value);
+
+	/* Sets a scalar parameter of a material parameter collection if it isn't already set to the input value
+	* @return - Whether the value was written
+	*/
+	bool		SetCollectionScalar(UMaterialParameterCollectionInstance* Collection, FName Name, float Value);
+
+	/* Forgets every cached value, e.g. when the materials are recreated
+	*/
+	void		Empty();
+
+	/* Starts counting the writes of a new frame
+	*/
+	void		BeginFrame();
+
+	// Writes made during the last full frame
+	inline const FMaterialParameterWriteStats&	GetLastFrameStats() const	{ return LastFrameStats; }
+
+private:
+
+	typedef TPair<FObjectKey, FName> FParameterKey;
+
+	// FObjectKey rather than the pointer, so a new material allocated where an old one was doesn't pick up its values
+	TMap<FParameterKey, float>			Scalars;
+	TMap<FParameterKey, FLinearColor>	Vectors;
+
+	FMaterialParameterWriteStats		FrameStats;
+	FMaterialParameterWriteStats		LastFrameStats;
+};
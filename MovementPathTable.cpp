@@ -0,0 +1,101 @@
+/*  Copyright (C) 2020-2021 Ilya Tsykunov (ilya@ilyatsykunov.com)
+*/
+
+#include "MovementPathTable.h"
+
+#include "Components/SplineComponent.h"
+
+void FMovementPathTable::Build(const USplineComponent* Spline, float SampleSpacing)
+{
+	Empty();
+
+	if (!Spline || SampleSpacing <= 0.0f)
+		return;
+
+	Length = Spline->GetSplineLength();
+	SplineVersion = Spline->SplineCurves.Version;
+
+	// Always keep at least the first and the last point of the path
+	const int32 SamplesNum = FMath::Max(2, FMath::CeilToInt(Length / SampleSpacing) + 1);
+
+	Locations.SetNumUninitialized(SamplesNum);
+	Tangents.SetNumUninitialized(SamplesNum);
+	Rotations.SetNumUninitialized(SamplesNum);
+
+	for (int32 i = 0; i < SamplesNum; i++)
+	{
+		const float Distance = Length * i / (SamplesNum - 1);
+		Locations[i] = Spline->GetLocationAtDistanceAlongSpline(Distance, ESplineCoordinateSpace::Local);
+		Tangents[i] = Spline->GetTangentAtDistanceAlongSpline(Distance, ESplineCoordinateSpace::Local);
+		Rotations[i] = Spline->GetQuaternionAtDistanceAlongSpline(Distance, ESplineCoordinateSpace::Local);
+	}
+
+	// The curvature between two samples is how much the direction turns over the distance between them
+	const float SampleDistance = Length / (SamplesNum - 1);
+	for (int32 i = 0; i < SamplesNum - 1 && SampleDistance > KINDA_SMALL_NUMBER; i++)
+	{
+		const float CosAngle = FVector::DotProduct(Tangents[i].GetSafeNormal(), Tangents[i + 1].GetSafeNormal());
+		MaxCurvature = FMath::Max(MaxCurvature, FMath::Acos(FMath::Clamp(CosAngle, -1.0f, 1.0f)) / SampleDistance);
+	}
+}
+
+void FMovementPathTable::Empty()
+{
+	Locations.Empty();
+	Tangents.Empty();
+	Rotations.Empty();
+	Length = 0.0f;
+	MaxCurvature = 0.0f;
+	SplineVersion = 0;
+}
+
+bool FMovementPathTable::IsOutOfDate(const USplineComponent* Spline) const
+{
+	return Spline && (!IsBuilt() || Spline->SplineCurves.Version != SplineVersion);
+}
+
+FVector FMovementPathTable::GetLocation(float Percentage) const
+{
+	int32 Idx;
+	float Alpha;
+	FindSegment(Percentage, Idx, Alpha);
+	return FMath::Lerp(Locations[Idx], Locations[Idx + 1], Alpha);
+}
+
+FVector FMovementPathTable::GetTangent(float Percentage) const
+{
+	int32 Idx;
+	float Alpha;
+	FindSegment(Percentage, Idx, Alpha);
+	return FMath::Lerp(Tangents[Idx], Tangents[Idx + 1], Alpha);
+}
+
+FQuat FMovementPathTable::GetRotation(float Percentage) const
+{
+	int32 Idx;
+	float Alpha;
+	FindSegment(Percentage, Idx, Alpha);
+	return FQuat::FastLerp(Rotations[Idx], Rotations[Idx + 1], Alpha).GetNormalized();
+}
+
+void FMovementPathTable::Sample(float Percentage, FVector& OutLocation, FVector& OutTangent, FQuat& OutRotation) const
+{
+	int32 Idx;
+	float Alpha;
+	FindSegment(Percentage, Idx, Alpha);
+
+	OutLocation = FMath::Lerp(Locations[Idx], Locations[Idx + 1], Alpha);
+	OutTangent = FMath::Lerp(Tangents[Idx], Tangents[Idx + 1], Alpha);
+	OutRotation = FQuat::FastLerp(Rotations[Idx], Rotations[Idx + 1], Alpha).GetNormalized();
+}
+
+void FMovementPathTable::FindSegment(float Percentage, int32& OutIdx, float& OutAlpha) const
+{
+	check(IsBuilt());
+
+	const int32 LastSegment = Locations.Num() - 2;
+	const float Position = FMath::Clamp(Percentage, 0.0f, 1.0f) * (Locations.Num() - 1);
+
+	OutIdx = FMath::Min(FMath::FloorToInt(Position), LastSegment);
+	OutAlpha = Position - OutIdx;
+}
@@ -0,0 +1,57 @@
+/*  A baked copy of a lane's movement path. The spline is sampled once at uniform distances and every location, tangent and
+	rotation query after that is answered by interpolating between the two closest samples instead of evaluating the spline.
+
+	Copyright (C) 2020-2021 Ilya Tsykunov (ilya@ilyatsykunov.com)
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "LanePath.h"
+
+class USplineComponent;
+
+struct FMovementPathTable : public ILanePath
+{
+	/* Samples the spline at uniform distances along it. Samples are kept in the local space of the spline so the table stays valid when the lane moves
+	* @param Spline			- The movement path to sample
+	* @param SampleSpacing	- Distance between two neighbouring samples along the spline
+	*/
+	void Build(const USplineComponent* Spline, float SampleSpacing);
+
+	void Empty();
+
+	/* Returns the local location / tangent / rotation at the input % along the path. Percentages outside 0-1 are clamped, same as the spline does
+	*/
+	virtual FVector GetLocation(float Percentage) const override;
+	FVector GetTangent(float Percentage) const;
+	FQuat	GetRotation(float Percentage) const;
+
+	/* Returns the local location, tangent and rotation at the input % along the path with a single lookup
+	*/
+	void	Sample(float Percentage, FVector& OutLocation, FVector& OutTangent, FQuat& OutRotation) const;
+
+	inline bool		IsBuilt() const			{ return Locations.Num() > 1; }
+	virtual float	GetLength() const override	{ return Length; }
+	// Returns the curvature (1 / radius) of the tightest bend of the path, 0 if the path is straight
+	inline float	GetMaxCurvature() const	{ return MaxCurvature; }
+	inline int32	GetNumSamples() const	{ return Locations.Num(); }
+
+	/* Returns true when the spline was changed after the table was built from it and the table has to be built again
+	* @param Spline - The movement path the table was built from
+	*/
+	bool IsOutOfDate(const USplineComponent* Spline) const;
+
+private:
+
+	// Finds the sample right before the input % and how far (0-1) we are between it and the next sample
+	void FindSegment(float Percentage, int32& OutIdx, float& OutAlpha) const;
+
+	TArray<FVector>	Locations;
+	TArray<FVector>	Tangents;
+	TArray<FQuat>	Rotations;
+	float			Length = 0.0f;
+	float			MaxCurvature = 0.0f;
+	// Version of the spline curves at the time the table was built, the spline bumps it every time its points change
+	uint32			SplineVersion = 0;
+};
@@ -0,0 +1,138 @@
+/*  Copyright (C) 2020-2021 Ilya Tsykunov (ilya@ilyatsykunov.com)
+*/
+
+#include "NoteJudgement.h"
+
+EJudgement FJudgementWindows::Classify(float Offset) const
+{
+	const float AbsOffset = FMath::Abs(Offset);
+
+	if (AbsOffset <= Perfect)
+		return EJudgement::PERFECT;
+	if (AbsOffset <= Great)
+		return EJudgement::GREAT;
+	if (AbsOffset <= Good)
+		return EJudgement::GOOD;
+	return EJudgement::NONE;
+}
+
+void FLaneJudge::Reset(TSharedPtr<const FLaneNoteStream> NewNoteStream, float Time, bool bButtonDown)
+{
+	NoteStream = NewNoteStream;
+	Cursor = NoteStream.IsValid() ? NoteStream->LowerBound(Time) : 0;
+	HeldNote = INDEX_NONE;
+
+	// Notes don't overlap a hold note, so only the note right before the cursor can be in the middle of being held
+	if (bButtonDown && Cursor > 0)
+	{
+		const FLaneNote Note = NoteStream->GetNote(Cursor - 1);
+		if (Note.Type == ENoteType::HOLD && Note.Time + Note.HoldDuration > Time)
+			HeldNote = Cursor - 1;
+	}
+}
+
+EJudgement FLaneJudge::Judge(float InputTime, const FJudgementWindows& Windows, TArray<FJudgedNote>& OutJudged)
+{
+	ExpireMisses(InputTime, Windows, OutJudged);
+	HeldNote = INDEX_NONE;
+
+	if (!NoteStream.IsValid())
+		return EJudgement::NONE;
+
+	const FLaneNoteStream& Stream = *NoteStream;
+
+	// Find the next note that has to be pressed, keeping the bomb in front of it closest to the press
+	FLaneNote Note;
+	int32 NoteIdx = Cursor;
+	int32 BombIdx = INDEX_NONE;
+	float BombOffset = 0.0f;
+	for (; NoteIdx < Stream.Num(); NoteIdx++)
+	{
+		Note = Stream.GetNote(NoteIdx);
+		if (IsJudged(Note.Type))
+			break;
+		if (Note.Type != ENoteType::BOMB)
+			continue;
+
+		const float Offset = InputTime - Note.Time;
+		if (BombIdx == INDEX_NONE || FMath::Abs(Offset) < FMath::Abs(BombOffset))
+		{
+			BombIdx = NoteIdx;
+			BombOffset = Offset;
+		}
+	}
+
+	// A bomb is only pressed if the note after it isn't closer, so a bomb right before a note doesn't take a press meant for the note
+	const bool bHasNote = NoteIdx < Stream.Num();
+	const float Offset = bHasNote ? InputTime - Note.Time : 0.0f;
+	if (BombIdx != INDEX_NONE && Windows.Classify(BombOffset) != EJudgement::NONE && (!bHasNote || FMath::Abs(BombOffset) < FMath::Abs(Offset)))
+	{
+		OutJudged.Add({ BombIdx, EJudgement::BOMB, BombOffset, false });
+		Cursor = BombIdx + 1;
+		return EJudgement::BOMB;
+	}
+
+	if (!bHasNote)
+		return EJudgement::NONE;
+
+	// Every note before this one is judged or a bomb and every note after it is later, so it is the only note the press can be for
+	const EJudgement Judgement = Windows.Classify(Offset);
+	if (Judgement != EJudgement::NONE)
+	{
+		const bool bHold = Note.Type == ENoteType::HOLD;
+		OutJudged.Add({ NoteIdx, Judgement, Offset, bHold });
+		HeldNote = bHold ? NoteIdx : INDEX_NONE;
+		Cursor = NoteIdx + 1;
+	}
+	return Judgement;
+}
+
+EJudgement FLaneJudge::JudgeRelease(float ReleaseTime, const FJudgementWindows& Windows, TArray<FJudgedNote>& OutJudged)
+{
+	if (!NoteStream.IsValid() || HeldNote == INDEX_NONE)
+		return EJudgement::NONE;
+
+	const FLaneNote Note = NoteStream->GetNote(HeldNote);
+
+	// Holding on to the end is finished by ExpireMisses, so this is only ever early
+	const float Offset = FMath::Min(ReleaseTime - (Note.Time + Note.HoldDuration), 0.0f);
+	EJudgement Judgement = Windows.Classify(Offset);
+	Judgement = (Judgement == EJudgement::NONE) ? EJudgement::MISS : Judgement;
+
+	OutJudged.Add({ HeldNote, Judgement, Offset, false });
+	HeldNote = INDEX_NONE;
+	return Judgement;
+}
+
+void FLaneJudge::ExpireMisses(float Time, const FJudgementWindows& Windows, TArray<FJudgedNote>& OutJudged)
+{
+	if (!NoteStream.IsValid())
+		return;
+
+	const FLaneNoteStream& Stream = *NoteStream;
+
+	if (HeldNote != INDEX_NONE)
+	{
+		const FLaneNote Note = Stream.GetNote(HeldNote);
+		if (Time >= Note.Time + Note.HoldDuration)
+		{
+			OutJudged.Add({ HeldNote, EJudgement::PERFECT, 0.0f, false });
+			HeldNote = INDEX_NONE;
+		}
+	}
+
+	for (; Cursor < Stream.Num(); Cursor++)
+	{
+		const FLaneNote Note = Stream.GetNote(Cursor);
+		if (Note.Time + Windows.Good >= Time)
+			break;
+
+		if (IsJudged(Note.Type))
+			OutJudged.Add({ Cursor, EJudgement::MISS, 0.0f, false });
+	}
+}
+
+bool FLaneJudge::IsJudged(ENoteType Type)
+{
+	return Type != ENoteType::BOMB && Type != ENoteType::EMPTY;
+}
@@ -0,0 +1,103 @@
+/*  Judges button presses by their time against the time each note reaches the button, instead of by where the note actors are
+	along the lane. Every lane keeps a cursor into its time ordered note stream that only ever moves forward, so each press is
+	judged against the next unjudged note without looking at the notes on the lane.
+
+	Copyright (C) 2020-2021 Ilya Tsykunov (ilya@ilyatsykunov.com)
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "LaneNoteStream.h"
+
+#include "NoteJudgement.generated.h"
+
+UENUM(BlueprintType)
+enum class EJudgement : uint8
+{
+	NONE,		// No note was close enough to the press
+	PERFECT,
+	GREAT,
+	GOOD,
+	MISS,		// The note went past the button without being pressed
+	BOMB		// A bomb was pressed
+};
+
+// How far (s) either side of a note's time a press still counts as each judgement
+USTRUCT(BlueprintType)
+struct FJudgementWindows
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)		float		Perfect = 0.035f;
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)		float		Great = 0.07f;
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)		float		Good = 0.12f;
+
+	/* Returns the judgement of a press the input number of seconds away from the note's time
+	*/
+	EJudgement Classify(float Offset) const;
+};
+
+// A note of the stream that was judged, for the lane to act on
+struct FJudgedNote
+{
+	// Index of the note in the note stream
+	int32		NoteIdx = INDEX_NONE;
+	EJudgement	Judgement = EJudgement::NONE;
+	// How early (-) or late (+) the press / release was
+	float		Offset = 0.0f;
+	// The press that started a hold note. The note is only finished once it is let go or held to its end
+	bool		bHoldStart = false;
+	// Handle of the note in the lane's note queue (see FLaneNoteQueue), INDEX_NONE if the note wasn't on the lane
+	int32		Handle = INDEX_NONE;
+};
+
+struct FLaneJudge
+{
+	/* Points the judge at a note stream and puts the cursor on the first note at or after the input time
+	* @param NewNoteStream	- The notes of the lane
+	* @param Time			- Seconds since the start of the level
+	* @param bButtonDown	- Whether the button is held at that time. If it is, a hold note that started before the time and hasn't ended
+	*						  yet is being held, and is judged like any other when it is let go or held to its end
+	*/
+	void		Reset(TSharedPtr<const FLaneNoteStream> NewNoteStream, float Time = 0.0f, bool bButtonDown = false);
+
+	/* Judges a press against the next unjudged note. Notes whose window has passed by the press time are skipped as misses first. A bomb
+	* before that note is pressed instead if it is within the good window and closer to the press than the note
+	* @param InputTime	- When the button was pressed, in seconds since the start of the level
+	* @param Windows	- Judgement windows to use
+	* @param OutJudged	- The notes that were missed before the press, then the note the press was judged against, are added to this
+	* @return			- The judgement, BOMB if a bomb was pressed, NONE if no note was within the good window
+	*/
+	EJudgement	Judge(float InputTime, const FJudgementWindows& Windows, TArray<FJudgedNote>& OutJudged);
+
+	/* Judges letting go of the button against the end of the hold note that was last judged on a press. Letting go earlier than the good
+	* window is a miss
+	* @param ReleaseTime	- When the button was let go, in seconds since the start of the level
+	* @param Windows		- Judgement windows to use
+	* @param OutJudged		- The hold note is added to this if one was being held
+	* @return				- The judgement, NONE if no hold note was being held
+	*/
+	EJudgement	JudgeRelease(float ReleaseTime, const FJudgementWindows& Windows, TArray<FJudgedNote>& OutJudged);
+
+	/* Moves the cursor past every note whose good window is over by the input time, and finishes the hold note being held as perfect
+	* once its end is reached
+	* @param OutJudged - The notes that were missed or finished are added to this
+	*/
+	void		ExpireMisses(float Time, const FJudgementWindows& Windows, TArray<FJudgedNote>& OutJudged);
+
+	// Index of the next note to be judged
+	inline int32 GetCursor() const { return Cursor; }
+	// Index of the hold note being held, INDEX_NONE if there isn't one
+	inline int32 GetHeldNote() const { return HeldNote; }
+
+private:
+
+	// Whether a note of this type has to be pressed, so it is missed when it isn't
+	static bool IsJudged(ENoteType Type);
+
+	TSharedPtr<const FLaneNoteStream>	NoteStream;
+	int32								Cursor = 0;
+	// Index of the hold note being held, INDEX_NONE if there isn't one
+	int32								HeldNote = INDEX_NONE;
+};
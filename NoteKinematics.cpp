@@ -0,0 +1,62 @@
+/*  Copyright (C) 2020-2021 Ilya Tsykunov (ilya@ilyatsykunov.com)
+*/
+
+#include "NoteKinematics.h"
+
+void NoteKinematics::ClassifyDistances(const float* Heads, const float* Tails, uint8* Locations, const uint64* LiveMask, int32 SlotsNum,
+	float BoundaryStart, float BoundaryEnd, uint64* OutChangedMask, uint64* OutPastButtonMask)
+{
+	check(SlotsNum % 64 == 0);
+
+	for (int32 Word = 0; Word < SlotsNum / 64; Word++)
+	{
+		const int32 First = Word * 64;
+		uint8 Changed[64];
+		uint8 Passed[64];
+
+		for (int32 i = 0; i < 64; i++)
+		{
+			const uint8 Old = Locations[First + i];
+			const uint8 New = ClassifyDistance(Heads[First + i], Tails[First + i], Old, BoundaryStart, BoundaryEnd);
+
+			Locations[First + i] = New;
+			Changed[i] = (New != Old);
+			Passed[i] = (New != Old) & (New == PastButton);
+		}
+
+		uint64 ChangedBits = 0;
+		uint64 PassedBits = 0;
+		for (int32 i = 0; i < 64; i++)
+		{
+			ChangedBits |= (uint64)Changed[i] << i;
+			PassedBits |= (uint64)Passed[i] << i;
+		}
+
+		OutChangedMask[Word] = ChangedBits & LiveMask[Word];
+		OutPastButtonMask[Word] = PassedBits & LiveMask[Word];
+	}
+}
+
+void NoteKinematics::FindAtOrPast(const float* Percentages, const uint64* LiveMask, int32 SlotsNum, float Threshold, uint64* OutMask)
+{
+	check(SlotsNum % 64 == 0);
+
+	for (int32 Word = 0; Word < SlotsNum / 64; Word++)
+	{
+		const int32 First = Word * 64;
+		uint64 Bits = 0;
+
+		for (int32 i = 0; i < 64; i++)
+			Bits |= (uint64)(Percentages[First + i] >= Threshold) << i;
+
+		OutMask[Word] = Bits & LiveMask[Word];
+	}
+}
+
+void NoteKinematics::ComputeTimeDrivenAdvances(const float* StartDistances, const float* Roots, int32 SlotsNum, float TravelledDistance, float PathLength, float* OutAdvances)
+{
+	const float InvPathLength = 1.0f / PathLength;
+
+	for (int32 i = 0; i < SlotsNum; i++)
+		OutAdvances[i] = (TravelledDistance - StartDistances[i]) * InvPathLength - Roots[i];
+}
@@ -0,0 +1,118 @@
+/*  The per-frame maths of the notes on a lane, working on flat per-slot arrays (see FLaneNoteQueue) rather than on the note
+	actors. Every loop here is branchless over the whole queue capacity so the compiler can vectorize it, and the results come
+	out as bitmasks (one bit per slot, 64 slots per word) so the lane only has to touch the actors of the notes that changed.
+
+	Copyright (C) 2020-2021 Ilya Tsykunov (ilya@ilyatsykunov.com)
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "EnumTypes.h"
+
+namespace NoteKinematics
+{
+	static constexpr uint8 InLane		= (uint8)ENoteDistance::InLane;
+	static constexpr uint8 InButton		= (uint8)ENoteDistance::InButton;
+	static constexpr uint8 PastButton	= (uint8)ENoteDistance::PastButton;
+
+	/* Number of 64 bit mask words needed to hold one bit per slot
+	*/
+	inline int32 GetMaskWordsNum(int32 SlotsNum) { return (SlotsNum + 63) / 64; }
+
+	/* Works out which part of the lane a single note is in: in lane, then within the button, then past the button. Otherwise it keeps its old location
+	* @param Head			- Head % of the note
+	* @param Tail			- Tail % of the note
+	* @param Old			- ENoteDistance the note was in
+	* @param BoundaryStart	- % along the movement path where the button starts
+	* @param BoundaryEnd	- % along the movement path where the button ends
+	*/
+	inline uint8 ClassifyDistance(float Head, float Tail, uint8 Old, float BoundaryStart, float BoundaryEnd)
+	{
+		uint8 New = Old;
+		New = (Tail >= BoundaryEnd) ? PastButton : New;
+		New = (Head > BoundaryStart && Tail < BoundaryEnd) ? InButton : New;
+		New = (Head < BoundaryStart) ? InLane : New;
+		return New;
+	}
+
+	/* Works out which part of the lane every note is in from its head and tail % and writes the new location in place
+	* @param Heads				- Head % of every slot
+	* @param Tails				- Tail % of every slot
+	* @param Locations			- ENoteDistance of every slot. Updated in place
+	* @param LiveMask			- Slots that hold a note. Only these can show up in the output masks
+	* @param SlotsNum			- Number of slots, must be a multiple of 64
+	* @param BoundaryStart		- % along the movement path where the button starts
+	* @param BoundaryEnd		- % along the movement path where the button ends
+	* @param OutChangedMask		- Slots whose location changed
+	* @param OutPastButtonMask	- Slots that have just gone past the button
+	*/
+	void ClassifyDistances(const float* Heads, const float* Tails, uint8* Locations, const uint64* LiveMask, int32 SlotsNum,
+		float BoundaryStart, float BoundaryEnd, uint64* OutChangedMask, uint64* OutPastButtonMask);
+
+	/* Finds the slots whose % is at or past the input value
+	* @param Percentages	- % of every slot
+	* @param LiveMask		- Slots that hold a note
+	* @param SlotsNum		- Number of slots, must be a multiple of 64
+	* @param Threshold		- % to compare against
+	* @param OutMask		- Slots at or past the threshold
+	*/
+	void FindAtOrPast(const float* Percentages, const uint64* LiveMask, int32 SlotsNum, float Threshold, uint64* OutMask);
+
+	/* Works out how far every note has to move to be where it should be at the current time
+	* @param StartDistances		- The lane's travelled distance at which every note was at the start of the path
+	* @param Roots				- Root % of every slot
+	* @param SlotsNum			- Number of slots
+	* @param TravelledDistance	- The lane's travelled distance at the current time
+	* @param PathLength			- Length of the movement path
+	* @param OutAdvances		- % every note has to move by
+	*/
+	void ComputeTimeDrivenAdvances(const float* StartDistances, const float* Roots, int32 SlotsNum, float TravelledDistance, float PathLength, float* OutAdvances);
+
+	/* Calls Func(SlotIdx) for every set bit of the mask, lowest slot first
+	*/
+	template<typename FuncType>
+	void ForEachSetBit(const uint64* Mask, int32 WordsNum, FuncType Func)
+	{
+		for (int32 Word = 0; Word < WordsNum; Word++)
+		{
+			uint64 Bits = Mask[Word];
+			while (Bits)
+			{
+				Func(Word * 64 + (int32)FMath::CountTrailingZeros64(Bits));
+				Bits &= Bits - 1;
+			}
+		}
+	}
+
+	/* Calls Func(SlotIdx) for every set bit of the mask in ring order: from the input slot to the last slot, then wrapping around to the
+	* slots before it. Starting at the front of a ring buffer, this visits its notes in the order they were added
+	* @param FirstSlot - Slot to start from
+	*/
+	template<typename FuncType>
+	void ForEachSetBitFrom(const uint64* Mask, int32 WordsNum, int32 FirstSlot, FuncType Func)
+	{
+		if (WordsNum == 0)
+			return;
+
+		const int32 FirstWord = FirstSlot / 64;
+		const uint64 FromFirstSlot = ~0ull << (FirstSlot % 64);
+
+		// The first word is visited twice: the bits from the first slot on, then once the whole ring has been walked the bits before it
+		for (int32 i = 0; i <= WordsNum; i++)
+		{
+			const int32 Word = (FirstWord + i) % WordsNum;
+			uint64 Bits = Mask[Word];
+			if (i == 0)
+				Bits &= FromFirstSlot;
+			else if (i == WordsNum)
+				Bits &= ~FromFirstSlot;
+
+			while (Bits)
+			{
+				Func(Word * 64 + (int32)FMath::CountTrailingZeros64(Bits));
+				Bits &= Bits - 1;
+			}
+		}
+	}
+}
@@ -0,0 +1,190 @@
+/*  Copyright (C) 2020-2021 Ilya Tsykunov (ilya@ilyatsykunov.com)
+*/
+
+#include "RibbonHoldNote.h"
+
+#include "Lane.h"
+#include "RitmoStats.h"
+#include "ProceduralMeshComponent.h"
+#include "Materials/MaterialInstanceDynamic.h"
+#include "Materials/MaterialInterface.h"
+
+ARibbonHoldNote::ARibbonHoldNote()
+{
+	TArray<USceneComponent*> SceneComponents;
+	GetComponents<USceneComponent>(SceneComponents, true);
+	Root = (SceneComponents.Max() > 0) ? SceneComponents[0] : CreateDefaultSubobject<USceneComponent>("Root");
+
+	RibbonMeshCmp = CreateDefaultSubobject<UProceduralMeshComponent>(TEXT("RibbonMesh"));
+	RibbonMeshCmp->SetupAttachment(Root);
+	RibbonMeshCmp->SetMobility(EComponentMobility::Movable);
+	RibbonMeshCmp->bUseAsyncCooking = true;
+	Components.Add(RibbonMeshCmp);
+}
+
+void ARibbonHoldNote::BeginPlay()
+{
+	Super::BeginPlay();
+
+	// The ribbon is the head, body and tail in one
+	BaseHead = RibbonMeshCmp;
+	BaseBody = RibbonMeshCmp;
+	BaseTail = RibbonMeshCmp;
+}
+
+void ARibbonHoldNote::SetupComponents()
+{
+}
+
+FVector ARibbonHoldNote::GetTopLocation()
+{
+	return ParentLane->GetLocAtPercentageAlongMovementPath(HeadPathPercentage, ESplineCoordinateSpace::World);
+}
+
+FVector ARibbonHoldNote::GetBottomLocation()
+{
+	return ParentLane->GetLocAtPercentageAlongMovementPath(FMath::Max(TailPathPercentage, 0.0f), ESplineCoordinateSpace::World);
+}
+
+float ARibbonHoldNote::GetXLength()
+{
+	return FMath::Max(HeadPathPercentage - FMath::Max(TailPathPercentage, 0.0f), 0.0f) * ParentLane->GetMovementPathLength();
+}
+
+void ARibbonHoldNote::SetParameters(const FHoldNoteMeta NewNoteMeta, const FVector MeshSizeMultiplier)
+{
+	Super::SetParameters(NewNoteMeta, MeshSizeMultiplier);
+
+	if (NewNoteMeta.NoteType == ENoteType::EMPTY)
+		return;
+
+	Type = ENoteType::HOLD;
+	StartScale = MeshSizeMultiplier;
+
+	// The ribbon takes the width and the material of the body mesh
+	UStaticMesh* BodyMesh = NewNoteMeta[1].StaticMesh;
+	if (BodyMesh)
+	{
+		RibbonWidth = BodyMesh->GetBounds().GetBox().GetSize().Y * MeshSizeMultiplier.Y;
+
+		BodyMaterial = UMaterialInstanceDynamic::Create(BodyMesh->GetMaterial(0), nullptr);
+		RITMO_INC_COUNTER(MIDsCreated);
+		BodyMaterial->SetVectorParameterValue("Color", NewNoteMeta.MainColor);
+		BodyMaterial->SetVectorParameterValue("SecondColor", NewNoteMeta.ParticleColor);
+		RibbonMeshCmp->SetMaterial(0, BodyMaterial);
+	}
+
+	ParticleColor = NewNoteMeta.ParticleColor;
+}
+
+void ARibbonHoldNote::SetActive(bool IsActive)
+{
+	Super::SetActive(IsActive);
+
+	if (!IsActive)
+		return;
+
+	const float TotalNoteLength = ParentLane->GetMoveSpeed() * (EndTime - ParentLane->GetSpawnTimeOffset() - ParentLane->GetSongTime());
+
+	// Every ribbon has room for the longest hold, so the mesh section is created once and reused by every hold this note spawns as.
+	// A shorter hold only uses as many cross sections as its length needs
+	if (RibbonBuilder.GetSectionsNum() != MaxRibbonSectionsNum || RibbonWidth != RibbonBuilder.GetWidth())
+		RibbonBuilder.Init(MaxRibbonSectionsNum, RibbonWidth);
+	RibbonBuilder.SetUsedSectionsNum(FMath::CeilToInt(TotalNoteLength / RibbonSectionLength) + 1);
+
+	// The head starts at the start of the path and the rest of the note comes out of it
+	HeadPathPercentage = 0.0f;
+	RootPathPercentage = 0.0f;
+	TailPathPercentage = -TotalNoteLength / ParentLane->GetMovementPathLength();
+
+	UpdateRibbon();
+	RibbonMeshCmp->SetMeshSectionVisible(0, true);
+}
+
+void ARibbonHoldNote::Reset()
+{
+	Super::Reset();
+
+	// Keep the mesh section so the next hold can reuse it
+	if (CreatedSectionsNum)
+		RibbonMeshCmp->SetMeshSectionVisible(0, false);
+	BuiltHeadPercentage = -1.0f;
+	BuiltTailPercentage = -1.0f;
+
+	for (USceneComponent* Component : Components)
+		ResetComponent(Component);
+}
+
+void ARibbonHoldNote::MoveTick(FVector NewWorldLoc, FVector NewWorldTan, FRotator NewWorldRot, float TickPercentage)
+{
+	RITMO_SCOPE(HoldNoteMoveTick);
+
+	(RootPathPercentage + TickPercentage) < 1.0f ? RootPathPercentage += TickPercentage : 1.0f;
+
+	// The head will either stop at the end of the movement path or at the button
+	float MaxPercentage = 1.0f;
+
+	if (NoteState.Location == ENoteDistance::InButton && ParentLane->GetButtonIsPressed() && ParentLane->IsInputValid())
+		MaxPercentage = ParentLane->GetButtonPercentageAlongMovementPath();
+
+	HeadPathPercentage = FMath::Min(HeadPathPercentage + TickPercentage, FMath::Max(MaxPercentage, HeadPathPercentage));
+	TailPathPercentage = FMath::Min(TailPathPercentage + TickPercentage, MaxPercentage);
+
+	UpdateRibbon();
+
+	// If the HEAD has reached the end of the path, but the TAIL has not - wait for it before removing the note
+	if (NoteState.Location == ENoteDistance::PastButton && TailPathPercentage < MaxPercentage && !NoteState.bStationary)
+		NoteState.bStationary = true;
+	else if (TailPathPercentage >= MaxPercentage && NoteState.bStationary)
+		NoteState.bStationary = false;
+}
+
+void ARibbonHoldNote::UpdateRibbon()
+{
+	const float StartPercentage = FMath::Clamp(TailPathPercentage, 0.0f, HeadPathPercentage);
+
+	// Nothing has moved, so the ribbon is already right
+	if (StartPercentage == BuiltTailPercentage && HeadPathPercentage == BuiltHeadPercentage)
+		return;
+
+	BuiltTailPercentage = StartPercentage;
+	BuiltHeadPercentage = HeadPathPercentage;
+
+	const FTransform& RibbonTransform = RibbonMeshCmp->GetComponentTransform();
+	ULane* Lane = ParentLane;
+
+	RibbonBuilder.Build(StartPercentage, HeadPathPercentage, [Lane, &RibbonTransform](float Percentage, FVector& OutLoc, FVector& OutRight, FVector& OutUp)
+	{
+		FVector WorldLoc, WorldTan;
+		FRotator WorldRot;
+		Lane->GetTransformAtPercentageAlongMovementPath(Percentage, ESplineCoordinateSpace::World, WorldLoc, WorldTan, WorldRot);
+
+		const FQuat LocalRot = RibbonTransform.InverseTransformRotation(WorldRot.Quaternion());
+		OutLoc = RibbonTransform.InverseTransformPosition(WorldLoc);
+		OutRight = LocalRot.GetRightVector();
+		OutUp = LocalRot.GetUpVector();
+	});
+
+	// The mesh section is only created the first time, every other frame just rewrites the vertices
+	if (CreatedSectionsNum != RibbonBuilder.GetSectionsNum())
+	{
+		RibbonMeshCmp->CreateMeshSection_LinearColor(0, RibbonBuilder.Vertices, RibbonBuilder.Triangles, RibbonBuilder.Normals, RibbonBuilder.UVs,
+			TArray<FLinearColor>(), TArray<FProcMeshTangent>(), false);
+		CreatedSectionsNum = RibbonBuilder.GetSectionsNum();
+	}
+	else
+	{
+		RibbonMeshCmp->UpdateMeshSection_LinearColor(0, RibbonBuilder.Vertices, RibbonBuilder.Normals, RibbonBuilder.UVs,
+			TArray<FLinearColor>(), TArray<FProcMeshTangent>());
+	}
+}
+
+float ARibbonHoldNote::GetOffsetRadius()
+{
+	return RibbonWidth / 2;
+}
+
+FVector ARibbonHoldNote::GetFullSize()
+{
+	return FVector(((HoldTimeRequired / ParentLane->GetSpawnTimeOffset()) * ParentLane->GetLaneLength()) + (2 * GetOffsetRadius()), 0.f, 0.f);
+}
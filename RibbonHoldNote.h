@@ -0,0 +1,67 @@
+/* A hold note drawn as a single procedural ribbon mesh along the movement path, from its tail to its head. Unlike
+   ASplineMeshHoldNote it is one component and one draw call however long the hold is, and the ribbon's vertices are
+   rewritten in place each frame (see FRibbonMeshBuilder).
+
+	Copyright (C) 2020-2021 Ilya Tsykunov (ilya@ilyatsykunov.com)
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Play/BaseHoldNote.h"
+#include "EnumTypes.h"
+#include "RibbonMeshBuilder.h"
+
+#include "RibbonHoldNote.generated.h"
+
+class UProceduralMeshComponent;
+
+UCLASS()
+class RHYTHMGAME_API ARibbonHoldNote : public ABaseHoldNote
+{
+	GENERATED_BODY()
+
+public:
+
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)		USceneComponent*				Root;
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)		UProceduralMeshComponent*		RibbonMeshCmp;
+	// Width of the ribbon. Replaced by the width of the body mesh if the note meta has one
+	UPROPERTY(BlueprintReadOnly, EditDefaultsOnly)	float							RibbonWidth = 50.0f;
+	// Distance between two cross sections of the ribbon. Smaller values follow tight bends more closely
+	UPROPERTY(BlueprintReadOnly, EditDefaultsOnly)	float							RibbonSectionLength = 25.0f;
+	// Upper limit of the cross sections of a single ribbon
+	UPROPERTY(BlueprintReadOnly, EditDefaultsOnly)	int								MaxRibbonSectionsNum = 256;
+
+
+	ARibbonHoldNote();
+	virtual void BeginPlay() override;
+	virtual void SetupComponents() override;
+	virtual float GetXLength() override;
+	virtual void SetParameters(const FHoldNoteMeta NewNoteMeta, const FVector MeshSizeMultiplier) override;
+	virtual void Reset() override;
+	virtual void MoveTick(FVector NewWorldLoc, FVector NewWorldTan, FRotator NewWorldRot, float TickPercentage) override;
+	virtual FVector GetTopLocation() override;
+	virtual FVector GetBottomLocation() override;
+	virtual float	GetOffsetRadius() override;
+	virtual void SetActive(bool IsActive) override;
+
+	/*
+	* As the size of the tile on screen can change as it moves through the game - this reports the maximum size, which is used for scoring
+	* For real time length see GetXLength
+	* and checking bounds
+	*/
+	virtual FVector GetFullSize() override;
+
+private:
+
+	/* Rebuilds the ribbon between the tail and the head and uploads the new vertices
+	*/
+	void UpdateRibbon();
+
+	FRibbonMeshBuilder		RibbonBuilder;
+	// Number of cross sections the mesh section was created with, 0 if it hasn't been created yet
+	int						CreatedSectionsNum = 0;
+	// The head / tail % the ribbon was last built for
+	float					BuiltHeadPercentage = -1.0f;
+	float					BuiltTailPercentage = -1.0f;
+};
@@ -0,0 +1,74 @@
+/*  Copyright (C) 2020-2021 Ilya Tsykunov (ilya@ilyatsykunov.com)
+*/
+
+#include "RibbonMeshBuilder.h"
+
+void FRibbonMeshBuilder::Init(int32 NewSectionsNum, float NewWidth)
+{
+	SectionsNum = FMath::Max(NewSectionsNum, 2);
+	Width = NewWidth;
+
+	Vertices.SetNumZeroed(SectionsNum * 2);
+	Normals.SetNumZeroed(SectionsNum * 2);
+	UVs.SetNumUninitialized(SectionsNum * 2);
+	Triangles.SetNumUninitialized((SectionsNum - 1) * 6);
+
+	UsedSectionsNum = 0;
+	SetUsedSectionsNum(SectionsNum);
+
+	// Two triangles between every pair of cross sections, wound to face up
+	for (int32 i = 0; i < SectionsNum - 1; i++)
+	{
+		const int32 Left = i * 2;
+		const int32 Right = Left + 1;
+		const int32 NextLeft = Left + 2;
+		const int32 NextRight = Left + 3;
+
+		int32* Tri = &Triangles[i * 6];
+		Tri[0] = Left;		Tri[1] = NextLeft;		Tri[2] = Right;
+		Tri[3] = Right;		Tri[4] = NextLeft;		Tri[5] = NextRight;
+	}
+}
+
+void FRibbonMeshBuilder::SetUsedSectionsNum(int32 NewUsedSectionsNum)
+{
+	NewUsedSectionsNum = FMath::Clamp(NewUsedSectionsNum, 2, SectionsNum);
+	if (NewUsedSectionsNum == UsedSectionsNum)
+		return;
+
+	UsedSectionsNum = NewUsedSectionsNum;
+
+	for (int32 i = 0; i < SectionsNum; i++)
+	{
+		const float V = FMath::Min((float)i / (UsedSectionsNum - 1), 1.0f);
+		UVs[i * 2] = FVector2D(0.0f, V);
+		UVs[i * 2 + 1] = FVector2D(1.0f, V);
+	}
+}
+
+void FRibbonMeshBuilder::Build(float StartPercentage, float EndPercentage, FSamplePath SamplePath)
+{
+	const float HalfWidth = Width / 2;
+	FVector Loc, Right, Up;
+
+	for (int32 i = 0; i < UsedSectionsNum; i++)
+	{
+		const float Percentage = FMath::Lerp(StartPercentage, EndPercentage, (float)i / (UsedSectionsNum - 1));
+		SamplePath(Percentage, Loc, Right, Up);
+
+		Vertices[i * 2] = Loc - Right * HalfWidth;
+		Vertices[i * 2 + 1] = Loc + Right * HalfWidth;
+		Normals[i * 2] = Up;
+		Normals[i * 2 + 1] = Up;
+	}
+
+	// Collapse the unused cross sections onto the head
+	const int32 HeadVertex = (UsedSectionsNum - 1) * 2;
+	for (int32 i = UsedSectionsNum * 2; i < SectionsNum * 2; i += 2)
+	{
+		Vertices[i] = Vertices[HeadVertex];
+		Vertices[i + 1] = Vertices[HeadVertex + 1];
+		Normals[i] = Normals[HeadVertex];
+		Normals[i + 1] = Normals[HeadVertex + 1];
+	}
+}
@@ -0,0 +1,58 @@
+/*  Builds the vertices of a flat ribbon that follows a path, e.g. the body of a hold note along a lane's movement path. The
+	number of cross sections is fixed when the builder is set up, so the triangles are built once and every rebuild only
+	rewrites the vertices in place. A shorter ribbon uses fewer of the cross sections and collapses the rest onto its head,
+	so ribbons of any length can share one mesh section. Doesn't depend on any rendering code.
+
+	Copyright (C) 2020-2021 Ilya Tsykunov (ilya@ilyatsykunov.com)
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct FRibbonMeshBuilder
+{
+	/* Samples the path the ribbon follows
+	* @param Percentage	- % along the path
+	* @param OutLoc		- Location of the middle of the ribbon
+	* @param OutRight	- Direction from the middle of the ribbon to its right edge, normalized
+	* @param OutUp		- The direction the ribbon faces, normalized
+	*/
+	typedef TFunctionRef<void(float Percentage, FVector& OutLoc, FVector& OutRight, FVector& OutUp)> FSamplePath;
+
+	/* Sets the number of cross sections and the width, and builds the triangles and UVs. Every cross section is used until SetUsedSectionsNum
+	* @param NewSectionsNum	- Number of cross sections along the ribbon, 2 at least
+	* @param NewWidth		- Width of the ribbon
+	*/
+	void	Init(int32 NewSectionsNum, float NewWidth);
+
+	/* Sets how many of the cross sections the ribbon is built from and spreads the UVs over them
+	* @param NewUsedSectionsNum - Number of cross sections to use, clamped to [2, GetSectionsNum()]
+	*/
+	void	SetUsedSectionsNum(int32 NewUsedSectionsNum);
+
+	/* Places the used cross sections evenly along the path between the input percentages. The unused ones are put on top of the
+	* last used one, so their triangles have no area
+	* @param StartPercentage	- % along the path the ribbon starts at (its tail)
+	* @param EndPercentage		- % along the path the ribbon ends at (its head)
+	* @param SamplePath			- Path to follow
+	*/
+	void	Build(float StartPercentage, float EndPercentage, FSamplePath SamplePath);
+
+	inline int32	GetSectionsNum() const		{ return SectionsNum; }
+	inline int32	GetUsedSectionsNum() const	{ return UsedSectionsNum; }
+	inline float	GetWidth() const			{ return Width; }
+
+	// Two vertices per cross section, left then right
+	TArray<FVector>		Vertices;
+	TArray<FVector>		Normals;
+	// V runs from 0 at the tail to 1 at the head, the unused cross sections stay at 1
+	TArray<FVector2D>	UVs;
+	TArray<int32>		Triangles;
+
+private:
+
+	int32	SectionsNum = 0;
+	int32	UsedSectionsNum = 0;
+	float	Width = 0.0f;
+};
@@ -0,0 +1,54 @@
+/*  Copyright (C) 2020-2021 Ilya Tsykunov (ilya@ilyatsykunov.com)
+*/
+
+#include "RitmoStats.h"
+
+CSV_DEFINE_CATEGORY_MODULE(RHYTHMGAME_API, Ritmo, true);
+
+DEFINE_STAT(STAT_RitmoLaneTick);
+DEFINE_STAT(STAT_RitmoTickLanes);
+DEFINE_STAT(STAT_RitmoNoteSpawn);
+DEFINE_STAT(STAT_RitmoSimulateNotes);
+DEFINE_STAT(STAT_RitmoCommitTick);
+DEFINE_STAT(STAT_RitmoHoldNoteMoveTick);
+DEFINE_STAT(STAT_RitmoActivateParticleGen);
+DEFINE_STAT(STAT_RitmoDispatchInput);
+DEFINE_STAT(STAT_RitmoCameraShake);
+DEFINE_STAT(STAT_RitmoPPEffectsTick);
+
+DEFINE_STAT(STAT_RitmoActiveNotes);
+DEFINE_STAT(STAT_RitmoLiveHoldSegments);
+DEFINE_STAT(STAT_RitmoMIDsCreated);
+DEFINE_STAT(STAT_RitmoDelegateBroadcasts);
+DEFINE_STAT(STAT_RitmoPoolMisses);
+
+void RitmoStats::SetLaneActiveNotes(int32 LaneIdx, int32 NotesNum)
+{
+	check(IsInGameThread());
+
+	RITMO_ADD_COUNTER(ActiveNotes, NotesNum);
+
+#if STATS || CSV_PROFILER
+	// The number of lanes depends on the level, so their counters are made as they are needed
+	static TArray<FName> LaneCsvNames;
+#if STATS
+	static TArray<TStatId> LaneStatIds;
+#endif
+
+	while (LaneCsvNames.Num() <= LaneIdx)
+	{
+		const int32 NewLaneIdx = LaneCsvNames.Num();
+		LaneCsvNames.Add(*FString::Printf(TEXT("ActiveNotesLane%d"), NewLaneIdx));
+#if STATS
+		LaneStatIds.Add(FDynamicStats::CreateStatIdInt64<FStatGroup_STATGROUP_Ritmo>(FString::Printf(TEXT("Active notes lane %d"), NewLaneIdx)));
+#endif
+	}
+
+#if STATS
+	SET_DWORD_STAT_FName(LaneStatIds[LaneIdx].GetName(), NotesNum);
+#endif
+#if CSV_PROFILER
+	FCsvProfiler::RecordCustomStat(LaneCsvNames[LaneIdx], CSV_CATEGORY_INDEX(Ritmo), NotesNum, ECsvCustomStatOp::Set);
+#endif
+#endif
+}
@@ -0,0 +1,68 @@
+/*  Stats, trace scopes and CSV counters of the gameplay tick. Every phase wrapped in RITMO_SCOPE shows up three ways:
+	- live in the "stat Ritmo" overlay
+	- as a CPU scope in Unreal Insights (-trace=cpu)
+	- as a timing in the CSV profile
+
+	The counters are per frame unless noted and go to the same places. A CSV of a whole song can be captured with
+	ABaseRitmoLevel::bCsvCapturePerSong, or by hand with "csvprofile start" / "csvprofile stop".
+
+	Copyright (C) 2020-2021 Ilya Tsykunov (ilya@ilyatsykunov.com)
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Stats/Stats.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+#include "ProfilingDebugging/CsvProfiler.h"
+
+DECLARE_STATS_GROUP(TEXT("Ritmo"), STATGROUP_Ritmo, STATCAT_Advanced);
+
+CSV_DECLARE_CATEGORY_MODULE_EXTERN(RHYTHMGAME_API, Ritmo);
+
+/* ############################################# PHASES ############################################# */
+
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Lane tick"),				STAT_RitmoLaneTick,				STATGROUP_Ritmo, RHYTHMGAME_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Tick lanes (parallel)"),	STAT_RitmoTickLanes,			STATGROUP_Ritmo, RHYTHMGAME_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Note spawn"),				STAT_RitmoNoteSpawn,			STATGROUP_Ritmo, RHYTHMGAME_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Simulate notes"),			STAT_RitmoSimulateNotes,		STATGROUP_Ritmo, RHYTHMGAME_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Commit tick"),				STAT_RitmoCommitTick,			STATGROUP_Ritmo, RHYTHMGAME_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Hold note move tick"),		STAT_RitmoHoldNoteMoveTick,		STATGROUP_Ritmo, RHYTHMGAME_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Activate particle gen"),	STAT_RitmoActivateParticleGen,	STATGROUP_Ritmo, RHYTHMGAME_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Dispatch input"),			STAT_RitmoDispatchInput,		STATGROUP_Ritmo, RHYTHMGAME_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Camera shake"),				STAT_RitmoCameraShake,			STATGROUP_Ritmo, RHYTHMGAME_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Post process effects tick"), STAT_RitmoPPEffectsTick,		STATGROUP_Ritmo, RHYTHMGAME_API);
+
+/* ############################################# COUNTERS ############################################# */
+
+// Notes on every lane together. Each lane also has its own "Active notes lane N", see RitmoStats::SetLaneActiveNotes
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Active notes"),			STAT_RitmoActiveNotes,			STATGROUP_Ritmo, RHYTHMGAME_API);
+// Body segments in use by hold notes on the lanes
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Live hold segments"),	STAT_RitmoLiveHoldSegments,		STATGROUP_Ritmo, RHYTHMGAME_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("MIDs created"),			STAT_RitmoMIDsCreated,			STATGROUP_Ritmo, RHYTHMGAME_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Delegate broadcasts"),	STAT_RitmoDelegateBroadcasts,	STATGROUP_Ritmo, RHYTHMGAME_API);
+// Notes the object pool had to spawn because none were free
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Pool misses"),			STAT_RitmoPoolMisses,			STATGROUP_Ritmo, RHYTHMGAME_API);
+
+// Times the rest of the enclosing scope as STAT_Ritmo<Name>, in Insights and in the CSV profile
+#define RITMO_SCOPE(Name) \
+	TRACE_CPUPROFILER_EVENT_SCOPE(Ritmo##Name); \
+	SCOPE_CYCLE_COUNTER(STAT_Ritmo##Name); \
+	CSV_SCOPED_TIMING_STAT(Ritmo, Name)
+
+// Adds one to the STAT_Ritmo<Name> counter of this frame
+#define RITMO_INC_COUNTER(Name) \
+	do { INC_DWORD_STAT(STAT_Ritmo##Name); CSV_CUSTOM_STAT(Ritmo, Name, 1, ECsvCustomStatOp::Accumulate); } while (0)
+
+// Adds the input value to the STAT_Ritmo<Name> counter of this frame
+#define RITMO_ADD_COUNTER(Name, Value) \
+	do { INC_DWORD_STAT_BY(STAT_Ritmo##Name, Value); CSV_CUSTOM_STAT(Ritmo, Name, (int32)(Value), ECsvCustomStatOp::Accumulate); } while (0)
+
+namespace RitmoStats
+{
+	/* Sets the "Active notes lane N" counter of a lane for this frame. Lanes get their counters the first time they are set
+	* @param LaneIdx	- Index of the lane
+	* @param NotesNum	- Notes on the lane
+	*/
+	RHYTHMGAME_API void SetLaneActiveNotes(int32 LaneIdx, int32 NotesNum);
+}
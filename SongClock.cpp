@@ -0,0 +1,130 @@
+/*  Copyright (C) 2020-2021 Ilya Tsykunov (ilya@ilyatsykunov.com)
+*/
+
+#include "SongClock.h"
+
+#include "HAL/PlatformTime.h"
+
+/* ############################################# FReportedSongAudioClock ############################################# */
+
+bool FReportedSongAudioClock::GetPlaybackTime(double& OutTime, double& OutAge) const
+{
+	OutTime = PlaybackTime;
+	OutAge = FPlatformTime::Seconds() - ReportPlatformTime;
+	return bHasPlaybackTime;
+}
+
+void FReportedSongAudioClock::Seek(double Time)
+{
+	bHasPlaybackTime = false;
+}
+
+void FReportedSongAudioClock::ReportPlaybackTime(double Time)
+{
+	PlaybackTime = Time;
+	ReportPlatformTime = FPlatformTime::Seconds();
+	bHasPlaybackTime = true;
+}
+
+void FReportedSongAudioClock::Stop()
+{
+	bHasPlaybackTime = false;
+}
+
+/* ############################################# FSimulatedSongAudioClock ############################################# */
+
+FSimulatedSongAudioClock::FSimulatedSongAudioClock(int32 Seed, double Drift, double Jitter, double UpdateInterval)
+	: Random(Seed), Drift(Drift), Jitter(Jitter), UpdateInterval(UpdateInterval)
+{
+}
+
+bool FSimulatedSongAudioClock::GetPlaybackTime(double& OutTime, double& OutAge) const
+{
+	OutTime = ReportedPlaybackTime;
+	OutAge = TimeSinceReport;
+	return true;
+}
+
+void FSimulatedSongAudioClock::Advance(double DeltaTime)
+{
+	TruePlaybackTime += DeltaTime * (1.0 + Drift);
+	TimeSinceReport += DeltaTime;
+
+	// The position is only reported once per update interval, and never exactly. The report is the position at the last interval, which was a bit ago
+	if (TimeSinceReport >= UpdateInterval)
+	{
+		TimeSinceReport = (UpdateInterval > 0.0) ? FMath::Fmod(TimeSinceReport, UpdateInterval) : 0.0;
+		ReportedPlaybackTime = TruePlaybackTime - TimeSinceReport * (1.0 + Drift) + Random.FRandRange(-Jitter, Jitter);
+	}
+}
+
+void FSimulatedSongAudioClock::Seek(double Time)
+{
+	TruePlaybackTime = Time;
+	ReportedPlaybackTime = Time;
+	TimeSinceReport = 0.0;
+}
+
+/* ############################################# FSongClock ############################################# */
+
+void FSongClock::SetAudioClock(TSharedPtr<ISongAudioClock> NewAudioClock)
+{
+	AudioClock = NewAudioClock;
+}
+
+void FSongClock::Reset()
+{
+	Time = 0.0;
+	PlatformTimeAtTime = FPlatformTime::Seconds();
+
+	if (AudioClock.IsValid())
+		AudioClock->Seek(Time);
+}
+
+void FSongClock::Seek(float NewTime)
+{
+	// The player hears the audio LatencyOffset late, so the audio has to be that much ahead of the time being seeked to
+	Time = (double)NewTime + LatencyOffset;
+	PlatformTimeAtTime = FPlatformTime::Seconds();
+
+	if (AudioClock.IsValid())
+		AudioClock->Seek(Time);
+}
+
+float FSongClock::Tick(float DeltaTime)
+{
+	Time += DeltaTime;
+	PlatformTimeAtTime = FPlatformTime::Seconds();
+
+	double ReportedTime, ReportAge;
+	if (AudioClock.IsValid() && AudioClock->GetPlaybackTime(ReportedTime, ReportAge) && ReportAge <= MaxReportAge)
+	{
+		// The audio has carried on playing since it reported its position
+		const double AudioTime = ReportedTime + ReportAge;
+		const double Error = AudioTime - Time;
+
+		if (Error > SnapThreshold)
+		{
+			// Too far behind the audio, e.g. after a hitch, to catch up gradually
+			Time = AudioTime;
+		}
+		else
+		{
+			// Ahead of the audio the clock only ever slows down, at most to a stop, to let the audio catch up. It never steps back, so notes don't jitter backwards
+			const double Correction = Error * FMath::Min(CorrectionRate * DeltaTime, 1.0f);
+			Time += FMath::Max(Correction, -(double)DeltaTime);
+		}
+	}
+
+	return GetTime();
+}
+
+float FSongClock::GetTime() const
+{
+	return (float)Time - LatencyOffset;
+}
+
+float FSongClock::PlatformTimeToSongTime(double PlatformTime) const
+{
+	return GetTime() + (float)(PlatformTime - PlatformTimeAtTime);
+}
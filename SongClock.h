@@ -0,0 +1,144 @@
+/*  The time of the song everything in the level is synced to. Adding up frame deltas drifts away from the music after hitches
+	and pauses, so the clock follows the playback position of the song's audio instead. The audio position only updates every
+	few buffers and is jittery, so the clock still moves with the frame time and is gradually pulled towards where the audio is
+	by now (its last reported position plus the time since the report). It only jumps straight to the audio when it has fallen
+	too far behind (e.g. after a hitch), and never goes backwards: when it's ahead it slows down or waits for the audio instead.
+
+	The audio side is behind ISongAudioClock so the clock can run without any audio, e.g. against FSimulatedSongAudioClock.
+
+	Copyright (C) 2020-2021 Ilya Tsykunov (ilya@ilyatsykunov.com)
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+// Something that knows how far into the song the audio playback is
+class ISongAudioClock
+{
+public:
+
+	virtual ~ISongAudioClock() {}
+
+	/* Returns whether the audio has a playback position at the moment (i.e. is playing)
+	* @param OutTime	- Seconds into the song the playback was at when it was last reported
+	* @param OutAge		- Seconds since then, the playback has carried on by about this much
+	*/
+	virtual bool GetPlaybackTime(double& OutTime, double& OutAge) const = 0;
+
+	/* Called when the song is moved to another position or restarted, so the positions reported before don't count any more
+	* @param Time - Seconds into the song the playback was moved to
+	*/
+	virtual void Seek(double Time) = 0;
+};
+
+// Audio clock that is told the playback position, e.g. from UAudioComponent::OnAudioPlaybackPercentNative
+class FReportedSongAudioClock : public ISongAudioClock
+{
+public:
+
+	virtual bool GetPlaybackTime(double& OutTime, double& OutAge) const override;
+
+	/* Drops the last reported position until the moved audio reports a new one
+	*/
+	virtual void Seek(double Time) override;
+
+	void	ReportPlaybackTime(double Time);
+	void	Stop();
+
+private:
+
+	double	PlaybackTime = 0.0;
+	// FPlatformTime::Seconds() when PlaybackTime was reported
+	double	ReportPlatformTime = 0.0;
+	bool	bHasPlaybackTime = false;
+};
+
+// Audio clock for running the level without audio. Its playback position runs slightly fast or slow and is only updated in
+// steps with random jitter, like a real audio device, so the song clock's drift correction can be tried out headlessly
+class FSimulatedSongAudioClock : public ISongAudioClock
+{
+public:
+
+	/* @param Seed				- Seed of the jitter, the same seed always gives the same positions
+	* @param Drift				- How much faster (+) or slower (-) than real time the audio plays, e.g. 0.001 = 1ms per second
+	* @param Jitter				- Maximum error (s) of each reported position
+	* @param UpdateInterval		- How often (s) the position is reported, e.g. the length of an audio buffer
+	*/
+	FSimulatedSongAudioClock(int32 Seed = 0, double Drift = 0.0, double Jitter = 0.0, double UpdateInterval = 0.0);
+
+	virtual bool GetPlaybackTime(double& OutTime, double& OutAge) const override;
+
+	/* Puts the playback at the input time, e.g. to simulate a hitch
+	*/
+	virtual void Seek(double Time) override;
+
+	/* Moves real time forward
+	*/
+	void	Advance(double DeltaTime);
+
+	// The exact playback position without jitter or stepping
+	inline double GetTruePlaybackTime() const { return TruePlaybackTime; }
+
+private:
+
+	FRandomStream	Random;
+	double			Drift;
+	double			Jitter;
+	double			UpdateInterval;
+
+	double			TruePlaybackTime = 0.0;
+	double			ReportedPlaybackTime = 0.0;
+	double			TimeSinceReport = 0.0;
+};
+
+struct FSongClock
+{
+	/* Sets the audio to follow. Without one, the clock only adds up the frame time
+	*/
+	void	SetAudioClock(TSharedPtr<ISongAudioClock> NewAudioClock);
+
+	/* Puts the clock and the audio clock back at the start of the song
+	*/
+	void	Reset();
+
+	/* Puts the clock at the input time straight away and tells the audio clock the song has moved. The audio itself has to be
+	* moved to GetPlaybackTime by whoever plays it
+	* @param NewTime - Seconds since the start of the level, as GetTime will return it
+	*/
+	void	Seek(float NewTime);
+
+	/* Moves the clock forward by the frame time and pulls it towards the audio position. Call once per frame while the song plays
+	* @return - The new song time (GetTime)
+	*/
+	float	Tick(float DeltaTime);
+
+	/* Returns the time of the song as heard by the player, in seconds since the start of the level
+	*/
+	float	GetTime() const;
+
+	/* Returns where the audio playback should be at the moment. Ahead of GetTime by LatencyOffset
+	*/
+	inline double GetPlaybackTime() const { return Time; }
+
+	/* Converts an FPlatformTime::Seconds() timestamp from around this frame into song time
+	*/
+	float	PlatformTimeToSongTime(double PlatformTime) const;
+
+	// How late (s) the player hears the audio compared to when it's played, e.g. because of bluetooth headphones. Moves every note later by this much
+	float	LatencyOffset = 0.0f;
+	// How quickly (1/s) the clock catches up with the audio position. Higher follows the audio closer but passes more of its jitter on
+	float	CorrectionRate = 4.0f;
+	// If the clock is further behind the audio than this (s), the clock jumps straight to the audio position
+	float	SnapThreshold = 0.1f;
+	// A reported audio position older than this (s) isn't followed, e.g. while the game is paused and nothing is reported
+	float	MaxReportAge = 0.25f;
+
+private:
+
+	TSharedPtr<ISongAudioClock>		AudioClock;
+	// Where the audio playback should be, GetTime without the latency
+	double							Time = 0.0;
+	// FPlatformTime::Seconds() of the last Tick / Seek
+	double							PlatformTimeAtTime = 0.0;
+};
@@ -4,6 +4,7 @@
 #include "SplineMeshHoldNote.h"
 
 #include "Lane.h"
+#include "RitmoStats.h"
 #include "Materials/MaterialInstanceDynamic.h"
 #include "Materials/MaterialInterface.h"
 #include "Components/StaticMeshComponent.h"
@@ -94,6 +95,7 @@ void ASplineMeshHoldNote::SetParameters(const FHoldNoteMeta NewNoteMeta, const F
 	TailMaterial->SetVectorParameterValue("Color", NewNoteMeta.MainColor);
 	TailMaterial->SetVectorParameterValue("SecondColor", NewNoteMeta.ParticleColor);
 	TailMeshCmp->SetMaterial(0, TailMaterial);
+	RITMO_ADD_COUNTER(MIDsCreated, 3);
 
 	ParticleColor = NewNoteMeta.ParticleColor;
 	StartScale = HeadMeshCmp->GetComponentScale();
@@ -109,10 +111,11 @@ void ASplineMeshHoldNote::SetActive(bool IsActive)
 	const float HeadLength = HeadMeshCmp->GetStaticMesh()->GetBounds().GetBox().GetSize().X * StartScale.X;
 	const float TailLength = TailMeshCmp->GetStaticMesh()->GetBounds().GetBox().GetSize().X * StartScale.X;
 
-	const float TotalNoteLength = ParentLane->GetMoveSpeed() * (EndTime - ParentLane->GetSpawnTimeOffset() - GameMode->SecondsSinceStart);
+	const float TotalNoteLength = ParentLane->GetMoveSpeed() * (EndTime - ParentLane->GetSpawnTimeOffset() - ParentLane->GetSongTime());
 	const float TotalBodyLength = TotalNoteLength - HeadLength - TailLength;
 
-	const float SingleBodyLength = 100.0f; // TODO: Replace magic number with LaneLength / number of points on the lane path
+	// Every segment moves through the whole path, so they are all as long as the tightest bend of the path allows
+	const float SingleBodyLength = GetBodySegmentLength(ParentLane->GetMovementPathMaxCurvature());
 	const int BodyNum = FMath::CeilToInt(TotalBodyLength / SingleBodyLength);
 
 	const int MeshesNum = BodyNum + 2; // Number of body meshes + head mesh + tail mesh
@@ -132,7 +135,7 @@ void ASplineMeshHoldNote::SetActive(bool IsActive)
 			SplinePointsMeta[i].MaxPercentage = SingleBodyLength / ParentLane->GetMovementPathLength();
 		// Last body point - assign it whatever is left of the TotalBodyLength / SingleBodyLength as the max %
 		else if (i == BodyNum)
-			SplinePointsMeta[i].MaxPercentage = int(TotalBodyLength) % int(SingleBodyLength) / ParentLane->GetMovementPathLength();
+			SplinePointsMeta[i].MaxPercentage = FMath::Fmod(TotalBodyLength, SingleBodyLength) / ParentLane->GetMovementPathLength();
 		// Tail point
 		else if (i == PointsNum - 2)
 			SplinePointsMeta[i].MaxPercentage = TailLength / ParentLane->GetMovementPathLength();
@@ -154,10 +157,10 @@ void ASplineMeshHoldNote::SetActive(bool IsActive)
 		// Body mesh
 		else if (i < MeshesNum - 1)
 		{
-			const FName Name = *FString(TEXT("BodyMesh ")).Append(FString::FromInt(i - 1));
-			NewCmp = SpawnSplineMesh(FVector::ZeroVector, FVector::ZeroVector, FVector::ZeroVector, FVector::ZeroVector, BodyMeshCmp->GetStaticMesh(), Name);
+			NewCmp = AcquireBodyMesh();
 
 			// Broadcast the segment so we can make changes to it if we need to
+			RITMO_INC_COUNTER(DelegateBroadcasts);
 			OnSegmentSpawned.Broadcast(NewCmp);
 
 		}
@@ -171,9 +174,9 @@ void ASplineMeshHoldNote::SetActive(bool IsActive)
 		SplineMeshCmps.Add(NewCmp);
 	}
 
-	HeadPathPercentage = HeadMeshCmp->GetStaticMesh()->GetBounds().GetBox().GetSize().X * StartScale.X / 2 / GetParentLane()->GetMovementPath()->GetSplineLength();
+	HeadPathPercentage = HeadMeshCmp->GetStaticMesh()->GetBounds().GetBox().GetSize().X * StartScale.X / 2 / GetParentLane()->GetMovementPathLength();
 	RootPathPercentage = 0.0f;
-	TailPathPercentage = 0.0f - TailMeshCmp->GetStaticMesh()->GetBounds().GetBox().GetSize().X * StartScale.X / 2 / GetParentLane()->GetMovementPath()->GetSplineLength();
+	TailPathPercentage = 0.0f - TailMeshCmp->GetStaticMesh()->GetBounds().GetBox().GetSize().X * StartScale.X / 2 / GetParentLane()->GetMovementPathLength();
 }
 
 void ASplineMeshHoldNote::Reset()
@@ -183,8 +186,10 @@ void ASplineMeshHoldNote::Reset()
 	// Clear the spline
 	ActiveSplinePoint = 0;
 	SplinePointsMeta.Empty();
-	for (int i = 1; i < SplineMeshCmps.Num() - 1; i++) // Destroy every body component, keeping the head and tail components
-		SplineMeshCmps[i]->DestroyComponent();
+	PointLocalLocs.Reset();
+	PointLocalTans.Reset();
+	for (int i = 1; i < SplineMeshCmps.Num() - 1; i++) // Put every body component back into the pool, keeping the head and tail components
+		ReleaseBodyMesh(SplineMeshCmps[i]);
 	SplineMeshCmps.Empty();
 	HeadMeshCmp->SetStartAndEnd(FVector::ZeroVector, FVector::ZeroVector, FVector::ZeroVector, FVector::ZeroVector);
 	TailMeshCmp->SetStartAndEnd(FVector::ZeroVector, FVector::ZeroVector, FVector::ZeroVector, FVector::ZeroVector);
@@ -198,6 +203,8 @@ void ASplineMeshHoldNote::Reset()
 
 void ASplineMeshHoldNote::MoveTick(FVector NewWorldLoc, FVector NewWorldTan, FRotator NewWorldRot, float TickPercentage)
 {
+	RITMO_SCOPE(HoldNoteMoveTick);
+
 	(HeadPathPercentage + TickPercentage) < 1.0f ? HeadPathPercentage += TickPercentage : 1.0f;
 	(RootPathPercentage + TickPercentage) < 1.0f ? RootPathPercentage += TickPercentage : 1.0f;
 
@@ -207,56 +214,69 @@ void ASplineMeshHoldNote::MoveTick(FVector NewWorldLoc, FVector NewWorldTan, FRo
 	if (NoteState.Location == ENoteDistance::InButton && ParentLane->GetButtonIsPressed() && ParentLane->IsInputValid())
 		MaxPercentage = ParentLane->GetButtonPercentageAlongMovementPath();
 
-	// Move each spline point and each spline mesh forward
-	for (int i = 0; i < BodySpline->GetNumberOfSplinePoints(); i++)
+	const int PointsNum = BodySpline->GetNumberOfSplinePoints();
+	const FTransform& SplineTransform = BodySpline->GetComponentTransform();
+
+	// The points have just been added, so every one of them has to be set
+	const bool bAllDirty = PointLocalLocs.Num() != PointsNum;
+	PointLocalLocs.SetNum(PointsNum, false);
+	PointLocalTans.SetNum(PointsNum, false);
+
+	// Range of points that moved this frame. Points that haven't started extending yet or are held at the button don't move
+	int FirstDirtyPoint = PointsNum;
+	int LastDirtyPoint = -1;
+
+	// Move each spline point forward. The spline is only rebuilt once all of them have moved
+	for (int i = 0; i < PointsNum; i++)
 	{
 		// Move the point forward making sure it does not go over the MaxPercentage
 		if (i <= ActiveSplinePoint)
 			(SplinePointsMeta[i].Percentage + TickPercentage < MaxPercentage) ? SplinePointsMeta[i].Percentage += TickPercentage : SplinePointsMeta[i].Percentage = MaxPercentage;
 
 		const FVector PointWorldLoc = ParentLane->GetLocAtPercentageAlongMovementPath(SplinePointsMeta[i].Percentage, ESplineCoordinateSpace::World);
+		const FVector PointLocalLoc = SplineTransform.InverseTransformPosition(PointWorldLoc);
 
-		BodySpline->SetLocationAtSplinePoint(i, PointWorldLoc, ESplineCoordinateSpace::World);
-
-		const FVector NewLocalLoc = BodySpline->GetLocationAtSplinePoint(i, ESplineCoordinateSpace::Local);
-		const FVector NewLocalTan = BodySpline->GetTangentAtSplinePoint(i, ESplineCoordinateSpace::Local);
-
-		// Head mesh (For head and tail the start and end tangents are the same)
-		if (i == 0)
-		{
-			SplineMeshCmps[i]->SetStartPosition(NewLocalLoc);
-			SplineMeshCmps[i]->SetStartTangent(NewLocalTan);
-			SplineMeshCmps[i]->SetEndTangent(NewLocalTan);
-		}
-		else if (i == 1)
-		{
-			SplineMeshCmps[i - 1]->SetEndPosition(NewLocalLoc);
-
-			SplineMeshCmps[i]->SetStartPosition(NewLocalLoc);
-			SplineMeshCmps[i]->SetStartTangent(NewLocalTan);
-		}
-		// Body meshes
-		else if (i < SplineMeshCmps.Num() - 1)
-		{
-			SplineMeshCmps[i - 1]->SetEndPosition(NewLocalLoc);
-			SplineMeshCmps[i - 1]->SetEndTangent(NewLocalTan);
+		if (!bAllDirty && PointLocalLoc == PointLocalLocs[i])
+			continue;
 
-			SplineMeshCmps[i]->SetStartPosition(NewLocalLoc);
-			SplineMeshCmps[i]->SetStartTangent(NewLocalTan);
-		}
-		// For the tail mesh the start and end positions are flipped (because the tail mesh is always flipped. For head and tail the start and end tangents are the same)
-		else if (i == BodySpline->GetNumberOfSplinePoints() - 2)
-		{
-			SplineMeshCmps[i - 1]->SetEndPosition(NewLocalLoc);
-			SplineMeshCmps[i - 1]->SetEndTangent(NewLocalTan);
+		PointLocalLocs[i] = PointLocalLoc;
+		BodySpline->SetLocationAtSplinePoint(i, PointLocalLoc, ESplineCoordinateSpace::Local, false);
+		FirstDirtyPoint = FMath::Min(FirstDirtyPoint, i);
+		LastDirtyPoint = FMath::Max(LastDirtyPoint, i);
+	}
 
-			SplineMeshCmps[i]->SetEndPosition(NewLocalLoc);
-		}
-		else if (i == BodySpline->GetNumberOfSplinePoints() - 1)
+	if (FirstDirtyPoint <= LastDirtyPoint)
+	{
+		BodySpline->UpdateSpline();
+
+		// The tangent of a point depends on the points either side of it, so those change as well
+		const int FirstDirtyTan = FMath::Max(FirstDirtyPoint - 1, 0);
+		const int LastDirtyTan = FMath::Min(LastDirtyPoint + 1, PointsNum - 1);
+		for (int i = FirstDirtyTan; i <= LastDirtyTan; i++)
+			PointLocalTans[i] = BodySpline->GetTangentAtSplinePoint(i, ESplineCoordinateSpace::Local);
+
+		// Move each spline mesh that has a changed point to its two points (mesh i goes from point i to point i + 1), updating each mesh once
+		const int MeshesNum = SplineMeshCmps.Num();
+		const int LastDirtyMesh = FMath::Min(LastDirtyTan, FMath::Min(MeshesNum, PointsNum - 1) - 1);
+		for (int i = FMath::Max(FirstDirtyTan - 1, 0); i <= LastDirtyMesh; i++)
 		{
-			SplineMeshCmps[i - 1]->SetStartPosition(NewLocalLoc);
-			SplineMeshCmps[i - 1]->SetStartTangent(NewLocalTan * -1);
-			SplineMeshCmps[i - 1]->SetEndTangent(NewLocalTan * -1);
+			// Head mesh (For head and tail the start and end tangents are the same)
+			if (i == 0)
+			{
+				SplineMeshCmps[i]->SetStartAndEnd(PointLocalLocs[0], PointLocalTans[0], PointLocalLocs[1], PointLocalTans[0], false);
+			}
+			// For the tail mesh the start and end positions are flipped (because the tail mesh is always flipped. For head and tail the start and end tangents are the same)
+			else if (i == MeshesNum - 1)
+			{
+				const FVector TailTan = PointLocalTans[PointsNum - 1] * -1;
+				SplineMeshCmps[i]->SetStartAndEnd(PointLocalLocs[PointsNum - 1], TailTan, PointLocalLocs[PointsNum - 2], TailTan, false);
+			}
+			// Body meshes
+			else
+			{
+				SplineMeshCmps[i]->SetStartAndEnd(PointLocalLocs[i], PointLocalTans[i], PointLocalLocs[i + 1], PointLocalTans[i + 1], false);
+			}
+			SplineMeshCmps[i]->UpdateMesh();
 		}
 	}
 
@@ -292,6 +312,57 @@ USplineMeshComponent* ASplineMeshHoldNote::SpawnSplineMesh(FVector LocalStartLoc
 	return NewCmp;
 }
 
+USplineMeshComponent* ASplineMeshHoldNote::AcquireBodyMesh()
+{
+	USplineMeshComponent* Segment = PooledBodyMeshCmps.Num() ? PooledBodyMeshCmps.Pop(false) : SpawnBodyMesh();
+	Segment->SetStaticMesh(BodyMeshCmp->GetStaticMesh());
+	// Every segment draws with the note's own body material instead of a copy of it
+	if (Segment->GetMaterial(0) != BodyMaterial)
+		Segment->SetMaterial(0, BodyMaterial);
+	Segment->SetHiddenInGame(false);
+	return Segment;
+}
+
+void ASplineMeshHoldNote::ReleaseBodyMesh(USplineMeshComponent* Segment)
+{
+	Segment->SetHiddenInGame(true);
+	Segment->SetStartAndEnd(FVector::ZeroVector, FVector::ZeroVector, FVector::ZeroVector, FVector::ZeroVector);
+	PooledBodyMeshCmps.Add(Segment);
+}
+
+void ASplineMeshHoldNote::PrewarmBodyMeshes(int SegmentsNum)
+{
+	// Segments in use count towards the total, they'll be back in the pool once the note is reset
+	const int InUseNum = GetLiveBodyMeshesNum();
+
+	while (PooledBodyMeshCmps.Num() + InUseNum < SegmentsNum)
+		PooledBodyMeshCmps.Add(SpawnBodyMesh());
+}
+
+USplineMeshComponent* ASplineMeshHoldNote::SpawnBodyMesh()
+{
+	const FName Name = *FString(TEXT("BodyMesh ")).Append(FString::FromInt(SpawnedBodyMeshesNum++));
+	USplineMeshComponent* Segment = SpawnSplineMesh(FVector::ZeroVector, FVector::ZeroVector, FVector::ZeroVector, FVector::ZeroVector, BodyMeshCmp->GetStaticMesh(), Name);
+	Segment->SetHiddenInGame(true);
+	return Segment;
+}
+
+float ASplineMeshHoldNote::GetBodySegmentLength(float PathCurvature) const
+{
+	if (PathCurvature <= KINDA_SMALL_NUMBER)
+		return FMath::Max(MaxBodySegmentLength, BodySegmentLength);
+
+	// A segment of length L across a bend of radius R drifts from it by at most R - sqrt(R^2 - L^2 / 4) ~= L^2 / 8R (the sagitta of the chord). The
+	// spline mesh bends with the path so it drifts less than the chord does, which makes this a safe upper bound
+	const float Length = FMath::Sqrt(8.0f * BodySegmentTolerance / PathCurvature);
+	return FMath::Clamp(Length, BodySegmentLength, FMath::Max(MaxBodySegmentLength, BodySegmentLength));
+}
+
+int ASplineMeshHoldNote::GetBodySegmentsNum(float HoldDuration, float MoveSpeed, float PathCurvature) const
+{
+	return FMath::CeilToInt(MoveSpeed * HoldDuration / GetBodySegmentLength(PathCurvature)) + 1;
+}
+
 void ASplineMeshHoldNote::RegisterTouch(float CurrentTime, float DeltaTime)
 {
 	Super::RegisterTouch(CurrentTime, DeltaTime);
@@ -52,6 +52,19 @@ public:
 	UPROPERTY(BlueprintReadWrite, EditAnywhere)		TArray<FSplinePointMeta>		SplinePointsMeta;
 	UPROPERTY(BlueprintReadWrite, EditAnywhere)		int								ActiveSplinePoint = 0;
 	UPROPERTY(BlueprintReadWrite, EditAnywhere)		TArray<USplineMeshComponent*>	SplineMeshCmps;
+	// Shortest a body segment can be. Segments only get this short on lanes with very tight bends
+	UPROPERTY(BlueprintReadOnly, EditDefaultsOnly)	float							BodySegmentLength = 100.0f;
+	// Longest a body segment can be, which is what every segment is on a straight lane
+	UPROPERTY(BlueprintReadOnly, EditDefaultsOnly)	float							MaxBodySegmentLength = 2000.0f;
+	// How far (in units) a body segment is allowed to drift from the movement path where the path bends. Larger values mean fewer, longer segments
+	UPROPERTY(BlueprintReadOnly, EditDefaultsOnly)	float							BodySegmentTolerance = 2.0f;
+	// Body segments that aren't in use. They stay registered and hidden so they can be reused without registering new components
+	UPROPERTY()										TArray<USplineMeshComponent*>	PooledBodyMeshCmps;
+	// Number of body segments this note has ever created, used to give each one a unique name
+	UPROPERTY()										int								SpawnedBodyMeshesNum = 0;
+	// Local locations and tangents the body spline points were last set to. Only points that move away from these are updated
+													TArray<FVector>					PointLocalLocs;
+													TArray<FVector>					PointLocalTans;
 
 
 	ASplineMeshHoldNote();
@@ -85,9 +98,44 @@ public:
 
 	USplineMeshComponent* SpawnSplineMesh(FVector LocalStartLoc, FVector LocalStartTan, FVector LocalEndLoc, FVector LocalEndTan, UStaticMesh* Mesh, FName Name);
 
+	/* Takes a body segment from the pool, or creates a new one if the pool is empty
+	*/
+	USplineMeshComponent* AcquireBodyMesh();
+
+	/* Hides a body segment and puts it back into the pool
+	*/
+	void ReleaseBodyMesh(USplineMeshComponent* Segment);
+
+	/* Creates hidden body segments up front so that holds up to the input number of segments never have to create components while playing
+	* @param SegmentsNum - Number of body segments the longest hold needs
+	*/
+	void PrewarmBodyMeshes(int SegmentsNum);
+
+	/* Returns how long the body segments can be on a path whose tightest bend has the input curvature, while staying within BodySegmentTolerance of it
+	* @param PathCurvature - Curvature (1 / radius) of the tightest bend of the movement path
+	*/
+	float GetBodySegmentLength(float PathCurvature) const;
+
+	/* Returns the number of body segments a hold of the input duration needs at most
+	* @param HoldDuration	- How long the note is held for
+	* @param MoveSpeed		- Speed of the notes
+	* @param PathCurvature	- Curvature (1 / radius) of the tightest bend of the movement path
+	*/
+	int GetBodySegmentsNum(float HoldDuration, float MoveSpeed, float PathCurvature) const;
+
 	/*
 	* Moves the tail and adjusts the spline points of the body acording to the movement path
 	*/
 	void MoveSpline(float TickPercentage);
 
+	/* Returns the number of body segments this note has taken out of its pool and not put back yet
+	*/
+	inline int GetLiveBodyMeshesNum() const { return FMath::Max(SplineMeshCmps.Num() - 2, 0); }
+
+private:
+
+	/* Creates a new hidden body segment with a unique name
+	*/
+	USplineMeshComponent* SpawnBodyMesh();
+
 };
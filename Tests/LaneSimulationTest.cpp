@@ -0,0 +1,181 @@
+/*  Copyright (C) 2020-2021 Ilya Tsykunov (ilya@ilyatsykunov.com)
+*/
+
+#include "LaneSimulation.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace LaneSimulationTest
+{
+	// A press for most notes of the stream, up to 80ms off, the release at the end of hold notes and the odd press at nothing
+	TArray<FScriptedInput> ScriptInputs(const FLaneNoteStream& Stream, int32 Seed)
+	{
+		FScriptedInputParams Params;
+		Params.Accuracy = 0.08f;
+		Params.MissRate = 0.1f;
+		Params.StrayPressRate = 0.05f;
+		return FLaneSimulation::ScriptInputs(Stream, Params, Seed);
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FLaneSimulationGoldenTest, "Ritmo.LaneSimulation.Golden", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FLaneSimulationGoldenTest::RunTest(const FString& Parameters)
+{
+	FSyntheticChartParams ChartParams;
+	ChartParams.NotesNum = 300;
+	ChartParams.NotesPerSecond = 4.0f;
+	ChartParams.HoldRatio = 0.3f;
+	ChartParams.HoldLength = 1.0f;
+
+	FSpecialNoteOdds Odds;
+	Odds.BombFreq = 10;
+
+	const FStraightLanePath Path(FVector::ZeroVector, FVector(3000.0f, 0.0f, 0.0f));
+	FLaneSimulation Lane;
+	Lane.SetPath(&Path, 0.45f, 0.55f);
+	Lane.LoadNotes(FLaneNoteStream::Generate(ChartParams, 7));
+	Lane.ResolveSpecialNotes(Odds, 7);
+	Lane.SetMoveSpeed(0.0f, 1000.0f);
+	Lane.Reset(1000.0f);
+
+	const FLaneNoteStream& Stream = *Lane.GetNoteStream();
+	const FLaneNote LastNote = Stream.GetNote(Stream.Num() - 1);
+	const float EndTime = LastNote.Time + LastNote.HoldDuration + 4.0f;
+
+	Lane.Play(LaneSimulationTest::ScriptInputs(Stream, 11), EndTime, 1.0f / 60.0f);
+
+	// Every note was judged, or hit as a bomb, and has left the lane
+	const FLaneSimulationStats& Stats = Lane.GetStats();
+	TestEqual(TEXT("Spawned notes"), Stats.SpawnedNotes, Stream.Num());
+	TestEqual(TEXT("Notes left on the lane"), Lane.GetNotes().NumNotes(), 0);
+
+	// Golden output: changes to these mean the rules of the lane changed, which has to be on purpose. Hold notes are judged twice, on the
+	// press and on the release. The lane is empty by now, so the hash only covers the judge and the stats, not any note positions
+	TestEqual(TEXT("Perfect"), Stats.Perfect, 148);
+	TestEqual(TEXT("Great"), Stats.Great, 142);
+	TestEqual(TEXT("Good"), Stats.Good, 48);
+	TestEqual(TEXT("Miss"), Stats.Miss, 26);
+	TestEqual(TEXT("Complete misses"), Stats.CompleteMisses, 12);
+	TestEqual(TEXT("Bombs"), Stats.Bombs, 16);
+	TestEqual(TEXT("State hash"), Lane.GetStateHash(), 2459504501u);
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FLaneSimulationNotesTest, "Ritmo.LaneSimulation.Notes", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FLaneSimulationNotesTest::RunTest(const FString& Parameters)
+{
+	FSyntheticChartParams ChartParams;
+	ChartParams.NotesNum = 20;
+	ChartParams.NotesPerSecond = 2.0f;
+	ChartParams.HoldRatio = 0.0f;
+
+	// 3000 units at 1000 units / s with the button in the middle: a note spawns 1.5s before its time
+	const FStraightLanePath Path(FVector::ZeroVector, FVector(3000.0f, 0.0f, 0.0f));
+	FLaneSimulation Lane;
+	Lane.SetPath(&Path, 0.45f, 0.55f);
+	Lane.LoadNotes(FLaneNoteStream::Generate(ChartParams, 3));
+	Lane.SetMoveSpeed(0.0f, 1000.0f);
+	Lane.Reset(1000.0f);
+
+	const FLaneNote FirstNote = Lane.GetNoteStream()->GetNote(0);
+	const FLaneNoteQueue& Notes = Lane.GetNotes();
+
+	// At its time the first note is in the middle of the button and can be hit
+	Lane.Step(FirstNote.Time, 1.0f / 60.0f);
+	const int32 Slot = Notes.FindSlotOfNoteIdx(0);
+	TestTrue(TEXT("The first note is on the lane"), Slot != INDEX_NONE);
+	if (Slot == INDEX_NONE)
+		return false;
+
+	TestEqual(TEXT("Root of a note at its time"), Notes.Kinematics.Root[Slot], 0.5f, 1e-4f);
+	TestEqual(TEXT("Within the button at its time"), Notes.Kinematics.Location[Slot], (uint8)ENoteDistance::InButton);
+	TestEqual(TEXT("The note within the button"), Lane.FindNoteWithinBounds(), Slot);
+
+	// Hitting it takes it off the lane straight away, and hands back what its owner keeps it by
+	Lane.SetNoteHandle(Slot, 42);
+	TestEqual(TEXT("Slot of a handle"), Notes.FindSlotOfHandle(42), Slot);
+	TArray<FJudgedNote> Judged;
+	TestEqual(TEXT("Press on time"), Lane.Press(FirstNote.Time, Judged), EJudgement::PERFECT);
+	TestEqual(TEXT("Judged notes"), Judged.Num(), 1);
+	TestEqual(TEXT("Handle of the judged note"), Judged.Num() ? Judged[0].Handle : INDEX_NONE, 42);
+	TestEqual(TEXT("A hit note leaves the lane"), Notes.FindSlotOfNoteIdx(0), INDEX_NONE);
+	TestEqual(TEXT("The handle of a note that left the lane is free"), Notes.FindSlotOfHandle(42), INDEX_NONE);
+	Lane.Release(FirstNote.Time + 0.05f, Judged);
+
+	// A note that isn't pressed goes past the button, can't be hit any more and is missed once its window is over
+	const FLaneNote SecondNote = Lane.GetNoteStream()->GetNote(1);
+	Lane.Step(SecondNote.Time + 0.4f, 1.0f / 60.0f);
+	const int32 MissedSlot = Notes.FindSlotOfNoteIdx(1);
+	TestTrue(TEXT("A missed note stays on the lane"), MissedSlot != INDEX_NONE);
+	TestTrue(TEXT("A note past the button is done with"), MissedSlot != INDEX_NONE && Notes.IsDone(MissedSlot));
+	TestEqual(TEXT("Misses"), Lane.GetStats().Miss, 1);
+
+	// And it leaves the lane once it has travelled the whole path
+	Lane.Step(SecondNote.Time + 1.6f, 1.0f / 60.0f);
+	TestEqual(TEXT("A note at the end of the path leaves the lane"), Notes.FindSlotOfNoteIdx(1), INDEX_NONE);
+
+	// Seeking back brings the notes back where they were, the ones before the seek time only to be seen
+	Lane.Seek(FirstNote.Time + 0.1f, [](int32 SeekSlot, const FLaneNote& LaneNote, float TimeSinceSpawn) {});
+	const int32 SeekSlot = Notes.FindSlotOfNoteIdx(0);
+	TestTrue(TEXT("A seek brings notes back"), SeekSlot != INDEX_NONE);
+	TestTrue(TEXT("A note before the seek time can't be hit"), SeekSlot != INDEX_NONE && Notes.IsDone(SeekSlot));
+	TestEqual(TEXT("Root after a seek"), SeekSlot != INDEX_NONE ? Notes.Kinematics.Root[SeekSlot] : 0.0f, (1.5f + 0.1f) / 3.0f, 1e-4f);
+
+	// A note that is on its way to the button when the speed changes still reaches the button at its time
+	const FLaneNote ThirdNote = Lane.GetNoteStream()->GetNote(2);
+	const float SpeedChangeTime = ThirdNote.Time - 1.0f;
+	Lane.Step(SpeedChangeTime, 1.0f / 60.0f);
+	Lane.SetMoveSpeed(SpeedChangeTime, 1500.0f);
+	Lane.Step(ThirdNote.Time, 1.0f / 60.0f);
+	const int32 SpeedSlot = Notes.FindSlotOfNoteIdx(2);
+	TestTrue(TEXT("The note is on the lane after the speed change"), SpeedSlot != INDEX_NONE);
+	TestEqual(TEXT("Root at its time after a speed change"), SpeedSlot != INDEX_NONE ? Notes.Kinematics.Root[SpeedSlot] : 0.0f, 0.5f, 1e-4f);
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FLaneSimulationSeekHoldTest, "Ritmo.LaneSimulation.SeekHold", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FLaneSimulationSeekHoldTest::RunTest(const FString& Parameters)
+{
+	FSyntheticChartParams ChartParams;
+	ChartParams.NotesNum = 10;
+	ChartParams.HoldRatio = 1.0f;
+	ChartParams.HoldLength = 2.0f;
+
+	const FStraightLanePath Path(FVector::ZeroVector, FVector(3000.0f, 0.0f, 0.0f));
+	FLaneSimulation Lane;
+	Lane.SetPath(&Path, 0.45f, 0.55f);
+	Lane.LoadNotes(FLaneNoteStream::Generate(ChartParams, 5));
+	Lane.SetMoveSpeed(0.0f, 1000.0f);
+	Lane.Reset(1000.0f);
+
+	const FLaneNote HoldNote = Lane.GetNoteStream()->GetNote(0);
+	const float SeekTime = HoldNote.Time + HoldNote.HoldDuration / 2;
+	const FLaneNoteQueue& Notes = Lane.GetNotes();
+	TArray<FJudgedNote> Judged;
+
+	// Seeking into a hold note with the button up only shows it
+	Lane.Seek(SeekTime, [](int32 Slot, const FLaneNote& LaneNote, float TimeSinceSpawn) {});
+	const int32 ShownSlot = Notes.FindSlotOfNoteIdx(0);
+	TestTrue(TEXT("A hold note in progress without the button is only shown"), ShownSlot != INDEX_NONE && Notes.IsDone(ShownSlot));
+	TestEqual(TEXT("No hold note is held"), Lane.GetHeldNote(), INDEX_NONE);
+
+	// With the button down it carries on being held, and is finished once it is held to its end
+	Lane.Seek(SeekTime, [](int32 Slot, const FLaneNote& LaneNote, float TimeSinceSpawn) {}, true);
+	const int32 HeldSlot = Notes.FindSlotOfNoteIdx(0);
+	TestTrue(TEXT("A hold note in progress with the button down can still be held"), HeldSlot != INDEX_NONE && !Notes.IsDone(HeldSlot));
+	TestEqual(TEXT("The hold note is held"), Lane.GetHeldNote(), 0);
+
+	Lane.ExpireMisses(HoldNote.Time + HoldNote.HoldDuration, Judged);
+	TestEqual(TEXT("Held to its end"), Judged.Num() ? Judged[0].Judgement : EJudgement::NONE, EJudgement::PERFECT);
+	TestEqual(TEXT("A finished hold note leaves the lane"), Notes.FindSlotOfNoteIdx(0), INDEX_NONE);
+
+	return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
@@ -0,0 +1,77 @@
+/*  Copyright (C) 2020-2021 Ilya Tsykunov (ilya@ilyatsykunov.com)
+*/
+
+#include "RibbonMeshBuilder.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace RibbonMeshBuilderTest
+{
+	// A straight path along X, 1000 units long, facing up
+	void SampleStraightPath(float Percentage, FVector& OutLoc, FVector& OutRight, FVector& OutUp)
+	{
+		OutLoc = FVector(Percentage * 1000.0f, 0.0f, 0.0f);
+		OutRight = FVector(0.0f, 1.0f, 0.0f);
+		OutUp = FVector(0.0f, 0.0f, 1.0f);
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FRibbonMeshBuilderTest, "Ritmo.RibbonMeshBuilder", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FRibbonMeshBuilderTest::RunTest(const FString& Parameters)
+{
+	FRibbonMeshBuilder Builder;
+	Builder.Init(8, 20.0f);
+
+	// Two vertices per cross section, two triangles between every pair of them
+	TestEqual(TEXT("Sections"), Builder.GetSectionsNum(), 8);
+	TestEqual(TEXT("Used sections after Init"), Builder.GetUsedSectionsNum(), 8);
+	TestEqual(TEXT("Vertices"), Builder.Vertices.Num(), 16);
+	TestEqual(TEXT("Normals"), Builder.Normals.Num(), 16);
+	TestEqual(TEXT("UVs"), Builder.UVs.Num(), 16);
+	TestEqual(TEXT("Indices"), Builder.Triangles.Num(), 42);
+
+	bool bIndicesInRange = true;
+	for (int32 Idx : Builder.Triangles)
+		bIndicesInRange &= Idx >= 0 && Idx < Builder.Vertices.Num();
+	TestTrue(TEXT("Every index points at a vertex"), bIndicesInRange);
+
+	// With every section used, V runs from 0 at the tail to 1 at the head and U goes across
+	TestEqual(TEXT("Tail left UV"), Builder.UVs[0], FVector2D(0.0f, 0.0f));
+	TestEqual(TEXT("Tail right UV"), Builder.UVs[1], FVector2D(1.0f, 0.0f));
+	TestEqual(TEXT("Head left UV"), Builder.UVs[14], FVector2D(0.0f, 1.0f));
+	TestEqual(TEXT("Head right UV"), Builder.UVs[15], FVector2D(1.0f, 1.0f));
+
+	// A shorter ribbon spreads V over the sections it uses, the rest stay at the head
+	Builder.SetUsedSectionsNum(3);
+	TestEqual(TEXT("Used sections"), Builder.GetUsedSectionsNum(), 3);
+	TestEqual(TEXT("Middle UV of a short ribbon"), Builder.UVs[2], FVector2D(0.0f, 0.5f));
+	TestEqual(TEXT("Head UV of a short ribbon"), Builder.UVs[5], FVector2D(1.0f, 1.0f));
+	TestEqual(TEXT("Unused UV"), Builder.UVs[15], FVector2D(1.0f, 1.0f));
+	TestEqual(TEXT("Indices don't change with the used sections"), Builder.Triangles.Num(), 42);
+
+	Builder.Build(0.25f, 0.75f, RibbonMeshBuilderTest::SampleStraightPath);
+
+	TestEqual(TEXT("Tail left vertex"), Builder.Vertices[0], FVector(250.0f, -10.0f, 0.0f));
+	TestEqual(TEXT("Tail right vertex"), Builder.Vertices[1], FVector(250.0f, 10.0f, 0.0f));
+	TestEqual(TEXT("Middle left vertex"), Builder.Vertices[2], FVector(500.0f, -10.0f, 0.0f));
+	TestEqual(TEXT("Head right vertex"), Builder.Vertices[5], FVector(750.0f, 10.0f, 0.0f));
+	TestEqual(TEXT("Normal"), Builder.Normals[3], FVector(0.0f, 0.0f, 1.0f));
+
+	// The unused sections are collapsed onto the head so they don't draw anything
+	bool bCollapsed = true;
+	for (int32 i = 6; i < Builder.Vertices.Num(); i += 2)
+		bCollapsed &= Builder.Vertices[i] == Builder.Vertices[4] && Builder.Vertices[i + 1] == Builder.Vertices[5];
+	TestTrue(TEXT("Unused sections are collapsed onto the head"), bCollapsed);
+
+	// The used sections are clamped to what the builder was set up with
+	Builder.SetUsedSectionsNum(1);
+	TestEqual(TEXT("At least two sections are used"), Builder.GetUsedSectionsNum(), 2);
+	Builder.SetUsedSectionsNum(100);
+	TestEqual(TEXT("No more sections are used than there are"), Builder.GetUsedSectionsNum(), 8);
+
+	return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
@@ -0,0 +1,142 @@
+/*  Copyright (C) 2020-2021 Ilya Tsykunov (ilya@ilyatsykunov.com)
+*/
+
+#include "SongClock.h"
+#include "Math/RandomStream.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace SongClockTest
+{
+	// Plays the song for the input time at an uneven ~60fps
+	// @return - The furthest the clock got from the true audio position after the first second, -1 if the clock ever went backwards
+	double Play(FSongClock& Clock, FSimulatedSongAudioClock& Audio, FRandomStream& Frames, double Duration)
+	{
+		double MaxError = 0.0;
+		float LastTime = Clock.GetTime();
+
+		for (double Elapsed = 0.0; Elapsed < Duration;)
+		{
+			const float DeltaTime = Frames.FRandRange(0.8f, 1.2f) / 60.0f;
+			Elapsed += DeltaTime;
+
+			Audio.Advance(DeltaTime);
+			const float Time = Clock.Tick(DeltaTime);
+			if (Time < LastTime)
+				return -1.0;
+			LastTime = Time;
+
+			if (Elapsed > 1.0)
+				MaxError = FMath::Max(MaxError, FMath::Abs(Clock.GetPlaybackTime() - Audio.GetTruePlaybackTime()));
+		}
+		return MaxError;
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FSongClockFollowsAudioTest, "Ritmo.SongClock.FollowsAudio", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FSongClockFollowsAudioTest::RunTest(const FString& Parameters)
+{
+	FRandomStream Frames(3);
+
+	// Positions only reported every 100ms: the clock has to carry them forward by the time since, not pull back towards them
+	{
+		TSharedRef<FSimulatedSongAudioClock> Audio = MakeShared<FSimulatedSongAudioClock>(1, 0.0, 0.0, 0.1);
+		FSongClock Clock;
+		Clock.SetAudioClock(Audio);
+		Clock.Reset();
+
+		const double MaxError = SongClockTest::Play(Clock, *Audio, Frames, 20.0);
+		TestTrue(TEXT("Never goes backwards with coarse positions"), MaxError >= 0.0);
+		TestTrue(TEXT("Stays with coarse positions"), MaxError < 0.005);
+	}
+
+	// A drifting, jittery audio device
+	{
+		TSharedRef<FSimulatedSongAudioClock> Audio = MakeShared<FSimulatedSongAudioClock>(7, 0.002, 0.004, 0.021);
+		FSongClock Clock;
+		Clock.SetAudioClock(Audio);
+		Clock.Reset();
+
+		const double MaxError = SongClockTest::Play(Clock, *Audio, Frames, 60.0);
+		TestTrue(TEXT("Never goes backwards with drift and jitter"), MaxError >= 0.0);
+		TestTrue(TEXT("Stays with drift and jitter"), MaxError < 0.01);
+	}
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FSongClockHitchTest, "Ritmo.SongClock.Hitches", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FSongClockHitchTest::RunTest(const FString& Parameters)
+{
+	FRandomStream Frames(5);
+	TSharedRef<FSimulatedSongAudioClock> Audio = MakeShared<FSimulatedSongAudioClock>(2, 0.0, 0.002, 0.02);
+	FSongClock Clock;
+	Clock.SetAudioClock(Audio);
+	Clock.Reset();
+	SongClockTest::Play(Clock, *Audio, Frames, 5.0);
+
+	// The game hitched for 300ms but the frame time was clamped to 100ms: the clock has fallen behind and jumps to the audio
+	Audio->Advance(0.3);
+	Clock.Tick(0.1f);
+	TestTrue(TEXT("Catches up after a hitch"), FMath::Abs(Clock.GetPlaybackTime() - Audio->GetTruePlaybackTime()) < 0.01);
+
+	// The audio stalls for 300ms while the game keeps running: the clock gets ahead, but must never step back to meet it
+	const double StallTime = Audio->GetTruePlaybackTime();
+	float LastTime = Clock.GetTime();
+	bool bSteppedBack = false;
+	for (int32 i = 0; i < 18; i++)
+	{
+		Audio->Seek(StallTime);
+		bSteppedBack |= Clock.Tick(1.0f / 60.0f) < LastTime;
+		LastTime = Clock.GetTime();
+	}
+	TestFalse(TEXT("Doesn't step back while the audio is stalled"), bSteppedBack);
+
+	// Once the audio carries on the clock waits for it and then follows it again
+	TestTrue(TEXT("Follows the audio again after a stall"), SongClockTest::Play(Clock, *Audio, Frames, 3.0) >= 0.0);
+	TestTrue(TEXT("Back with the audio after a stall"), FMath::Abs(Clock.GetPlaybackTime() - Audio->GetTruePlaybackTime()) < 0.01);
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FSongClockSeekTest, "Ritmo.SongClock.Seek", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FSongClockSeekTest::RunTest(const FString& Parameters)
+{
+	FRandomStream Frames(11);
+	TSharedRef<FSimulatedSongAudioClock> Audio = MakeShared<FSimulatedSongAudioClock>(4, 0.0, 0.002, 0.02);
+	FSongClock Clock;
+	Clock.LatencyOffset = 0.1f;
+	Clock.SetAudioClock(Audio);
+	Clock.Reset();
+	SongClockTest::Play(Clock, *Audio, Frames, 10.0);
+
+	// Seeking back puts the time the player hears at the seek time, and the audio ahead of it by the latency
+	Clock.Seek(2.0f);
+	TestEqual(TEXT("Heard time after a seek"), Clock.GetTime(), 2.0f, 1e-4f);
+	TestEqual(TEXT("Playback time after a seek"), Clock.GetPlaybackTime(), 2.1, 1e-4);
+
+	// The audio is moved with the clock, so the clock carries on from the seek time rather than going back to where the audio was
+	Audio->Seek(Clock.GetPlaybackTime());
+	TestTrue(TEXT("Follows the audio after a seek"), SongClockTest::Play(Clock, *Audio, Frames, 2.0) >= 0.0);
+	TestEqual(TEXT("Carries on from the seek time"), Clock.GetTime(), (float)Audio->GetTruePlaybackTime() - 0.1f, 0.01f);
+
+	// A position reported during the last run doesn't count once the clock is reset
+	TSharedRef<FReportedSongAudioClock> ReportedAudio = MakeShared<FReportedSongAudioClock>();
+	FSongClock ReportedClock;
+	ReportedClock.SetAudioClock(ReportedAudio);
+	ReportedAudio->ReportPlaybackTime(42.0);
+	ReportedClock.Tick(1.0f / 60.0f);
+	TestTrue(TEXT("Follows a reported position"), ReportedClock.GetPlaybackTime() >= 42.0);
+
+	ReportedClock.Reset();
+	ReportedClock.Tick(1.0f / 60.0f);
+	TestEqual(TEXT("Ignores the last run's position after a reset"), ReportedClock.GetPlaybackTime(), 1.0 / 60.0, 1e-4);
+
+	return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
@@ -0,0 +1,140 @@
+/*  Copyright (C) 2020-2021 Ilya Tsykunov (ilya@ilyatsykunov.com)
+*/
+
+#include "TimedInputQueue.h"
+
+#include "HAL/PlatformTime.h"
+#include "Algo/StableSort.h"
+#include "Misc/ScopeLock.h"
+
+#if PLATFORM_ANDROID
+#include <android/input.h>
+#include <android_native_app_glue.h>
+
+extern struct android_app* GNativeAndroidApp;
+
+namespace TimedInputQueue
+{
+	// The hook runs on the Android event thread, so the queue it writes to is only swapped under the lock
+	FCriticalSection	HookLock;
+	FTimedInputQueue*	HookedQueue = nullptr;
+	int32_t				(*PrevOnInputEvent)(struct android_app* App, AInputEvent* InputEvent) = nullptr;
+
+	void RecordPointer(const AInputEvent* InputEvent, size_t PointerIdx, bool bPressed)
+	{
+		FTimedInputEvent Event;
+		// Nanoseconds of CLOCK_MONOTONIC, the same clock FPlatformTime::Seconds() reads on Android
+		Event.Timestamp = AMotionEvent_getEventTime(InputEvent) / 1000000000.0;
+		Event.ScreenLoc = FVector2D(AMotionEvent_getX(InputEvent, PointerIdx), AMotionEvent_getY(InputEvent, PointerIdx));
+		Event.PointerIdx = AMotionEvent_getPointerId(InputEvent, PointerIdx);
+		Event.bPressed = bPressed;
+
+		FScopeLock Lock(&HookLock);
+		if (HookedQueue)
+			HookedQueue->Enqueue(Event);
+	}
+
+	int32_t OnInputEvent(struct android_app* App, AInputEvent* InputEvent)
+	{
+		if (AInputEvent_getType(InputEvent) == AINPUT_EVENT_TYPE_MOTION)
+		{
+			const int32_t Action = AMotionEvent_getAction(InputEvent);
+			const size_t ActionPointerIdx = (Action & AMOTION_EVENT_ACTION_POINTER_INDEX_MASK) >> AMOTION_EVENT_ACTION_POINTER_INDEX_SHIFT;
+
+			switch (Action & AMOTION_EVENT_ACTION_MASK)
+			{
+			case AMOTION_EVENT_ACTION_DOWN:
+			case AMOTION_EVENT_ACTION_POINTER_DOWN:
+				RecordPointer(InputEvent, ActionPointerIdx, true);
+				break;
+			case AMOTION_EVENT_ACTION_UP:
+			case AMOTION_EVENT_ACTION_POINTER_UP:
+				RecordPointer(InputEvent, ActionPointerIdx, false);
+				break;
+			case AMOTION_EVENT_ACTION_CANCEL:
+				// Every pointer of a cancelled gesture is let go
+				for (size_t i = 0; i < AMotionEvent_getPointerCount(InputEvent); i++)
+					RecordPointer(InputEvent, i, false);
+				break;
+			default:
+				break;
+			}
+		}
+
+		// The engine still handles every event as usual
+		return PrevOnInputEvent ? PrevOnInputEvent(App, InputEvent) : 0;
+	}
+}
+#endif
+
+FTimedInputQueue::FTimedInputQueue()
+{
+#if PLATFORM_ANDROID
+	FScopeLock Lock(&TimedInputQueue::HookLock);
+	if (GNativeAndroidApp && !TimedInputQueue::HookedQueue)
+	{
+		TimedInputQueue::PrevOnInputEvent = GNativeAndroidApp->onInputEvent;
+		GNativeAndroidApp->onInputEvent = &TimedInputQueue::OnInputEvent;
+		TimedInputQueue::HookedQueue = this;
+		bPlatformTimestamps = true;
+	}
+#endif
+}
+
+FTimedInputQueue::~FTimedInputQueue()
+{
+#if PLATFORM_ANDROID
+	FScopeLock Lock(&TimedInputQueue::HookLock);
+	if (TimedInputQueue::HookedQueue == this)
+	{
+		GNativeAndroidApp->onInputEvent = TimedInputQueue::PrevOnInputEvent;
+		TimedInputQueue::HookedQueue = nullptr;
+	}
+#endif
+}
+
+bool FTimedInputQueue::HandleMouseButtonDownEvent(FSlateApplication& SlateApp, const FPointerEvent& MouseEvent)
+{
+	// Touches already come in from the platform with a better timestamp
+	if (!bPlatformTimestamps || !MouseEvent.IsTouchEvent())
+		Record(MouseEvent, true);
+	return false;
+}
+
+bool FTimedInputQueue::HandleMouseButtonUpEvent(FSlateApplication& SlateApp, const FPointerEvent& MouseEvent)
+{
+	if (!bPlatformTimestamps || !MouseEvent.IsTouchEvent())
+		Record(MouseEvent, false);
+	return false;
+}
+
+void FTimedInputQueue::Enqueue(const FTimedInputEvent& Event)
+{
+	Events.Enqueue(Event);
+}
+
+int32 FTimedInputQueue::Drain(TArray<FTimedInputEvent>& OutEvents)
+{
+	const int32 FirstIdx = OutEvents.Num();
+
+	FTimedInputEvent Event;
+	while (Events.Dequeue(Event))
+		OutEvents.Add(Event);
+
+	// Events from different producers can be interleaved, so put them back in the order they happened
+	TArrayView<FTimedInputEvent> Drained = MakeArrayView(OutEvents.GetData() + FirstIdx, OutEvents.Num() - FirstIdx);
+	Algo::StableSortBy(Drained, &FTimedInputEvent::Timestamp);
+
+	return Drained.Num();
+}
+
+void FTimedInputQueue::Record(const FPointerEvent& MouseEvent, bool bPressed)
+{
+	// Slate doesn't pass on the platform's timestamp, so the best there is is when it got to us
+	FTimedInputEvent Event;
+	Event.Timestamp = FPlatformTime::Seconds();
+	Event.ScreenLoc = MouseEvent.GetScreenSpacePosition();
+	Event.PointerIdx = MouseEvent.GetPointerIndex();
+	Event.bPressed = bPressed;
+	Events.Enqueue(Event);
+}
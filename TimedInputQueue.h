@@ -0,0 +1,60 @@
+/*  Captures button presses and releases with the time they happened, so lanes can judge a press by when it happened instead of
+	by the frame it was polled in. Where the platform stamps its input events (Android) touches are taken straight from the platform
+	with that stamp, otherwise they're taken from Slate with the time they arrived. Events are pushed into a lock-free queue that
+	any thread can write to and the game thread drains once per frame in timestamp order.
+
+	Copyright (C) 2020-2021 Ilya Tsykunov (ilya@ilyatsykunov.com)
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/Queue.h"
+#include "Framework/Application/IInputProcessor.h"
+
+// A single press or release of a touch / mouse button
+struct FTimedInputEvent
+{
+	// When the event happened, in FPlatformTime::Seconds() time. The platform's own timestamp where there is one, otherwise when Slate handled it
+	double		Timestamp = 0.0;
+	// Absolute (desktop space) location of the pointer
+	FVector2D	ScreenLoc = FVector2D::ZeroVector;
+	// Touch index, or the mouse pointer index
+	uint32		PointerIdx = 0;
+	bool		bPressed = false;
+};
+
+class FTimedInputQueue : public IInputProcessor
+{
+public:
+
+	/* Hooks into the platform's input events where they carry a timestamp. Only one queue can be hooked in at a time
+	*/
+	FTimedInputQueue();
+	virtual ~FTimedInputQueue();
+
+	virtual void Tick(const float DeltaTime, FSlateApplication& SlateApp, TSharedRef<ICursor> Cursor) override {}
+
+	// The events are only recorded, they're never consumed, so the regular input handling still gets them
+	virtual bool HandleMouseButtonDownEvent(FSlateApplication& SlateApp, const FPointerEvent& MouseEvent) override;
+	virtual bool HandleMouseButtonUpEvent(FSlateApplication& SlateApp, const FPointerEvent& MouseEvent) override;
+
+	/* Adds an event to the queue. Can be called from any thread, e.g. by a platform input hook that has more precise timestamps than Slate
+	*/
+	void		Enqueue(const FTimedInputEvent& Event);
+
+	/* Moves every queued event into the output array, oldest first. Game thread only
+	* @return - The number of events drained
+	*/
+	int32		Drain(TArray<FTimedInputEvent>& OutEvents);
+
+	// Whether touches come from the platform's input events, with the platform's timestamps
+	inline bool	HasPlatformTimestamps() const		{ return bPlatformTimestamps; }
+
+private:
+
+	void		Record(const FPointerEvent& MouseEvent, bool bPressed);
+
+	TQueue<FTimedInputEvent, EQueueMode::Mpsc>		Events;
+	bool											bPlatformTimestamps = false;
+};